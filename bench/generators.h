@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+
+#include <lib/asm/compiler.h>
+#include <lib/asm/parser.h>
+
+
+// Synthetic bfasm programs of configurable size for the benchmarks. Every
+// generator produces a complete unit with a `main` macro.
+namespace bftrans::bench {
+    // `n` macros in the style of test.bfasm (copy/div-like temps and loops),
+    // each used once from main.
+    inline std::string flat_program(size_t n) {
+        std::string code;
+
+        for (size_t i = 0; i < n; ++i) {
+            std::string name = "m" + std::to_string(i);
+            code += "MACRO " + name + " (y -> x):\n"
+                    "    temp0[-]\n"
+                    "    x[-]\n"
+                    "    y[x+temp0+y-]\n"
+                    "    temp0[y+temp0-]\n"
+                    "    x++++++++++.\n\n";
+        }
+
+        code += "MACRO main ():\n    a,\n";
+        for (size_t i = 0; i < n; ++i) {
+            code += "    USE m" + std::to_string(i) + " (a -> b)\n";
+        }
+
+        return code;
+    }
+
+    // A chain of `depth` macros, each one using the previous one.
+    inline std::string nested_use(size_t depth) {
+        std::string code = "MACRO m0 (x):\n    x+\n\n";
+
+        for (size_t i = 1; i <= depth; ++i) {
+            code += "MACRO m" + std::to_string(i) + " (x):\n"
+                    "    temp0[-]\n"
+                    "    USE m" + std::to_string(i - 1) + " (x)\n"
+                    "    temp0+x-\n\n";
+        }
+
+        code += "MACRO main ():\n    a,\n    USE m" + std::to_string(depth) + " (a)\n";
+
+        return code;
+    }
+
+    // `n` sequential IF/ELSE constructs, every fourth one nested one level deeper.
+    inline std::string many_ifs(size_t n) {
+        std::string code = "MACRO main ():\n    a,\n    b,\n";
+
+        for (size_t i = 0; i < n; ++i) {
+            if (i % 4 == 3) {
+                code += "    IF a { IF b { c+ } ELSE { c- } } ELSE { d+ }\n";
+            } else {
+                code += "    IF a { c+ } ELSE { d+ }\n";
+            }
+        }
+
+        return code;
+    }
+
+    // Compiled label stream of `program`, rendered in bflabels syntax.
+    inline std::string labels_text(const std::string& program) {
+        auto tokens = bfasm::parse::Tokenizer(program).tokenize();
+        auto unit = bfasm::parse::Parser(*tokens).parse();
+
+        bfasm::compiler::Compiler compiler(*unit);
+        compiler.compile();
+
+        std::stringstream ss;
+        for (auto token : compiler.result) {
+            ss << token;
+        }
+
+        return ss.str();
+    }
+}  // namespace bftrans::bench
@@ -0,0 +1,109 @@
+#include <benchmark/benchmark.h>
+
+#include <lib/asm/compiler.h>
+#include <lib/asm/parser.h>
+#include <lib/labels/bflabels.h>
+
+#include "generators.h"
+
+using namespace bftrans;
+
+
+static void BM_Tokenize(benchmark::State& state) {
+    std::string code = bench::flat_program(state.range(0));
+
+    for (auto _ : state) {
+        auto tokens = bfasm::parse::Tokenizer(code).tokenize();
+        benchmark::DoNotOptimize(tokens);
+    }
+
+    state.SetBytesProcessed(state.iterations() * code.size());
+}
+BENCHMARK(BM_Tokenize)->RangeMultiplier(8)->Range(8, 4096);
+
+
+static void BM_Parse(benchmark::State& state) {
+    std::string code = bench::flat_program(state.range(0));
+    auto tokens = bfasm::parse::Tokenizer(code).tokenize();
+
+    for (auto _ : state) {
+        auto unit = bfasm::parse::Parser(*tokens).parse();
+        benchmark::DoNotOptimize(unit);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tokens->size());
+}
+BENCHMARK(BM_Parse)->RangeMultiplier(8)->Range(8, 4096);
+
+
+static void compile_benchmark(benchmark::State& state, const std::string& code) {
+    auto tokens = bfasm::parse::Tokenizer(code).tokenize();
+    auto unit = bfasm::parse::Parser(*tokens).parse();
+
+    size_t emitted = 0;
+    for (auto _ : state) {
+        bfasm::compiler::Compiler compiler(*unit);
+        compiler.compile();
+        emitted = compiler.result.size();
+        benchmark::DoNotOptimize(compiler.result);
+    }
+
+    state.SetItemsProcessed(state.iterations() * emitted);
+}
+
+static void BM_CompileFlat(benchmark::State& state) {
+    compile_benchmark(state, bench::flat_program(state.range(0)));
+}
+BENCHMARK(BM_CompileFlat)->RangeMultiplier(8)->Range(8, 4096);
+
+static void BM_CompileNestedUse(benchmark::State& state) {
+    compile_benchmark(state, bench::nested_use(state.range(0)));
+}
+BENCHMARK(BM_CompileNestedUse)->RangeMultiplier(4)->Range(4, 1024);
+
+static void BM_CompileManyIfs(benchmark::State& state) {
+    compile_benchmark(state, bench::many_ifs(state.range(0)));
+}
+BENCHMARK(BM_CompileManyIfs)->RangeMultiplier(8)->Range(8, 4096);
+
+
+static void BM_BFLabelsParse(benchmark::State& state) {
+    std::string code = bench::labels_text(bench::many_ifs(state.range(0)));
+
+    for (auto _ : state) {
+        auto tokens = bflabels::Parser(code).parse();
+        benchmark::DoNotOptimize(tokens);
+    }
+
+    state.SetBytesProcessed(state.iterations() * code.size());
+}
+BENCHMARK(BM_BFLabelsParse)->RangeMultiplier(8)->Range(8, 4096);
+
+
+static void BM_BFLCodeLayout(benchmark::State& state) {
+    std::string code = bench::labels_text(bench::flat_program(state.range(0)));
+    auto tokens = *bflabels::Parser(code).parse();
+
+    for (auto _ : state) {
+        bflabels::BFLCode bfl(tokens);
+        benchmark::DoNotOptimize(bfl.memory_layout());
+    }
+
+    state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+BENCHMARK(BM_BFLCodeLayout)->RangeMultiplier(8)->Range(8, 4096);
+
+
+static void BM_BFLCodeCompile(benchmark::State& state) {
+    std::string code = bench::labels_text(bench::flat_program(state.range(0)));
+    auto tokens = *bflabels::Parser(code).parse();
+    bflabels::BFLCode bfl(tokens);
+
+    for (auto _ : state) {
+        auto bf = bfl.compile();
+        benchmark::DoNotOptimize(bf);
+    }
+
+    state.SetItemsProcessed(state.iterations() * tokens.size());
+}
+BENCHMARK(BM_BFLCodeCompile)->RangeMultiplier(8)->Range(8, 4096);
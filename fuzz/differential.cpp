@@ -0,0 +1,230 @@
+#include "differential.h"
+
+#include <algorithm>
+#include <optional>
+#include <set>
+#include <sstream>
+
+#include <lib/asm/compiler.h>
+#include <lib/asm/parser.h>
+#include <lib/opt/closed_form.h>
+#include <lib/opt/pipeline.h>
+#include <lib/vm/interpreter.h>
+
+
+namespace bftrans::fuzz {
+    Execution execute(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::MemoryLayout& layout,
+        std::string_view input,
+        uint64_t max_steps,
+        const bflabels::ClosedLoops& closed_loops,
+        bool direct
+    ) {
+        bflabels::BFLCode code(tokens, layout);
+
+        auto program = [&] {
+            if (direct) {
+                return bfvm::Program::from_labels(tokens, code, closed_loops);
+            }
+
+            std::vector<size_t> token_map;
+            std::string text = code.compile(&token_map);
+
+            auto closed_forms = bfvm::place_closed_loops(closed_loops, code, text, token_map);
+            return bfvm::Program::from_bf(text, true, closed_forms);
+        }();
+
+        Execution execution;
+        if (!program) {
+            return execution;
+        }
+
+        std::stringstream in{std::string(input)};
+        std::stringstream out;
+        bfvm::Interpreter interpreter(*program, in, out);
+
+        execution.finished = interpreter.run(max_steps).has_value();
+        execution.output = out.str();
+
+        for (auto token : tokens) {
+            if (const bflabels::Label* label = std::get_if<bflabels::Label>(&token)) {
+                size_t cell = code.offset(*label);
+                uint8_t value = cell < interpreter.tape.size() ? interpreter.tape[cell] : 0;
+                execution.cells[{label->label_idx, label->element_idx}] = value;
+            }
+        }
+
+        return execution;
+    }
+
+    Execution execute_tiered(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::MemoryLayout& layout,
+        std::string_view input,
+        uint64_t max_steps,
+        const bflabels::ClosedLoops& closed_loops
+    ) {
+        bflabels::BFLCode code(tokens, layout);
+
+        Execution execution;
+        auto program = bfvm::Program::from_labels(tokens, code);
+        if (!program) {
+            return execution;
+        }
+
+        bflabels::ClosedLoops picked;
+        size_t recompiles = 0;
+
+        bfvm::TierUp tier_up {
+            [&](const std::set<uint32_t>& hot) -> std::optional<bfvm::Program> {
+                size_t before = picked.size();
+                for (uint32_t pos : hot) {
+                    if (auto loop = closed_loops.find(pos); loop != closed_loops.end()) {
+                        picked.insert(*loop);
+                    }
+                }
+
+                if (picked.size() == before || recompiles == TIERED_RECOMPILES) {
+                    return std::nullopt;
+                }
+                ++recompiles;
+
+                auto program = bfvm::Program::from_labels(tokens, code, picked);
+                if (!program) {
+                    return std::nullopt;
+                }
+                return std::move(*program);
+            },
+            1,
+        };
+
+        std::stringstream in{std::string(input)};
+        std::stringstream out;
+
+        execution.finished = bfvm::run_dialect(*program, bfvm::Dialect {}, in, out, max_steps, nullptr, &tier_up).has_value();
+        execution.output = out.str();
+
+        return execution;
+    }
+
+    bflabels::MemoryLayout shuffled_layout(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::MemoryLayout& reserved,
+        Entropy& entropy
+    ) {
+        std::map<bflabels::Label, size_t> extents = reserved.label_extents;
+        for (auto token : tokens) {
+            if (const bflabels::Label* label = std::get_if<bflabels::Label>(&token)) {
+                size_t& extent = extents[*label];
+                extent = std::max(extent, label->element_idx + 1);
+            }
+        }
+
+        std::vector<std::pair<bflabels::Label, size_t>> order(extents.begin(), extents.end());
+        for (size_t i = order.size(); i > 1; --i) {
+            std::swap(order[i - 1], order[entropy.below(i)]);
+        }
+
+        bflabels::MemoryLayout layout;
+        layout.label_extents = reserved.label_extents;
+        int64_t offset = 0;
+        for (auto [label, extent] : order) {
+            layout.label_offsets[bflabels::Label { label.label_idx, 0 }] = offset;
+            offset += extent;
+        }
+
+        return layout;
+    }
+
+    static CheckResult failed(std::string failure) {
+        return CheckResult { CheckResult::Failed, std::move(failure) };
+    }
+
+    CheckResult check_unit(
+        const std::string& code,
+        std::string_view input,
+        Entropy& entropy,
+        const CheckOptions& options
+    ) {
+        auto tokens = bfasm::parse::Tokenizer(code).tokenize();
+        if (!tokens) {
+            std::stringstream ss;
+            ss << "generated unit does not tokenize: " << tokens.error();
+            return failed(ss.str());
+        }
+
+        auto unit = bfasm::parse::Parser(*tokens).parse();
+        if (!unit) {
+            std::stringstream ss;
+            ss << "generated unit does not parse: " << unit.error();
+            return failed(ss.str());
+        }
+
+        bfasm::compiler::Compiler compiler(*unit);
+        if (auto error = compiler.compile()) {
+            std::stringstream ss;
+            ss << "generated unit does not compile: " << *error;
+            return failed(ss.str());
+        }
+
+        auto reference = execute(compiler.result, compiler.layout, input, options.max_steps);
+        if (!reference.finished) {
+            return CheckResult { CheckResult::Skipped, {} };
+        }
+
+        bflabels::opt::Stream stream { compiler.result, compiler.result_origins };
+        bflabels::opt::optimize(stream, options.opt_level, compiler.layout);
+
+        if (!stream.origins.empty() && stream.origins.size() != stream.tokens.size()) {
+            return failed("optimized stream lost track of token origins");
+        }
+
+        // Optimized programs may be laid out worse, but never much slower.
+        bflabels::ClosedLoops closed_loops;
+        if (options.opt_level >= 1) {
+            closed_loops = bflabels::opt::find_closed_loops(stream.tokens);
+        }
+
+        auto layout = shuffled_layout(stream.tokens, compiler.layout, entropy);
+        auto candidate = execute(stream.tokens, layout, input, 4 * options.max_steps, closed_loops);
+
+        if (!candidate.finished) {
+            return failed("optimized program did not finish");
+        }
+
+        auto direct = execute(stream.tokens, layout, input, 4 * options.max_steps, closed_loops, true);
+
+        if (!direct.finished || direct.output != candidate.output || direct.cells != candidate.cells) {
+            return failed("label-addressed run differs from brainfuck");
+        }
+
+        if (options.opt_level >= 1) {
+            auto tiered = execute_tiered(stream.tokens, layout, input, 4 * options.max_steps, closed_loops);
+
+            if (!tiered.finished || tiered.output != direct.output) {
+                return failed("tiered run differs from plain one");
+            }
+        }
+
+        if (candidate.output != reference.output) {
+            return failed("outputs differ");
+        }
+
+        for (const auto& [label, value] : candidate.cells) {
+            if (stream.merged.contains(label.first)) {
+                continue;
+            }
+
+            auto it = reference.cells.find(label);
+            if (it != reference.cells.end() && it->second != value) {
+                std::stringstream ss;
+                ss << "final value of var" << label.first << " differs: "
+                   << (int)it->second << " unoptimized, " << (int)value << " optimized";
+                return failed(ss.str());
+            }
+        }
+
+        return CheckResult { CheckResult::Passed, {} };
+    }
+}  // namespace bftrans::fuzz
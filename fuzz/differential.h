@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <lib/labels/bflabels.h>
+
+#include "generator.h"
+
+
+namespace bftrans::fuzz {
+    struct Execution {
+        bool finished = false;
+        std::string output;
+
+        // Final value of every cell the program names, by (label, element).
+        std::map<std::pair<size_t, size_t>, uint8_t> cells;
+    };
+
+    // Lays `tokens` out with `layout`, emits brainfuck and runs it in the
+    // built-in interpreter on `input` for at most `max_steps` ops, with the
+    // loops in `closed_loops` replaced by their closed forms. With `direct`,
+    // the tokens are lowered straight to label-addressed ops instead.
+    Execution execute(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::MemoryLayout& layout,
+        std::string_view input,
+        uint64_t max_steps,
+        const bflabels::ClosedLoops& closed_loops = {},
+        bool direct = false
+    );
+
+    // Lowers `tokens` straight to label-addressed ops and runs them tiered,
+    // loops of `closed_loops` getting their closed forms once they exit
+    // after a back-edge, for the first `TIERED_RECOMPILES` such loops. Only
+    // `finished` and `output` are filled.
+    constexpr size_t TIERED_RECOMPILES = 4;
+
+    Execution execute_tiered(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::MemoryLayout& layout,
+        std::string_view input,
+        uint64_t max_steps,
+        const bflabels::ClosedLoops& closed_loops
+    );
+
+    // A layout placing the labels of `tokens` in a random order, keeping the
+    // extents `reserved` asks for.
+    bflabels::MemoryLayout shuffled_layout(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::MemoryLayout& reserved,
+        Entropy& entropy
+    );
+
+    struct CheckOptions {
+        unsigned opt_level = 2;
+        uint64_t max_steps = 200000;
+    };
+
+    struct CheckResult {
+        enum {
+            Passed,
+            // The reference run did not finish within the step budget.
+            Skipped,
+            Failed,
+        } status;
+
+        std::string failure;
+    };
+
+    // Compiles `code` unoptimized with the default layout as the reference,
+    // then at `opt_level` with a shuffled layout (and closed-form loops from
+    // level 1 on), runs both on `input` and
+    // compares output, termination and the final value of every label the
+    // optimized program still names. The optimized program also runs lowered
+    // straight from its labels, which must agree with its brainfuck.
+    CheckResult check_unit(
+        const std::string& code,
+        std::string_view input,
+        Entropy& entropy,
+        const CheckOptions& options = {}
+    );
+}  // namespace bftrans::fuzz
@@ -0,0 +1,277 @@
+#include "generator.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+
+namespace bftrans::fuzz {
+    uint32_t Entropy::below(uint32_t bound) {
+        if (!from_data) {
+            return std::uniform_int_distribution<uint32_t>(0, bound - 1)(rng);
+        }
+
+        uint32_t value = 0;
+        for (uint32_t range = 1; range < bound; range <<= 8) {
+            value <<= 8;
+            if (size) {
+                value |= *data++;
+                --size;
+            }
+        }
+
+        return value % bound;
+    }
+
+    namespace {
+        struct MacroSignature {
+            std::string name;
+            size_t arguments;
+            size_t returns;
+
+            // Statements it amounts to with its USEs inlined.
+            size_t expansion;
+        };
+
+        class Generator {
+          private:
+            Entropy& entropy;
+            const GeneratorLimits& limits;
+
+            std::vector<MacroSignature> macros;
+            std::vector<std::string> labels;
+            std::string code;
+
+            // Statements the current macro amounts to so far.
+            size_t expansion = 0;
+
+            const std::string& pick(const std::vector<std::string>& from) {
+                return from[entropy.below(from.size())];
+            }
+
+            // Labels the current block may modify: everything but the
+            // conditions of the enclosing loops.
+            std::vector<std::string> writable(const std::set<std::string>& pinned) {
+                std::vector<std::string> result;
+                for (const auto& label : labels) {
+                    if (!pinned.contains(label)) {
+                        result.push_back(label);
+                    }
+                }
+                return result;
+            }
+
+            void indent(size_t depth) {
+                code.append(4 * (depth + 1), ' ');
+            }
+
+            void statement(size_t depth, const std::set<std::string>& pinned) {
+                auto free = writable(pinned);
+                ++expansion;
+
+                if (free.empty()) {
+                    indent(depth);
+                    code += pick(labels) + ".\n";
+                    return;
+                }
+
+                uint32_t kind = entropy.below(depth < limits.depth ? 10 : 6);
+                indent(depth);
+
+                switch (kind) {
+                    case 0:
+                        code += pick(free) + std::string(1 + entropy.below(12), '+') + '\n';
+                        break;
+
+                    case 1:
+                        code += pick(free) + std::string(1 + entropy.below(5), '-') + '\n';
+                        break;
+
+                    case 2:
+                        code += pick(labels) + ".\n";
+                        break;
+
+                    case 3:
+                        code += pick(free) + ",\n";
+                        break;
+
+                    case 4: {
+                        const auto& x = pick(free);
+                        const auto& y = pick(free);
+
+                        const auto& t = pick(free);
+
+                        if (x == y) {
+                            code += x + "[-]\n";
+                        } else if (t != x && t != y && entropy.chance(2)) {
+                            // The copy idiom that copy coalescing looks for.
+                            code += t + "[-]" + y + "[-]" + x + '[' + y + '+' + t + '+' + x + "-]" + t + '[' + x + '+' + t + "-]\n";
+                        } else {
+                            code += x + '[' + y + std::string(1 + entropy.below(3), '+') + x + "-]\n";
+                        }
+                        break;
+                    }
+
+                    case 5: {
+                        std::vector<const MacroSignature*> fitting;
+                        for (const auto& macro : macros) {
+                            if (expansion + macro.expansion <= limits.expansion) {
+                                fitting.push_back(&macro);
+                            }
+                        }
+
+                        if (fitting.empty()) {
+                            code += pick(free) + "+\n";
+                            break;
+                        }
+
+                        const auto& macro = *fitting[entropy.below(fitting.size())];
+                        expansion += macro.expansion;
+                        code += "USE " + macro.name + " (";
+                        for (size_t i = 0; i < macro.arguments; ++i) {
+                            code += ' ' + pick(free);
+                        }
+                        if (macro.returns) {
+                            code += " ->";
+                            for (size_t i = 0; i < macro.returns; ++i) {
+                                code += ' ' + pick(free);
+                            }
+                        }
+                        code += " )\n";
+                        break;
+                    }
+
+                    case 6:
+                    case 7: {
+                        code += "IF " + pick(labels) + " {\n";
+                        block(depth + 1, pinned);
+                        indent(depth);
+                        code += '}';
+
+                        if (entropy.chance(2)) {
+                            code += " ELSE {\n";
+                            block(depth + 1, pinned);
+                            indent(depth);
+                            code += '}';
+                        }
+
+                        code += '\n';
+                        break;
+                    }
+
+                    case 8: {
+                        const auto& x = pick(free);
+                        auto inner = pinned;
+                        inner.insert(x);
+
+                        code += "WHILE " + x + " {\n";
+                        block(depth + 1, inner);
+                        indent(depth + 1);
+                        code += x + "-\n";
+                        indent(depth);
+                        code += "}\n";
+                        break;
+                    }
+
+                    case 9: {
+                        code += "SWITCH " + pick(labels) + " {\n";
+
+                        std::set<uint32_t> values;
+                        for (size_t i = 1 + entropy.below(3); i > 0; --i) {
+                            values.insert(entropy.chance(2) ? entropy.below(4) : entropy.below(256));
+                        }
+
+                        for (uint32_t value : values) {
+                            indent(depth + 1);
+                            code += "CASE " + std::to_string(value) + " {\n";
+                            block(depth + 2, pinned);
+                            indent(depth + 1);
+                            code += "}\n";
+                        }
+
+                        if (entropy.chance(2)) {
+                            indent(depth + 1);
+                            code += "DEFAULT {\n";
+                            block(depth + 2, pinned);
+                            indent(depth + 1);
+                            code += "}\n";
+                        }
+
+                        indent(depth);
+                        code += "}\n";
+                        break;
+                    }
+                }
+            }
+
+            void block(size_t depth, const std::set<std::string>& pinned) {
+                size_t statements = 1 + entropy.below(limits.statements);
+                for (size_t i = 0; i < statements; ++i) {
+                    statement(depth, pinned);
+                }
+            }
+
+            void macro(const std::string& name, size_t arguments, size_t returns) {
+                labels.clear();
+                expansion = 0;
+
+                code += "MACRO " + name + " (";
+                for (size_t i = 0; i < arguments; ++i) {
+                    labels.push_back("a" + std::to_string(i));
+                    code += ' ' + labels.back();
+                }
+                if (returns) {
+                    code += " ->";
+                    for (size_t i = 0; i < returns; ++i) {
+                        labels.push_back("r" + std::to_string(i));
+                        code += ' ' + labels.back();
+                    }
+                }
+                code += " ):\n";
+
+                size_t locals = 1 + entropy.below(limits.locals);
+                for (size_t i = 0; i < locals; ++i) {
+                    labels.push_back("t" + std::to_string(i));
+                }
+
+                // Locals of non-main macros start with whatever the previous
+                // user of the cell left there, as in hand-written macros.
+                if (name == "main") {
+                    for (size_t i = 0; i < locals; ++i) {
+                        if (entropy.chance(2)) {
+                            indent(0);
+                            code += "t" + std::to_string(i) + ",\n";
+                        }
+                    }
+                }
+
+                block(0, {});
+                code += '\n';
+
+                macros.push_back(MacroSignature { name, arguments, returns, expansion });
+            }
+
+          public:
+            Generator(Entropy& entropy, const GeneratorLimits& limits) :
+                entropy(entropy),
+                limits(limits) {}
+
+            std::string run() {
+                size_t count = entropy.below(limits.macros + 1);
+
+                for (size_t i = 0; i < count; ++i) {
+                    macro("m" + std::to_string(i), entropy.below(3), entropy.below(2));
+                }
+
+                macro("main", 0, 0);
+
+                return std::move(code);
+            }
+        };
+    }  // namespace
+
+    std::string generate_unit(Entropy& entropy, const GeneratorLimits& limits) {
+        return Generator(entropy, limits).run();
+    }
+}  // namespace bftrans::fuzz
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+
+namespace bftrans::fuzz {
+    // Source of the generator's choices: a seeded PRNG for standalone runs, or
+    // the raw bytes of a libFuzzer input, read as zeros once exhausted.
+    class Entropy {
+      private:
+        std::mt19937_64 rng;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        bool from_data = false;
+
+      public:
+        Entropy(uint64_t seed) : rng(seed) {}
+
+        Entropy(const uint8_t* data, size_t size) :
+            data(data),
+            size(size),
+            from_data(true) {}
+
+        // Uniform-ish value in [0, bound), bound > 0.
+        uint32_t below(uint32_t bound);
+
+        bool chance(uint32_t one_in) {
+            return below(one_in) == 0;
+        }
+    };
+
+    struct GeneratorLimits {
+        size_t macros = 4;
+        size_t depth = 3;
+        size_t statements = 6;
+        size_t locals = 4;
+
+        // Statements a macro may amount to with its USEs inlined, as nested
+        // USEs otherwise multiply into streams too large to compile.
+        size_t expansion = 4096;
+    };
+
+    // A random valid bfasm unit using plain ops, raw loops, IF/ELSE, WHILE,
+    // SWITCH and USE. Every loop the generator writes terminates; USE argument
+    // aliasing can still produce ones that do not, which the step budget
+    // catches.
+    std::string generate_unit(Entropy& entropy, const GeneratorLimits& limits = {});
+}  // namespace bftrans::fuzz
@@ -0,0 +1,32 @@
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "differential.h"
+#include "generator.h"
+
+using namespace bftrans;
+
+
+// The input bytes drive every choice of the generator, so libFuzzer's
+// mutations explore the space of bfasm units rather than raw text.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    fuzz::Entropy entropy(data, size);
+
+    std::string code = fuzz::generate_unit(entropy);
+
+    std::string input;
+    for (size_t n = entropy.below(16); n; --n) {
+        input += (char)entropy.below(256);
+    }
+
+    auto result = fuzz::check_unit(code, input, entropy);
+
+    if (result.status == fuzz::CheckResult::Failed) {
+        std::cerr << result.failure << "\n\n" << code << '\n';
+        __builtin_trap();
+    }
+
+    return 0;
+}
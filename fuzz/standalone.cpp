@@ -0,0 +1,79 @@
+#include <charconv>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "differential.h"
+#include "generator.h"
+
+using namespace bftrans;
+
+
+// Usage: bftrans_fuzz [--seed=<n>] [--iterations=<n>] [-O<level>]
+//
+// Checks `iterations` generated units starting at `seed`, one seed per unit,
+// and prints the first failing unit with its seed and input.
+int main(int argc, char** argv) {
+    uint64_t seed = 1;
+    uint64_t iterations = 1000;
+    fuzz::CheckOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+
+        auto number = [&](std::string_view value, uint64_t& into) {
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), into);
+            return ec == std::errc{} && ptr == value.data() + value.size();
+        };
+
+        bool ok = false;
+        if (arg.starts_with("--seed=")) {
+            ok = number(arg.substr(7), seed);
+        } else if (arg.starts_with("--iterations=")) {
+            ok = number(arg.substr(13), iterations);
+        } else if (arg.starts_with("-O")) {
+            uint64_t level = 0;
+            ok = number(arg.substr(2), level);
+            options.opt_level = level;
+        }
+
+        if (!ok) {
+            std::cerr << "Usage: bftrans_fuzz [--seed=<n>] [--iterations=<n>] [-O<level>]\n";
+            return 2;
+        }
+    }
+
+    uint64_t skipped = 0;
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        fuzz::Entropy entropy(seed + i);
+
+        std::string code = fuzz::generate_unit(entropy);
+
+        std::string input;
+        for (size_t n = entropy.below(16); n; --n) {
+            input += (char)entropy.below(256);
+        }
+
+        auto result = fuzz::check_unit(code, input, entropy, options);
+
+        if (result.status == fuzz::CheckResult::Skipped) {
+            ++skipped;
+        }
+
+        if (result.status == fuzz::CheckResult::Failed) {
+            std::cerr << "Seed " << seed + i << ": " << result.failure << "\n\n"
+                      << code << "\nInput bytes:";
+            for (unsigned char ch : input) {
+                std::cerr << ' ' << (int)ch;
+            }
+            std::cerr << '\n';
+            return 1;
+        }
+    }
+
+    std::cout << "Checked " << iterations << " units, " << skipped << " skipped as non-terminating.\n";
+
+    return 0;
+}
@@ -41,6 +41,10 @@ std::ostream& operator<<(std::ostream& os, const bfasm::ast::Label& label) {
     return os;
 }
 
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Location&) {
+    return os;
+}
+
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::Use& use) {
     os << "USE " << use.macro_name << " (";
 
@@ -75,3 +79,75 @@ std::ostream& operator<<(std::ostream& os, const bfasm::ast::While& while_) {
 
     return os;
 }
+
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Switch& switch_) {
+    os << "SWITCH " << switch_.condition << " { ";
+
+    for (const auto& case_ : switch_.cases) {
+        os << "CASE " << (int)case_.value << " { " << case_.block << " } ";
+    }
+
+    if (!switch_.default_block.empty()) {
+        os << "DEFAULT { " << switch_.default_block << " } ";
+    }
+
+    os << "} ";
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Array& array) {
+    os << "ARRAY " << array.name << '(' << array.size << ") ";
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Get& get) {
+    os << "GET " << get.array << '[' << get.index << "] -> " << get.into << ' ';
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Set& set) {
+    os << "SET " << set.array << '[' << set.index << "] " << set.value << ' ';
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Int& int_) {
+    os << "INT " << int_.name << '(' << int_.width << ") ";
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Arithmetic& arithmetic) {
+    using Kind = bfasm::ast::Arithmetic::Kind;
+
+    switch (arithmetic.kind) {
+        case Kind::Add:
+            os << "ADD ";
+            break;
+        case Kind::Sub:
+            os << "SUB ";
+            break;
+        case Kind::Mul:
+            os << "MUL ";
+            break;
+        case Kind::DivMod:
+            os << "DIVMOD ";
+            break;
+        case Kind::Less:
+            os << "LESS ";
+            break;
+    }
+
+    os << arithmetic.x << ' ' << arithmetic.y << " ->";
+
+    for (const auto& into : arithmetic.into) {
+        os << ' ' << into;
+    }
+
+    os << ' ';
+
+    return os;
+}
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <map>
 #include <variant>
 #include <vector>
 
+#include "tokenizer.h"
 
 namespace bfasm::ast {
 
@@ -12,16 +14,30 @@ namespace bfasm::ast {
     
     using Plain = char;
     struct Label;
+    struct Location;
     struct Use;
     struct If;
     struct While;
+    struct Switch;
+    struct Array;
+    struct Get;
+    struct Set;
+    struct Int;
+    struct Arithmetic;
 
     using ASTNode = std::variant<
         Plain,
         Label,
+        Location,
         Use,
         If,
-        While
+        While,
+        Switch,
+        Array,
+        Get,
+        Set,
+        Int,
+        Arithmetic
     >;
 
     using ASTBlock = std::vector<ASTNode>;
@@ -32,10 +48,17 @@ namespace bfasm::ast {
         bool operator==(const Label& other) const = default;
     };
 
+    // Source position of the nodes that follow it in the block, emitted by the
+    // parser whenever the source line changes.
+    struct Location {
+        parse::Position pos;
+    };
+
     struct Use {
         std::string macro_name;
         std::vector<ast::Label> arguments;
         std::vector<ast::Label> return_into;
+        parse::Position pos;
     };
 
     struct If {
@@ -49,6 +72,65 @@ namespace bfasm::ast {
         ASTBlock do_block;
     };
 
+    struct Case {
+        uint8_t value;
+        ASTBlock block;
+    };
+
+    // Cases are sorted by value, which are distinct.
+    struct Switch {
+        Label condition;
+        std::vector<Case> cases;
+        ASTBlock default_block;
+    };
+
+    // Reserves `size` byte elements for `name`, indexed at runtime by GET and
+    // SET. The label's own cell belongs to the array and must not be used
+    // directly.
+    struct Array {
+        Label name;
+        size_t size;
+    };
+
+    // into = array[index]
+    struct Get {
+        Label array;
+        Label index;
+        Label into;
+    };
+
+    // array[index] = value
+    struct Set {
+        Label array;
+        Label index;
+        Label value;
+    };
+
+    // Makes `name` a `width`-byte integer, least significant byte first.
+    // Plain code on the label reaches the low byte.
+    struct Int {
+        Label name;
+        size_t width;
+    };
+
+    // `ADD x y -> z` and the like; DIVMOD stores the quotient and the
+    // remainder. Operands are zero-extended or truncated to the width of the
+    // operation, which is that of `z` for ADD, SUB and MUL, and the widest
+    // operand for DIVMOD and LESS.
+    struct Arithmetic {
+        enum Kind {
+            Add,
+            Sub,
+            Mul,
+            DivMod,
+            Less,
+        } kind;
+
+        Label x;
+        Label y;
+        std::vector<Label> into;
+    };
+
     struct Macro {
         std::string name;
         ast::ASTBlock block;
@@ -71,6 +153,13 @@ std::ostream& operator<<(std::ostream& os, const bfasm::ast::Macro& macro);
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::ASTNode& node);
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::ASTBlock& block);
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::Label& label);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Location& location);
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::Use& use);
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::If& if_);
 std::ostream& operator<<(std::ostream& os, const bfasm::ast::While& while_);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Switch& switch_);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Array& array);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Get& get);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Set& set);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Int& int_);
+std::ostream& operator<<(std::ostream& os, const bfasm::ast::Arithmetic& arithmetic);
@@ -3,6 +3,7 @@
 #include <expected>
 #include "../labels/bflabels.h"
 #include "ast.h"
+#include "liveness.h"
 #include "utils.h"
 
 
@@ -30,13 +31,35 @@ namespace bfasm::compiler {
             labels.pop_back();
         };
 
+        // Binds `new_labels` in the current frame to `old_labels` as the
+        // parent frame sees them. Labels the parent has not used yet are
+        // created there, so they outlive the current frame.
         void merge_injection(const std::vector<ast::Label>& new_labels, const std::vector<ast::Label>& old_labels) {
-            auto& curr = labels.back().first;
+            auto& [parent, parent_last_id] = labels[labels.size() - 2];
+            auto& [curr, last_id] = labels.back();
+
             for (size_t i = 0; i < new_labels.size(); ++i) {
-                curr[new_labels[i]] = get(old_labels[i]);
+                auto [it, inserted] = parent.try_emplace(old_labels[i]);
+                if (inserted) {
+                    it->second = bflabels::Label { ++parent_last_id };
+                    last_id = std::max(last_id, parent_last_id);
+                    curr.try_emplace(old_labels[i], it->second);
+                }
+
+                curr[new_labels[i]] = it->second;
             }
         };
 
+        bool contains(ast::Label label) const {
+            return labels.back().first.contains(label);
+        }
+
+        // Every label of the current frame that is not visible to the parent
+        // has a greater id.
+        size_t last_id() const {
+            return labels.back().second;
+        }
+
         bflabels::Label get(ast::Label label) {
             auto& curr = labels.back().first;
             auto& last_id = labels.back().second;
@@ -64,121 +87,803 @@ namespace bfasm::compiler {
     template <typename T>
     using CompileResult = std::expected<T, CompileError>;
 
+    // One macro expansion. `call` is the USE site in the parent frame; the
+    // root frame is `main` and has no parent.
+    struct Frame {
+        static constexpr size_t ROOT = -1;
+
+        std::string_view macro;
+        parse::Position call;
+        size_t parent;
+    };
+
+    // Provenance of a compiled token: the frame it was expanded in and the
+    // bfasm source position it was written at.
+    struct Origin {
+        size_t frame;
+        parse::Position pos;
+    };
+
+    // How an IF is lowered, from cheapest to most general. The destructive
+    // forms leave the condition zeroed and are only used when it is dead
+    // after the IF.
+    enum class IfLowering {
+        // x[ code1 x[-] ]
+        Destructive,
+        // temp0[-]+ x[ code1 temp0- x[-] ] temp0[ code2 temp0- ]
+        DestructiveElse,
+        // temp1[-] x[ code1 x[temp1+x-] ] temp1[x+temp1-]
+        NoElse,
+        // temp0[-]+ temp1[-] x[ code1 temp0- x[temp1+x-] ] temp1[x+temp1-]
+        // temp0[ code2 temp0- ]
+        Preserving,
+    };
+
     class Compiler {
       public:
         std::vector<bflabels::Token> result;
         const ast::Unit& unit;
         StackLabels labeler;
 
+        // `result_origins[i]` indexes `origins` for `result[i]`.
+        std::vector<Frame> frames;
+        std::vector<Origin> origins;
+        std::vector<size_t> result_origins;
+
+        // Cells reserved for ARRAY regions; `result` must be laid out with it.
+        bflabels::MemoryLayout layout;
+
+      private:
+        size_t frame = Frame::ROOT;
+        size_t origin = 0;
+
+        // First error found while compiling a block.
+        std::optional<CompileError> error;
+
+        // Sizes of ARRAY and widths of INT labels, by label id, for the
+        // labels of the current frame and its parents.
+        std::unordered_map<size_t, size_t> arrays;
+        std::unordered_map<size_t, size_t> widths;
+
+        // Per macro and set of labels it inherits from the expansion site.
+        std::map<std::pair<const ast::Macro*, std::vector<size_t>>, Liveness> liveness;
+        const Liveness* macro_liveness = nullptr;
+
+        // Must be called once the macro's arguments and returns are bound.
+        const Liveness& liveness_of(const ast::Macro& macro) {
+            std::unordered_set<ast::Label> inherited;
+            std::vector<size_t> key;
+
+            for (ast::Label label : Liveness::labels(macro)) {
+                if (labeler.contains(label)) {
+                    inherited.insert(label);
+                    key.push_back(label.id);
+                }
+            }
+
+            auto it = liveness.find({&macro, key});
+            if (it == liveness.end()) {
+                it = liveness.emplace(std::pair(&macro, std::move(key)), Liveness::analyze(macro, std::move(inherited))).first;
+            }
+            return it->second;
+        }
+
+        static bool has_code(const ast::ASTBlock& block) {
+            for (const auto& node : block) {
+                if (!std::holds_alternative<ast::Location>(node)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void enter_origin(size_t frame, parse::Position pos) {
+            origins.push_back(Origin { frame, pos });
+            origin = origins.size() - 1;
+        }
+
+      public:
         Compiler(const ast::Unit& unit) : unit(unit) {}
 
         std::optional<CompileError> compile() {
+            if (!unit.contains("main")) {
+                return CompileError("No main macro.");
+            }
+
             const auto& main = unit.at("main");
 
             if (!main.arguments.empty() || !main.returns.empty()) {
                 return CompileError("main macro shouldn't take or return any labels.");
             }
 
+            frames.push_back(Frame { main.name, parse::Position::END, Frame::ROOT });
+            frame = 0;
+            enter_origin(frame, parse::Position::END);
+            macro_liveness = &liveness_of(main);
+
             compile_block(main.block);
 
-            return std::nullopt;
+            return error;
+        }
+
+        void emit(bflabels::Token token) {
+            result.push_back(token);
+            result_origins.push_back(origin);
         }
 
         void push_plains(std::string_view plains) {
             for (char ch : plains) {
-                result.emplace_back(ch);
+                emit(ch);
             }
         }
 
         void compile_use(const ast::Use& use) {
             auto& macro = unit.at(use.macro_name);
 
+            size_t caller_frame = frame;
+            size_t caller_origin = origin;
+            const Liveness* caller_liveness = macro_liveness;
+
+            frames.push_back(Frame { macro.name, use.pos, caller_frame });
+            frame = frames.size() - 1;
+            enter_origin(frame, use.pos);
+
             labeler.push();
             labeler.merge_injection(macro.arguments, use.arguments);
             labeler.merge_injection(macro.returns, use.return_into);
+            macro_liveness = &liveness_of(macro);
             
             compile_block(macro.block);
 
             labeler.pop();
+
+            // Ids of the macro's own labels are reused by the next expansion.
+            std::erase_if(arrays, [&](const auto& array) {
+                return array.first > labeler.last_id();
+            });
+            std::erase_if(widths, [&](const auto& width) {
+                return width.first > labeler.last_id();
+            });
+
+            frame = caller_frame;
+            origin = caller_origin;
+            macro_liveness = caller_liveness;
         };
 
-        void compile_block(const ast::ASTBlock& block) {
-            for (const auto& node : block) {
-                std::visit(overloaded {
-                    [&](ast::Plain p) {
-                        result.emplace_back(p);
-                    },
-                    [&](ast::Label label) {
-                        result.emplace_back(labeler.get(label));
-                    },
-                    [&](const ast::Use& use) {
-                        compile_use(use);
-                    },
-                    [&](const ast::If& if_) {
-                        bflabels::Label temp0 = labeler.temp();
-                        bflabels::Label temp1 = labeler.temp();
-                        bflabels::Label x = labeler.get(if_.condition);
+        IfLowering lowering(const ast::If& if_) const {
+            bool live = macro_liveness->condition_live_after(if_);
+            bool has_else = has_code(if_.else_block);
 
-                        // temp0[-]+
-                        result.emplace_back(temp0);
-                        push_plains("[-]+");
+            if (!live) {
+                return has_else ? IfLowering::DestructiveElse : IfLowering::Destructive;
+            }
+            return has_else ? IfLowering::Preserving : IfLowering::NoElse;
+        }
 
-                        // temp1[-]
-                        result.emplace_back(temp1);
-                        push_plains("[-]");
+        void compile_if(const ast::If& if_) {
+            IfLowering form = lowering(if_);
 
-                        // x[
-                        result.emplace_back(x);
-                        push_plains("[");
+            bool destructive = form == IfLowering::Destructive || form == IfLowering::DestructiveElse;
+            bool has_else = form == IfLowering::DestructiveElse || form == IfLowering::Preserving;
 
-                        // code1
-                        compile_block(if_.then_block);
+            bflabels::Label temp0 = has_else ? labeler.temp() : bflabels::Label {};
+            bflabels::Label temp1 = destructive ? bflabels::Label {} : labeler.temp();
+            bflabels::Label x = labeler.get(if_.condition);
 
-                        //     temp0-
-                        result.emplace_back(temp0);
-                        push_plains("-");
+            if (has_else) {
+                // temp0[-]+
+                emit(temp0);
+                push_plains("[-]+");
+            }
 
-                        //     x[temp1+x-]
-                        result.emplace_back(x);
-                        push_plains("[");
-                        result.emplace_back(temp1);
-                        push_plains("+");
-                        result.emplace_back(x);
-                        push_plains("-]");
+            if (!destructive) {
+                // temp1[-]
+                emit(temp1);
+                push_plains("[-]");
+            }
 
-                        // ]
-                        push_plains("]");
+            // x[
+            emit(x);
+            push_plains("[");
 
-                        // temp1[x+temp1-]
-                        result.emplace_back(temp1);
-                        push_plains("[");
-                        result.emplace_back(x);
-                        push_plains("+");
-                        result.emplace_back(temp1);
-                        push_plains("-]");
+            // code1
+            size_t if_origin = origin;
+            compile_block(if_.then_block);
+            origin = if_origin;
 
-                        // temp0[
-                        result.emplace_back(temp0);
-                        push_plains("[");
+            if (has_else) {
+                //     temp0-
+                emit(temp0);
+                push_plains("-");
+            }
+
+            if (destructive) {
+                //     x[-]
+                emit(x);
+                push_plains("[-]");
+            } else {
+                //     x[temp1+x-]
+                emit(x);
+                push_plains("[");
+                emit(temp1);
+                push_plains("+");
+                emit(x);
+                push_plains("-]");
+            }
+
+            // ]
+            push_plains("]");
+
+            if (!destructive) {
+                // temp1[x+temp1-]
+                emit(temp1);
+                push_plains("[");
+                emit(x);
+                push_plains("+");
+                emit(temp1);
+                push_plains("-]");
+            }
 
-                        // code2
-                        compile_block(if_.else_block);
+            if (has_else) {
+                // temp0[
+                emit(temp0);
+                push_plains("[");
+
+                // code2
+                compile_block(if_.else_block);
+                origin = if_origin;
+
+                // temp0-]
+                emit(temp0);
+                push_plains("-]");
+            }
+        }
+
+        // Decrement chain over the cases in order of value, with a flag that
+        // the first matching body (or the default) clears:
+        //
+        // flag[-] t[-] x[t+flag+x-] flag[x+flag-] flag+
+        // t-v1 [ t-(v2-v1) [ ... t[-] flag- default t ] flag[ case2 flag- ] t ]
+        // flag[ case1 flag- ]
+        //
+        // When x is dead afterwards and no case reads it, x itself is counted
+        // down instead of a copy.
+        void compile_switch(const ast::Switch& switch_) {
+            size_t switch_origin = origin;
+
+            if (switch_.cases.empty()) {
+                compile_block(switch_.default_block);
+                origin = switch_origin;
+                return;
+            }
 
-                        // temp0-]
-                        result.emplace_back(temp0);
-                        push_plains("-]");
+            bool destructive = !macro_liveness->condition_live_after(switch_);
+
+            bflabels::Label flag = labeler.temp();
+            bflabels::Label t = destructive ? bflabels::Label {} : labeler.temp();
+            bflabels::Label x = labeler.get(switch_.condition);
+
+            // flag[-]
+            emit(flag);
+            push_plains("[-]");
+
+            if (destructive) {
+                t = x;
+            } else {
+                // t[-] x[t+flag+x-] flag[x+flag-]
+                emit(t);
+                push_plains("[-]");
+                emit(x);
+                push_plains("[");
+                emit(t);
+                push_plains("+");
+                emit(flag);
+                push_plains("+");
+                emit(x);
+                push_plains("-]");
+                emit(flag);
+                push_plains("[");
+                emit(x);
+                push_plains("+");
+                emit(flag);
+                push_plains("-]");
+            }
+
+            // flag+
+            emit(flag);
+            push_plains("+");
+
+            // t-v1 [ t-(v2-v1) [ ...
+            uint8_t previous = 0;
+            for (const auto& case_ : switch_.cases) {
+                emit(t);
+                push_plains(std::string(case_.value - previous, '-'));
+                push_plains("[");
+                previous = case_.value;
+            }
+
+            // t[-] flag- default
+            emit(t);
+            push_plains("[-]");
+            emit(flag);
+            push_plains("-");
+            compile_block(switch_.default_block);
+            origin = switch_origin;
+
+            for (auto case_ = switch_.cases.rbegin(); case_ != switch_.cases.rend(); ++case_) {
+                // t ]
+                emit(t);
+                push_plains("]");
+
+                // flag[ case flag- ]
+                emit(flag);
+                push_plains("[");
+                compile_block(case_->block);
+                origin = switch_origin;
+                emit(flag);
+                push_plains("-]");
+            }
+        }
+
+        // An ARRAY region holds a zero sentinel s, a scratch cell h, and then
+        // a marker before every element and one past the last:
+        //
+        // s h m0 e0 m1 e1 ... m(size-1) e(size-1) m(size)
+        //
+        // Markers are zero between accesses. GET and SET copy the index into
+        // m0 and walk it right, leaving a 1 on every marker they pass, then
+        // come back over those to m0:
+        //
+        // m0[ [->>+<<]+ >>- ]
+        //
+        // Only the header cells are named, so the walks are raw moves that
+        // end where they start. Indices past the end are undefined.
+        static constexpr size_t ARRAY_SCRATCH = 1;
+        static constexpr size_t ARRAY_HEAD = 2;
+
+        static bflabels::Label element(bflabels::Label array, size_t idx) {
+            return bflabels::Label { array.label_idx, idx };
+        }
+
+        // to += from, through `temp`, which must be zero.
+        void copy(bflabels::Label from, bflabels::Label to, bflabels::Label temp) {
+            // from[to+temp+from-] temp[from+temp-]
+            emit(from);
+            push_plains("[");
+            emit(to);
+            push_plains("+");
+            emit(temp);
+            push_plains("+");
+            emit(from);
+            push_plains("-]");
+            emit(temp);
+            push_plains("[");
+            emit(from);
+            push_plains("+");
+            emit(temp);
+            push_plains("-]");
+        }
+
+        // ARRAY region of `label`, or an error if it was never declared.
+        std::optional<bflabels::Label> array_of(ast::Label label) {
+            bflabels::Label array = labeler.get(label);
+
+            if (!arrays.contains(array.label_idx)) {
+                if (!error) {
+                    error = CompileError("GET and SET need a label declared with ARRAY.");
+                }
+                return std::nullopt;
+            }
+            return array;
+        }
+
+        void compile_array(const ast::Array& array) {
+            bflabels::Label region = labeler.get(array.name);
+
+            size_t& extent = layout.label_extents[region];
+            extent = std::max(extent, ARRAY_HEAD + 2 * array.size + 1);
+            arrays[region.label_idx] = array.size;
+
+            // An earlier expansion may have left an INT in these cells.
+            // s[-] h[-] m0[-] ... m(size)[-]
+            for (size_t idx = 0; idx < ARRAY_HEAD + 2 * array.size + 1; idx += idx < ARRAY_HEAD ? 1 : 2) {
+                emit(element(region, idx));
+                push_plains("[-]");
+            }
+        }
+
+        // m0 = index; walk; m(i) = e(i) through m(i+1); carry m(i) back to m0
+        // along the markers; into = m0
+        void compile_get(const ast::Get& get) {
+            auto array = array_of(get.array);
+            if (!array) {
+                return;
+            }
+
+            bflabels::Label scratch = element(*array, ARRAY_SCRATCH);
+            bflabels::Label head = element(*array, ARRAY_HEAD);
+            bflabels::Label into = labeler.get(get.into);
+
+            copy(labeler.get(get.index), head, scratch);
+
+            emit(head);
+            push_plains("[[->>+<<]+>>-]");
+            push_plains(">[-<+>>+<]>[-<+>]<<");
+            push_plains("<<[->>[-<<+>>]<<<<]>>");
+
+            // into[-] m0[into+m0-]
+            emit(into);
+            push_plains("[-]");
+            emit(head);
+            push_plains("[");
+            emit(into);
+            push_plains("+");
+            emit(head);
+            push_plains("-]");
+        }
+
+        // m0 = index; m1 = value; walk, carrying the value one marker ahead;
+        // e(i) = m(i+1); clear the markers on the way back
+        void compile_set(const ast::Set& set) {
+            auto array = array_of(set.array);
+            if (!array) {
+                return;
+            }
+
+            bflabels::Label scratch = element(*array, ARRAY_SCRATCH);
+            bflabels::Label head = element(*array, ARRAY_HEAD);
+
+            copy(labeler.get(set.index), head, scratch);
+            copy(labeler.get(set.value), element(*array, ARRAY_HEAD + 2), scratch);
+
+            emit(head);
+            push_plains("[>>[->>+<<]<<[->>+<<]+>>-]");
+            push_plains(">[-]>[-<+>]<<");
+            push_plains("<<[-<<]>>");
+        }
+
+        // Arithmetic runs in accumulators, temporary integers that give every
+        // byte a(k) two zero cells to test it for wrapping in place:
+        //
+        // a0 b0 c0 a1 b1 c1 ...
+        //
+        // Adding one to a(k) and carrying into a(k+1) when it wraps is
+        //
+        // + >+<[>-]>[- >> (add one to a(k+1)) < ]<<
+        //
+        // which costs the same whatever a(k) holds, so adding a byte costs its
+        // value in steps. Subtracting tests for zero before the `-` instead.
+        static constexpr size_t ACCUMULATOR_STRIDE = 3;
+
+        size_t width_of(bflabels::Label label) const {
+            auto it = widths.find(label.label_idx);
+            return it == widths.end() ? 1 : it->second;
+        }
+
+        // Raw code adding one to byte `k` of a `width`-byte accumulator, or
+        // subtracting it, from and back to a(k).
+        static std::string carry(size_t k, size_t width, bool subtract) {
+            if (k + 1 == width) {
+                return subtract ? "-" : "+";
+            }
+
+            std::string ripple = ">+<[>-]>[->>" + carry(k + 1, width, subtract) + "<]<<";
+            return subtract ? ripple + "-" : "+" + ripple;
+        }
+
+        static bflabels::Label byte(bflabels::Label accumulator, size_t k) {
+            return element(accumulator, ACCUMULATOR_STRIDE * k);
+        }
+
+        bflabels::Label accumulator(size_t width) {
+            bflabels::Label accumulator = labeler.temp();
+            layout.label_extents[accumulator] = ACCUMULATOR_STRIDE * width;
+
+            for (size_t idx = 0; idx < ACCUMULATOR_STRIDE * width; ++idx) {
+                emit(element(accumulator, idx));
+                push_plains("[-]");
+            }
+
+            return accumulator;
+        }
+
+        // Adds `from` to byte `k` of `accumulator` `times` times, or subtracts
+        // it. `from` is kept through `temp`, which must be zero, or cleared
+        // when there is none.
+        void accumulate(
+            bflabels::Label from,
+            bflabels::Label accumulator,
+            size_t k,
+            size_t width,
+            bool subtract,
+            std::optional<bflabels::Label> temp,
+            size_t times = 1
+        ) {
+            std::string step = carry(k, width, subtract);
+
+            // from[ temp+ a(k) step from- ] temp[from+temp-]
+            emit(from);
+            push_plains("[");
+            if (temp) {
+                emit(*temp);
+                push_plains("+");
+            }
+            emit(byte(accumulator, k));
+            for (size_t i = 0; i < times; ++i) {
+                push_plains(step);
+            }
+            emit(from);
+            push_plains("-]");
+
+            if (temp) {
+                emit(*temp);
+                push_plains("[");
+                emit(from);
+                push_plains("+");
+                emit(*temp);
+                push_plains("-]");
+            }
+        }
+
+        // Doubles `accumulator` in place, high bytes first so that carries
+        // land on bytes already doubled.
+        void double_up(bflabels::Label accumulator, size_t width, bflabels::Label temp) {
+            for (size_t k = width; k-- > 0;) {
+                // a(k)[temp+a(k)-]
+                emit(byte(accumulator, k));
+                push_plains("[");
+                emit(temp);
+                push_plains("+");
+                emit(byte(accumulator, k));
+                push_plains("-]");
+
+                accumulate(temp, accumulator, k, width, false, std::nullopt, 2);
+            }
+        }
+
+        // Moves the low bytes of `accumulator` into `into`, zero-extended.
+        void store(bflabels::Label accumulator, size_t width, bflabels::Label into) {
+            for (size_t k = 0; k < width_of(into); ++k) {
+                bflabels::Label target = element(into, k);
+
+                // z(k)[-] a(k)[z(k)+a(k)-]
+                emit(target);
+                push_plains("[-]");
+
+                if (k < width) {
+                    emit(byte(accumulator, k));
+                    push_plains("[");
+                    emit(target);
+                    push_plains("+");
+                    emit(byte(accumulator, k));
+                    push_plains("-]");
+                }
+            }
+        }
+
+        void compile_int(const ast::Int& int_) {
+            bflabels::Label label = labeler.get(int_.name);
+
+            size_t& extent = layout.label_extents[label];
+            extent = std::max(extent, int_.width);
+            widths[label.label_idx] = int_.width;
+        }
+
+        // a = x; a += y (or -= y); z = a
+        void compile_add(bflabels::Label x, bflabels::Label y, bflabels::Label z, bool subtract) {
+            size_t width = width_of(z);
+            bflabels::Label a = accumulator(width);
+            bflabels::Label temp = labeler.temp();
+
+            emit(temp);
+            push_plains("[-]");
+
+            for (size_t k = 0; k < std::min(width, width_of(x)); ++k) {
+                copy(element(x, k), byte(a, k), element(a, ACCUMULATOR_STRIDE * k + 1));
+            }
+            for (size_t k = 0; k < std::min(width, width_of(y)); ++k) {
+                accumulate(element(y, k), a, k, width, subtract, temp);
+            }
+
+            store(a, width, z);
+        }
+
+        // Schoolbook: a(i+j) += x(i) once for every unit of y(j).
+        void compile_mul(bflabels::Label x, bflabels::Label y, bflabels::Label z) {
+            size_t width = width_of(z);
+            bflabels::Label a = accumulator(width);
+            bflabels::Label count = labeler.temp();
+            bflabels::Label temp = labeler.temp();
+
+            emit(count);
+            push_plains("[-]");
+            emit(temp);
+            push_plains("[-]");
+
+            for (size_t j = 0; j < std::min(width, width_of(y)); ++j) {
+                // y is copied out first, as it may be x.
+                copy(element(y, j), count, temp);
+
+                emit(count);
+                push_plains("[");
+                for (size_t i = 0; i < std::min(width - j, width_of(x)); ++i) {
+                    accumulate(element(x, i), a, i + j, width, false, temp);
+                }
+                emit(count);
+                push_plains("-]");
+            }
+
+            store(a, width, z);
+        }
+
+        // a = x - y with a byte to spare, which ends at 255 on a borrow.
+        void compile_less(bflabels::Label x, bflabels::Label y, bflabels::Label into) {
+            size_t width = std::max(width_of(x), width_of(y));
+            bflabels::Label a = accumulator(width + 1);
+            bflabels::Label temp = labeler.temp();
+
+            emit(temp);
+            push_plains("[-]");
+
+            for (size_t k = 0; k < width_of(x); ++k) {
+                copy(element(x, k), byte(a, k), element(a, ACCUMULATOR_STRIDE * k + 1));
+            }
+            for (size_t k = 0; k < width_of(y); ++k) {
+                accumulate(element(y, k), a, k, width + 1, true, temp);
+            }
+
+            // a(k)[-] ... z[-] a(width)[z+a(width)+]
+            for (size_t k = 0; k < width; ++k) {
+                emit(byte(a, k));
+                push_plains("[-]");
+            }
+            store(a, 0, into);
+            emit(byte(a, width));
+            push_plains("[");
+            emit(into);
+            push_plains("+");
+            emit(byte(a, width));
+            push_plains("+]");
+        }
+
+        // Restoring long division, one bit of x per round, shifted out of
+        // the top of a copy of it. r gets a byte to spare for the trial
+        // subtraction, which borrows into it exactly when r < y; adding y
+        // back then carries it to zero, ending the loop over it.
+        //
+        // n[ X*=2 R*=2 Q*=2 X(top)[R+=1 X(top)-] R-=y
+        //    e+ R(top)[e- R+=y R(top)] e[Q+=1 e-] n- ]
+        //
+        // Division by zero leaves q with all bits set and r = x.
+        void compile_divmod(bflabels::Label x, bflabels::Label y, bflabels::Label q, bflabels::Label r) {
+            size_t width = std::max(width_of(x), width_of(y));
+
+            bflabels::Label dividend = accumulator(width + 1);
+            bflabels::Label remainder = accumulator(width + 1);
+            bflabels::Label quotient = accumulator(width);
+            bflabels::Label rounds = labeler.temp();
+            bflabels::Label kept = labeler.temp();
+            bflabels::Label temp = labeler.temp();
+
+            emit(kept);
+            push_plains("[-]");
+            emit(temp);
+            push_plains("[-]");
+
+            for (size_t k = 0; k < width_of(x); ++k) {
+                copy(element(x, k), byte(dividend, k), element(dividend, ACCUMULATOR_STRIDE * k + 1));
+            }
+
+            emit(rounds);
+            push_plains("[-]");
+            push_plains(std::string(8 * width, '+'));
+            push_plains("[");
+
+            double_up(dividend, width + 1, temp);
+            double_up(remainder, width + 1, temp);
+            double_up(quotient, width, temp);
+
+            accumulate(byte(dividend, width), remainder, 0, width + 1, false, std::nullopt);
+
+            for (size_t k = 0; k < width_of(y); ++k) {
+                accumulate(element(y, k), remainder, k, width + 1, true, temp);
+            }
+
+            emit(kept);
+            push_plains("+");
+            emit(byte(remainder, width));
+            push_plains("[");
+            emit(kept);
+            push_plains("-");
+            for (size_t k = 0; k < width_of(y); ++k) {
+                accumulate(element(y, k), remainder, k, width + 1, false, temp);
+            }
+            emit(byte(remainder, width));
+            push_plains("]");
+
+            accumulate(kept, quotient, 0, width, false, std::nullopt);
+
+            emit(rounds);
+            push_plains("-]");
+
+            store(quotient, width, q);
+            store(remainder, width, r);
+        }
+
+        void compile_arithmetic(const ast::Arithmetic& arithmetic) {
+            bflabels::Label x = labeler.get(arithmetic.x);
+            bflabels::Label y = labeler.get(arithmetic.y);
+            bflabels::Label z = labeler.get(arithmetic.into[0]);
+
+            switch (arithmetic.kind) {
+                case ast::Arithmetic::Add:
+                case ast::Arithmetic::Sub:
+                    compile_add(x, y, z, arithmetic.kind == ast::Arithmetic::Sub);
+                    break;
+
+                case ast::Arithmetic::Mul:
+                    compile_mul(x, y, z);
+                    break;
+
+                case ast::Arithmetic::DivMod:
+                    compile_divmod(x, y, z, labeler.get(arithmetic.into[1]));
+                    break;
+
+                case ast::Arithmetic::Less:
+                    compile_less(x, y, z);
+                    break;
+            }
+        }
+
+        void compile_block(const ast::ASTBlock& block) {
+            for (const auto& node : block) {
+                std::visit(overloaded {
+                    [&](ast::Plain p) {
+                        emit(p);
+                    },
+                    [&](ast::Label label) {
+                        emit(labeler.get(label));
+                    },
+                    [&](ast::Location location) {
+                        enter_origin(frame, location.pos);
+                    },
+                    [&](const ast::Use& use) {
+                        compile_use(use);
+                    },
+                    [&](const ast::If& if_) {
+                        compile_if(if_);
+                    },
+                    [&](const ast::Switch& switch_) {
+                        compile_switch(switch_);
+                    },
+                    [&](const ast::Array& array) {
+                        compile_array(array);
+                    },
+                    [&](const ast::Get& get) {
+                        compile_get(get);
+                    },
+                    [&](const ast::Set& set) {
+                        compile_set(set);
+                    },
+                    [&](const ast::Int& int_) {
+                        compile_int(int_);
+                    },
+                    [&](const ast::Arithmetic& arithmetic) {
+                        compile_arithmetic(arithmetic);
                     },
                     [&](const ast::While& while_) {
                         bflabels::Label x = labeler.get(while_.condition);
 
                         // x[
-                        result.emplace_back(x);
+                        emit(x);
                         push_plains("[");
 
                         //    code
+                        size_t while_origin = origin;
                         compile_block(while_.do_block);
+                        origin = while_origin;
 
-                        result.emplace_back(x);
+                        emit(x);
                         push_plains("]");
                         // x]
                     },
@@ -187,3 +892,13 @@ namespace bfasm::compiler {
         }
     };
 }  // na    mespace bfasm::compiler
+
+inline std::ostream& operator<<(std::ostream& os, const bfasm::compiler::CompileError& error) {
+    os << "Error : ";
+
+    std::visit([&] (const auto& error) {
+        os << error;
+    }, error.msg);
+
+    return os;
+}
@@ -0,0 +1,340 @@
+#include "liveness.h"
+
+#include <functional>
+#include <string>
+
+#include "utils.h"
+
+
+namespace bfasm::compiler {
+    namespace {
+        // Plain operations applied to one cell; `label` is empty for temps.
+        struct Segment {
+            std::optional<ast::Label> label;
+            std::string ops;
+        };
+
+        // Steps from the one opening a raw `[` to the one closing it, and the
+        // labels named in between.
+        struct RawLoop {
+            size_t open;
+            size_t close;
+            std::unordered_set<ast::Label> labels;
+        };
+
+        using Step = std::variant<
+            Segment, const ast::Use*, const ast::If*, const ast::While*, const ast::Switch*, const ast::Get*, const ast::Set*,
+            const ast::Arithmetic*
+        >;
+
+        void collect(const ast::ASTBlock& block, const std::function<void(ast::Label)>& add);
+
+        // Calls `add` on every label `node` names, nested blocks included.
+        void collect(const ast::ASTNode& node, const std::function<void(ast::Label)>& add) {
+            std::visit(overloaded {
+                [&](ast::Label label) {
+                    add(label);
+                },
+                [&](const ast::Use& use) {
+                    for (ast::Label label : use.arguments) {
+                        add(label);
+                    }
+                    for (ast::Label label : use.return_into) {
+                        add(label);
+                    }
+                },
+                [&](const ast::If& if_) {
+                    add(if_.condition);
+                    collect(if_.then_block, add);
+                    collect(if_.else_block, add);
+                },
+                [&](const ast::While& while_) {
+                    add(while_.condition);
+                    collect(while_.do_block, add);
+                },
+                [&](const ast::Switch& switch_) {
+                    add(switch_.condition);
+                    for (const auto& case_ : switch_.cases) {
+                        collect(case_.block, add);
+                    }
+                    collect(switch_.default_block, add);
+                },
+                [&](const ast::Array& array) {
+                    add(array.name);
+                },
+                [&](const ast::Get& get) {
+                    add(get.array);
+                    add(get.index);
+                    add(get.into);
+                },
+                [&](const ast::Set& set) {
+                    add(set.array);
+                    add(set.index);
+                    add(set.value);
+                },
+                [&](const ast::Int& int_) {
+                    add(int_.name);
+                },
+                [&](const ast::Arithmetic& arithmetic) {
+                    add(arithmetic.x);
+                    add(arithmetic.y);
+                    for (ast::Label label : arithmetic.into) {
+                        add(label);
+                    }
+                },
+                [&](const auto&) {},
+            }, node);
+        }
+
+        // Calls `add` on every label `block` names, nested blocks included.
+        void collect(const ast::ASTBlock& block, const std::function<void(ast::Label)>& add) {
+            for (const auto& node : block) {
+                collect(node, add);
+            }
+        }
+
+        bool mentions(const ast::ASTBlock& block, ast::Label label) {
+            bool found = false;
+            collect(block, [&](ast::Label other) {
+                found |= other == label;
+            });
+            return found;
+        }
+    }
+
+    Liveness::LabelSet Liveness::block(const ast::ASTBlock& block, Cursor entry, LabelSet live) {
+        std::vector<Step> steps;
+        Cursor cursor = entry;
+
+        std::vector<RawLoop> loops;
+        std::vector<RawLoop> open_loops;
+
+        auto segment = [&]() -> Segment& {
+            if (steps.empty() || !std::holds_alternative<Segment>(steps.back())) {
+                if (cursor.kind == Cursor::Unknown) {
+                    opaque = true;
+                }
+
+                Segment next;
+                if (cursor.kind == Cursor::Named) {
+                    next.label = cursor.label;
+                }
+                steps.push_back(std::move(next));
+            }
+
+            return std::get<Segment>(steps.back());
+        };
+
+        for (const auto& node : block) {
+            for (auto& loop : open_loops) {
+                collect(node, [&](ast::Label label) {
+                    loop.labels.insert(label);
+                });
+            }
+
+            std::visit(overloaded {
+                [&](ast::Plain p) {
+                    if (p == '<' || p == '>') {
+                        opaque = true;
+                    }
+                    segment().ops += p;
+
+                    if (p == '[') {
+                        RawLoop loop { steps.size() - 1, 0, {} };
+                        if (cursor.kind == Cursor::Named) {
+                            loop.labels.insert(cursor.label);
+                        }
+                        open_loops.push_back(std::move(loop));
+                    } else if (p == ']' && open_loops.empty()) {
+                        opaque = true;
+                    } else if (p == ']') {
+                        RawLoop loop = std::move(open_loops.back());
+                        open_loops.pop_back();
+
+                        loop.close = steps.size() - 1;
+                        for (auto& outer : open_loops) {
+                            outer.labels.insert(loop.labels.begin(), loop.labels.end());
+                        }
+                        loops.push_back(std::move(loop));
+                    }
+                },
+                [&](ast::Label label) {
+                    cursor = Cursor { Cursor::Named, label };
+                    steps.push_back(Segment { label, {} });
+                },
+                [&](ast::Location) {},
+                [&](const ast::Use& use) {
+                    steps.push_back(&use);
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                [&](const ast::If& if_) {
+                    steps.push_back(&if_);
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                [&](const ast::While& while_) {
+                    steps.push_back(&while_);
+                    cursor = Cursor { Cursor::Named, while_.condition };
+                },
+                [&](const ast::Switch& switch_) {
+                    steps.push_back(&switch_);
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                // Only clears the array's own cell, which GET and SET keep at
+                // zero and nothing else reads.
+                [&](const ast::Array&) {
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                [&](const ast::Get& get) {
+                    steps.push_back(&get);
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                [&](const ast::Set& set) {
+                    steps.push_back(&set);
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                [&](const ast::Int&) {
+                    cursor = Cursor { Cursor::Unknown };
+                },
+                [&](const ast::Arithmetic& arithmetic) {
+                    steps.push_back(&arithmetic);
+                    cursor = Cursor { Cursor::Unknown };
+                },
+            }, node);
+        }
+
+        if (!open_loops.empty()) {
+            opaque = true;
+        }
+
+        for (auto step = steps.rbegin(); step != steps.rend(); ++step) {
+            // Raw loops have no structure to run to a fixpoint over, so every
+            // label named in one counts as live all through it, for the next
+            // pass to read.
+            size_t index = steps.rend() - step - 1;
+            for (const auto& loop : loops) {
+                if (loop.open <= index && index <= loop.close) {
+                    live.insert(loop.labels.begin(), loop.labels.end());
+                }
+            }
+
+            std::visit(overloaded {
+                [&](const Segment& segment) {
+                    if (!segment.label || segment.ops.empty()) {
+                        return;
+                    }
+
+                    if (segment.ops.starts_with("[-]") && !inherited.contains(*segment.label)) {
+                        live.erase(*segment.label);
+                    } else {
+                        live.insert(*segment.label);
+                    }
+                },
+                [&](const ast::Use* use) {
+                    live.insert(use->arguments.begin(), use->arguments.end());
+                    live.insert(use->return_into.begin(), use->return_into.end());
+                },
+                [&](const ast::If* if_) {
+                    if (live.contains(if_->condition)) {
+                        live_conditions.insert(if_);
+                    }
+
+                    LabelSet then_live = this->block(if_->then_block, Cursor { Cursor::Named, if_->condition }, live);
+                    LabelSet else_live = this->block(if_->else_block, Cursor { Cursor::Temp }, live);
+
+                    live = std::move(then_live);
+                    live.insert(else_live.begin(), else_live.end());
+                    live.insert(if_->condition);
+                },
+                [&](const ast::While* while_) {
+                    // Live at the loop head: read on exit, by the check, or by
+                    // the body on some later iteration.
+                    LabelSet head = live;
+                    head.insert(while_->condition);
+
+                    while (true) {
+                        LabelSet next = this->block(while_->do_block, Cursor { Cursor::Named, while_->condition }, head);
+                        next.insert(head.begin(), head.end());
+
+                        if (next.size() == head.size()) {
+                            break;
+                        }
+                        head = std::move(next);
+                    }
+
+                    live = std::move(head);
+                },
+                [&](const ast::Switch* switch_) {
+                    bool read_inside = mentions(switch_->default_block, switch_->condition);
+                    for (const auto& case_ : switch_->cases) {
+                        read_inside |= mentions(case_.block, switch_->condition);
+                    }
+
+                    if (read_inside || live.contains(switch_->condition)) {
+                        live_switches.insert(switch_);
+                    }
+
+                    LabelSet in = this->block(switch_->default_block, Cursor { Cursor::Temp }, live);
+                    for (const auto& case_ : switch_->cases) {
+                        LabelSet case_in = this->block(case_.block, Cursor { Cursor::Temp }, live);
+                        in.insert(case_in.begin(), case_in.end());
+                    }
+
+                    live = std::move(in);
+                    live.insert(switch_->condition);
+                },
+                [&](const ast::Get* get) {
+                    if (!inherited.contains(get->into)) {
+                        live.erase(get->into);
+                    }
+                    live.insert(get->array);
+                    live.insert(get->index);
+                },
+                [&](const ast::Set* set) {
+                    live.insert(set->array);
+                    live.insert(set->index);
+                    live.insert(set->value);
+                },
+                [&](const ast::Arithmetic* arithmetic) {
+                    for (ast::Label label : arithmetic->into) {
+                        if (!inherited.contains(label)) {
+                            live.erase(label);
+                        }
+                    }
+                    live.insert(arithmetic->x);
+                    live.insert(arithmetic->y);
+                },
+            }, *step);
+        }
+
+        return live;
+    }
+
+    Liveness Liveness::analyze(const ast::Macro& macro, LabelSet inherited) {
+        Liveness liveness;
+        liveness.inherited = std::move(inherited);
+        liveness.block(macro.block, Cursor { Cursor::Unknown }, liveness.inherited);
+
+        return liveness;
+    }
+
+    std::vector<ast::Label> Liveness::labels(const ast::Macro& macro) {
+        std::vector<ast::Label> result;
+        LabelSet seen;
+
+        auto add = [&](ast::Label label) {
+            if (seen.insert(label).second) {
+                result.push_back(label);
+            }
+        };
+
+        for (ast::Label label : macro.arguments) {
+            add(label);
+        }
+        for (ast::Label label : macro.returns) {
+            add(label);
+        }
+        collect(macro.block, add);
+
+        return result;
+    }
+}  // namespace bfasm::compiler
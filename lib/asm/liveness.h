@@ -0,0 +1,54 @@
+#pragma once
+
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "ast.h"
+
+
+namespace bfasm::compiler {
+    // Backward liveness of labels over one macro expansion: a label is live
+    // after a node when some later node may read the value it has there.
+    // Labels already bound when the macro is expanded (its arguments and
+    // returns, and any label of a caller it names too) belong to the caller
+    // and are live throughout, as they may alias each other. `x[-]` overwrites
+    // x without reading it, and so do GET and arithmetic into x; `x,` does
+    // not, as it keeps x at end of input. Raw `[`/`]` loops are not analyzed
+    // pass by pass: every label named in one is live all through it.
+    // Macros that move the pointer by hand, or apply operations to a cell left
+    // over from an IF or USE, are treated as reading every label everywhere.
+    class Liveness {
+        // Cell that plain operations apply to when no label precedes them.
+        struct Cursor {
+            enum { Unknown, Temp, Named } kind;
+            ast::Label label = {};
+        };
+
+        using LabelSet = std::unordered_set<ast::Label>;
+
+        LabelSet inherited;
+        std::unordered_set<const ast::If*> live_conditions;
+        std::unordered_set<const ast::Switch*> live_switches;
+        bool opaque = false;
+
+        LabelSet block(const ast::ASTBlock& block, Cursor entry, LabelSet live);
+
+      public:
+        static Liveness analyze(const ast::Macro& macro, LabelSet inherited);
+
+        // Every label `macro` names, in order of first mention.
+        static std::vector<ast::Label> labels(const ast::Macro& macro);
+
+        // Whether the condition of `if_` may be read after the IF.
+        bool condition_live_after(const ast::If& if_) const {
+            return opaque || live_conditions.contains(&if_);
+        }
+
+        // Whether the condition of `switch_` may be read by one of its cases
+        // or after the SWITCH.
+        bool condition_live_after(const ast::Switch& switch_) const {
+            return opaque || live_switches.contains(&switch_);
+        }
+    };
+}  // namespace bfasm::compiler
@@ -1,5 +1,7 @@
 #include "parser.h"
 
+#include <algorithm>
+#include <charconv>
 #include <variant>
 #include <iostream>
 #include <tuple>
@@ -52,7 +54,14 @@ namespace bfasm::parse {
         ast::ASTBlock block;
 
         bool next_block = false;
+        size_t line = 0;
         for (; token != end; ++token) {
+            bool ends_block = variant_is(token->data, Control::RCurly) || variant_is(token->data, Keyword::Macro);
+            if (token->pos.line != line && !ends_block) {
+                line = token->pos.line;
+                block.emplace_back(ast::Location { token->pos });
+            }
+
             auto parse_result = std::visit(overloaded{
                 [&](Plain plain) -> std::optional<ParseError> {
                     block.emplace_back(plain);
@@ -72,11 +81,18 @@ namespace bfasm::parse {
                         case Keyword::Else:
                             return ParseError(token->pos, "Unexpexted ELSE keyword.");
 
+                        case Keyword::Case:
+                            return ParseError(token->pos, "Unexpected CASE keyword.");
+
+                        case Keyword::Default:
+                            return ParseError(token->pos, "Unexpected DEFAULT keyword.");
+
                         case Keyword::If: {
                             auto if_or_err = parse_if();
                             --token;
                             if (if_or_err.has_value()) {
                                 block.emplace_back(if_or_err.value());
+                                line = 0;
                                 return std::nullopt;
                             }
 
@@ -88,12 +104,84 @@ namespace bfasm::parse {
                             --token;
                             if (while_or_err.has_value()) {
                                 block.emplace_back(while_or_err.value());
+                                line = 0;
                                 return std::nullopt;
                             }
 
                             return while_or_err.error();
                         }
 
+                        case Keyword::Switch: {
+                            auto switch_or_err = parse_switch();
+                            --token;
+                            if (switch_or_err.has_value()) {
+                                block.emplace_back(switch_or_err.value());
+                                line = 0;
+                                return std::nullopt;
+                            }
+
+                            return switch_or_err.error();
+                        }
+
+                        case Keyword::Array: {
+                            auto array_or_err = parse_array();
+                            --token;
+                            if (array_or_err.has_value()) {
+                                block.emplace_back(array_or_err.value());
+                                return std::nullopt;
+                            }
+
+                            return array_or_err.error();
+                        }
+
+                        case Keyword::Get: {
+                            auto get_or_err = parse_get();
+                            --token;
+                            if (get_or_err.has_value()) {
+                                block.emplace_back(get_or_err.value());
+                                return std::nullopt;
+                            }
+
+                            return get_or_err.error();
+                        }
+
+                        case Keyword::Set: {
+                            auto set_or_err = parse_set();
+                            --token;
+                            if (set_or_err.has_value()) {
+                                block.emplace_back(set_or_err.value());
+                                return std::nullopt;
+                            }
+
+                            return set_or_err.error();
+                        }
+
+                        case Keyword::Int: {
+                            auto int_or_err = parse_int();
+                            --token;
+                            if (int_or_err.has_value()) {
+                                block.emplace_back(int_or_err.value());
+                                return std::nullopt;
+                            }
+
+                            return int_or_err.error();
+                        }
+
+                        case Keyword::Add:
+                        case Keyword::Sub:
+                        case Keyword::Mul:
+                        case Keyword::DivMod:
+                        case Keyword::Less: {
+                            auto arithmetic_or_err = parse_arithmetic(keyword);
+                            --token;
+                            if (arithmetic_or_err.has_value()) {
+                                block.emplace_back(arithmetic_or_err.value());
+                                return std::nullopt;
+                            }
+
+                            return arithmetic_or_err.error();
+                        }
+
                         case Keyword::Use: {
                             auto use_or_err = parse_use();
                             --token;
@@ -187,7 +275,291 @@ namespace bfasm::parse {
         };
     }
 
+    ParseResult<ast::Switch> Parser::parse_switch() {
+        auto head = this->parse_struct(
+            Keyword::Switch,
+            &Parser::parse_label,
+            Control::LCurly
+        );
+
+        if (!head.has_value()) {
+            return std::unexpected(head.error());
+        }
+
+        auto& [condition] = *head;
+
+        ast::Switch switch_ {
+            .condition = condition,
+            .cases = {},
+            .default_block = {},
+        };
+
+        bool has_default = false;
+
+        while (true) {
+            if (token == end) {
+                return std::unexpected(ParseError(Position::END, "Unexpected end. Expected CASE, DEFAULT or closing curly brace."));
+            }
+
+            Position pos = token->pos;
+
+            if (is_standing_on(Control::RCurly)) {
+                ++token;
+                break;
+            }
+
+            if (is_standing_on(Keyword::Case)) {
+                auto case_ = this->parse_struct(
+                    Keyword::Case,
+                    &Parser::parse_case_value,
+                    Control::LCurly,
+                    &Parser::parse_block,
+                    Control::RCurly
+                );
+
+                if (!case_.has_value()) {
+                    return std::unexpected(case_.error());
+                }
+
+                auto& [value, block] = *case_;
+
+                for (const auto& other : switch_.cases) {
+                    if (other.value == value) {
+                        return std::unexpected(ParseError(pos, "Duplicate CASE value."));
+                    }
+                }
+
+                switch_.cases.push_back(ast::Case { value, std::move(block) });
+                continue;
+            }
+
+            if (is_standing_on(Keyword::Default)) {
+                if (has_default) {
+                    return std::unexpected(ParseError(pos, "Duplicate DEFAULT."));
+                }
+
+                auto default_ = this->parse_struct(
+                    Keyword::Default,
+                    Control::LCurly,
+                    &Parser::parse_block,
+                    Control::RCurly
+                );
+
+                if (!default_.has_value()) {
+                    return std::unexpected(default_.error());
+                }
+
+                switch_.default_block = std::move(std::get<0>(*default_));
+                has_default = true;
+                continue;
+            }
+
+            return std::unexpected(ParseError(pos, "Invalid token. Expected CASE, DEFAULT or closing curly brace."));
+        }
+
+        std::sort(switch_.cases.begin(), switch_.cases.end(), [](const ast::Case& a, const ast::Case& b) {
+            return a.value < b.value;
+        });
+
+        return switch_;
+    }
+
+    ParseResult<uint8_t> Parser::parse_case_value() {
+        Position pos = token->pos;
+        auto ident = this->parse_ident();
+
+        if (!ident.has_value()) {
+            return std::unexpected(ident.error());
+        }
+
+        unsigned value = 0;
+        auto [ptr, ec] = std::from_chars(ident->data(), ident->data() + ident->size(), value);
+        if (ec != std::errc{} || ptr != ident->data() + ident->size() || value > 255) {
+            return std::unexpected(ParseError(pos, "Invalid CASE value. Expected a number from 0 to 255."));
+        }
+
+        return value;
+    }
+
+    ParseResult<ast::Array> Parser::parse_array() {
+        auto array = this->parse_struct(
+            Keyword::Array,
+            &Parser::parse_label,
+            Control::LParen,
+            &Parser::parse_array_size,
+            Control::RParen
+        );
+
+        if (!array.has_value()) {
+            return std::unexpected(array.error());
+        }
+
+        auto& [name, size] = *array;
+
+        return ast::Array {
+            .name = name,
+            .size = size,
+        };
+    }
+
+    ParseResult<size_t> Parser::parse_array_size() {
+        Position pos = token->pos;
+        auto ident = this->parse_ident();
+
+        if (!ident.has_value()) {
+            return std::unexpected(ident.error());
+        }
+
+        // Indices are single cells, so larger arrays could not be addressed.
+        size_t size = 0;
+        auto [ptr, ec] = std::from_chars(ident->data(), ident->data() + ident->size(), size);
+        if (ec != std::errc{} || ptr != ident->data() + ident->size() || size == 0 || size > 256) {
+            return std::unexpected(ParseError(pos, "Invalid ARRAY size. Expected a number from 1 to 256."));
+        }
+
+        return size;
+    }
+
+    ParseResult<ast::Get> Parser::parse_get() {
+        auto get = this->parse_struct(
+            Keyword::Get,
+            &Parser::parse_label,
+            Plain('['),
+            &Parser::parse_label,
+            Plain(']'),
+            Control::Arrow,
+            &Parser::parse_label
+        );
+
+        if (!get.has_value()) {
+            return std::unexpected(get.error());
+        }
+
+        auto& [array, index, into] = *get;
+
+        return ast::Get {
+            .array = array,
+            .index = index,
+            .into = into,
+        };
+    }
+
+    ParseResult<ast::Set> Parser::parse_set() {
+        auto set = this->parse_struct(
+            Keyword::Set,
+            &Parser::parse_label,
+            Plain('['),
+            &Parser::parse_label,
+            Plain(']'),
+            &Parser::parse_label
+        );
+
+        if (!set.has_value()) {
+            return std::unexpected(set.error());
+        }
+
+        auto& [array, index, value] = *set;
+
+        return ast::Set {
+            .array = array,
+            .index = index,
+            .value = value,
+        };
+    }
+
+    ParseResult<ast::Int> Parser::parse_int() {
+        auto int_ = this->parse_struct(
+            Keyword::Int,
+            &Parser::parse_label,
+            Control::LParen,
+            &Parser::parse_int_width,
+            Control::RParen
+        );
+
+        if (!int_.has_value()) {
+            return std::unexpected(int_.error());
+        }
+
+        auto& [name, width] = *int_;
+
+        return ast::Int {
+            .name = name,
+            .width = width,
+        };
+    }
+
+    ParseResult<size_t> Parser::parse_int_width() {
+        Position pos = token->pos;
+        auto ident = this->parse_ident();
+
+        if (!ident.has_value()) {
+            return std::unexpected(ident.error());
+        }
+
+        size_t width = 0;
+        auto [ptr, ec] = std::from_chars(ident->data(), ident->data() + ident->size(), width);
+        if (ec != std::errc{} || ptr != ident->data() + ident->size() || width == 0 || width > 8) {
+            return std::unexpected(ParseError(pos, "Invalid INT width. Expected a number of bytes from 1 to 8."));
+        }
+
+        return width;
+    }
+
+    ParseResult<ast::Arithmetic> Parser::parse_arithmetic(Keyword keyword) {
+        auto head = this->parse_struct(
+            keyword,
+            &Parser::parse_label,
+            &Parser::parse_label,
+            Control::Arrow,
+            &Parser::parse_label
+        );
+
+        if (!head.has_value()) {
+            return std::unexpected(head.error());
+        }
+
+        auto& [x, y, into] = *head;
+
+        ast::Arithmetic arithmetic {
+            .kind = ast::Arithmetic::Add,
+            .x = x,
+            .y = y,
+            .into = {into},
+        };
+
+        switch (keyword) {
+            case Keyword::Sub:
+                arithmetic.kind = ast::Arithmetic::Sub;
+                break;
+            case Keyword::Mul:
+                arithmetic.kind = ast::Arithmetic::Mul;
+                break;
+            case Keyword::DivMod:
+                arithmetic.kind = ast::Arithmetic::DivMod;
+                break;
+            case Keyword::Less:
+                arithmetic.kind = ast::Arithmetic::Less;
+                break;
+            default:
+                break;
+        }
+
+        if (arithmetic.kind == ast::Arithmetic::DivMod) {
+            auto remainder = this->parse_label();
+
+            if (!remainder.has_value()) {
+                return std::unexpected(remainder.error());
+            }
+
+            arithmetic.into.push_back(*remainder);
+        }
+
+        return arithmetic;
+    }
+
     ParseResult<ast::Use> Parser::parse_use() {
+        Position pos = token->pos;
+
         auto use = this->parse_struct(
             Keyword::Use,
             &Parser::parse_signature
@@ -207,6 +579,7 @@ namespace bfasm::parse {
             .macro_name = signature.name,
             .arguments = signature.arguments,
             .return_into = signature.returns,
+            .pos = pos,
         };
     }
 
@@ -232,7 +605,9 @@ namespace bfasm::parse {
             return std::unexpected(ident.error());
         }
 
-        return this->labels_dispatcher.get(*ident);
+        // The dispatcher keeps views of its identifiers, so it must see the
+        // one in the token rather than the returned copy.
+        return this->labels_dispatcher.get(std::get<Identifier>(std::prev(token)->data));
     }
 
     ParseResult<Signature> Parser::parse_signature() {
@@ -59,6 +59,15 @@ namespace bfasm::parse {
         ParseResult<ast::ASTBlock> parse_block();
         ParseResult<ast::If> parse_if();
         ParseResult<ast::While> parse_while();
+        ParseResult<ast::Switch> parse_switch();
+        ParseResult<uint8_t> parse_case_value();
+        ParseResult<ast::Array> parse_array();
+        ParseResult<size_t> parse_array_size();
+        ParseResult<ast::Get> parse_get();
+        ParseResult<ast::Set> parse_set();
+        ParseResult<ast::Int> parse_int();
+        ParseResult<size_t> parse_int_width();
+        ParseResult<ast::Arithmetic> parse_arithmetic(Keyword keyword);
         ParseResult<ast::Use> parse_use();
 
         ParseResult<ast::Macro> parse_macro();
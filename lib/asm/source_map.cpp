@@ -0,0 +1,75 @@
+#include "source_map.h"
+
+#include <algorithm>
+
+
+namespace bfasm::compiler {
+    SourceMap SourceMap::build(const Compiler& compiler, const std::vector<size_t>& token_map) {
+        SourceMap map {
+            .frames = compiler.frames,
+            .origins = compiler.origins,
+            .code_origins = {},
+        };
+
+        map.code_origins.reserve(token_map.size());
+        for (size_t token : token_map) {
+            map.code_origins.push_back(compiler.result_origins[token]);
+        }
+
+        return map;
+    }
+
+    std::vector<std::string_view> SourceMap::stack(size_t frame) const {
+        std::vector<std::string_view> names;
+
+        for (; frame != Frame::ROOT; frame = frames[frame].parent) {
+            names.push_back(frames[frame].macro);
+        }
+
+        std::reverse(names.begin(), names.end());
+
+        return names;
+    }
+
+    static void write_position(std::ostream& os, parse::Position pos) {
+        if (pos == parse::Position::END) {
+            os << '-';
+        } else {
+            os << pos.line << ':' << pos.column;
+        }
+    }
+
+    // Format, one record per line:
+    //   frame <id> <parent | -> <macro> <USE position | ->
+    //   range <begin> <end> <frame> <position | ->
+    // where ranges are half-open intervals of code offsets.
+    void SourceMap::write(std::ostream& os) const {
+        os << "# bftrans source map\n";
+
+        for (size_t i = 0; i < frames.size(); ++i) {
+            os << "frame " << i << ' ';
+            if (frames[i].parent == Frame::ROOT) {
+                os << '-';
+            } else {
+                os << frames[i].parent;
+            }
+            os << ' ' << frames[i].macro << ' ';
+            write_position(os, frames[i].call);
+            os << '\n';
+        }
+
+        for (size_t begin = 0; begin < code_origins.size();) {
+            size_t end = begin;
+            while (end < code_origins.size() && code_origins[end] == code_origins[begin]) {
+                ++end;
+            }
+
+            const Origin& origin = origins[code_origins[begin]];
+            os << "range " << begin << ' ' << end << ' ' << origin.frame << ' ';
+            write_position(os, origin.pos);
+            os << '\n';
+
+            begin = end;
+        }
+    }
+}  // namespace bfasm::compiler
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "compiler.h"
+
+
+namespace bfasm::compiler {
+    // Side table mapping every character of the generated brainfuck back to the
+    // macro expansion and bfasm source line it was compiled from.
+    struct SourceMap {
+        std::vector<Frame> frames;
+        std::vector<Origin> origins;
+
+        // `code_origins[i]` indexes `origins` for the i-th character of the code.
+        std::vector<size_t> code_origins;
+
+        // `token_map` is the one filled by `bflabels::BFLCode::compile`.
+        static SourceMap build(const Compiler& compiler, const std::vector<size_t>& token_map);
+
+        // Macro names of the USE chain from `main` down to `frame`.
+        std::vector<std::string_view> stack(size_t frame) const;
+
+        void write(std::ostream& os) const;
+    };
+}  // namespace bfasm::compiler
@@ -25,6 +25,30 @@ namespace bfasm::parse {
                 tokens.emplace_back(Keyword::Use, ident_pos);
             } else if (ident_buf == "WHILE") {
                 tokens.emplace_back(Keyword::While, ident_pos);
+            } else if (ident_buf == "SWITCH") {
+                tokens.emplace_back(Keyword::Switch, ident_pos);
+            } else if (ident_buf == "CASE") {
+                tokens.emplace_back(Keyword::Case, ident_pos);
+            } else if (ident_buf == "DEFAULT") {
+                tokens.emplace_back(Keyword::Default, ident_pos);
+            } else if (ident_buf == "ARRAY") {
+                tokens.emplace_back(Keyword::Array, ident_pos);
+            } else if (ident_buf == "GET") {
+                tokens.emplace_back(Keyword::Get, ident_pos);
+            } else if (ident_buf == "SET") {
+                tokens.emplace_back(Keyword::Set, ident_pos);
+            } else if (ident_buf == "INT") {
+                tokens.emplace_back(Keyword::Int, ident_pos);
+            } else if (ident_buf == "ADD") {
+                tokens.emplace_back(Keyword::Add, ident_pos);
+            } else if (ident_buf == "SUB") {
+                tokens.emplace_back(Keyword::Sub, ident_pos);
+            } else if (ident_buf == "MUL") {
+                tokens.emplace_back(Keyword::Mul, ident_pos);
+            } else if (ident_buf == "DIVMOD") {
+                tokens.emplace_back(Keyword::DivMod, ident_pos);
+            } else if (ident_buf == "LESS") {
+                tokens.emplace_back(Keyword::Less, ident_pos);
             } else {
                 tokens.emplace_back(std::move(ident_buf), ident_pos);
                 return;
@@ -173,6 +197,42 @@ std::ostream& operator<<(std::ostream& os, const bfasm::parse::Token& token) {
                 case Keyword::Use:
                     os << "USE";
                     break;
+                case Keyword::Switch:
+                    os << "SWITCH";
+                    break;
+                case Keyword::Case:
+                    os << "CASE";
+                    break;
+                case Keyword::Default:
+                    os << "DEFAULT";
+                    break;
+                case Keyword::Array:
+                    os << "ARRAY";
+                    break;
+                case Keyword::Get:
+                    os << "GET";
+                    break;
+                case Keyword::Set:
+                    os << "SET";
+                    break;
+                case Keyword::Int:
+                    os << "INT";
+                    break;
+                case Keyword::Add:
+                    os << "ADD";
+                    break;
+                case Keyword::Sub:
+                    os << "SUB";
+                    break;
+                case Keyword::Mul:
+                    os << "MUL";
+                    break;
+                case Keyword::DivMod:
+                    os << "DIVMOD";
+                    break;
+                case Keyword::Less:
+                    os << "LESS";
+                    break;
             }
         },
     }, token);
@@ -27,6 +27,18 @@ namespace bfasm::parse {
         Else,
         While,
         Use,
+        Switch,
+        Case,
+        Default,
+        Array,
+        Get,
+        Set,
+        Int,
+        Add,
+        Sub,
+        Mul,
+        DivMod,
+        Less,
     };
     enum class Control {
         LCurly,
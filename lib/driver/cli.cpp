@@ -0,0 +1,241 @@
+#include "cli.h"
+
+#include <charconv>
+#include <string>
+#include <string_view>
+
+
+namespace bftrans::driver {
+    const char* const USAGE =
+        "Usage: bftrans [options] <input.bfasm | ->\n"
+        "\n"
+        "Options:\n"
+        "  -o <path>               Write output to <path> (default: stdout)\n"
+        "  --emit=ast|labels|bf|c|cost\n"
+        "                          Select what to output (default: bf); cost is\n"
+        "                          a static size and executed-ops estimate\n"
+        "  -O<level>               Optimization level, 0-2 (default: 0)\n"
+        "  --backend=absolute|pointer\n"
+        "                          C lowering: cells addressed by resolved label\n"
+        "                          offsets, or a moving pointer mirroring the\n"
+        "                          generated brainfuck (default: absolute)\n"
+        "  --source-map=<path>     Write the brainfuck-offset to bfasm-origin table\n"
+        "  --run                   Run the generated brainfuck in the built-in\n"
+        "                          interpreter instead of emitting it\n"
+        "  --profile[=flat|folded] Run, then report executed ops per macro and\n"
+        "                          source line, or as folded stacks, on stderr\n"
+        "  --max-steps=<n>         Stop running after about <n> executed ops\n"
+        "  --timeout=<ms>          Stop running after <ms> milliseconds, as\n"
+        "                          checked at loop back-edges; a `,` blocked\n"
+        "                          on input is not interrupted; batches time\n"
+        "                          every record, or lockstep group, and\n"
+        "                          servers every session, on its own\n"
+        "  --tiered                Start running before looking for closed-form\n"
+        "                          loops, and give them to loops once they get\n"
+        "                          hot (plain runs at -O1 and above)\n"
+        "  --batch=lines|lengths|files\n"
+        "                          Run once per record of stdin: a line, bytes\n"
+        "                          after a 4-byte little-endian length, or a\n"
+        "                          line naming a file to read; outputs follow\n"
+        "                          in order, after their lengths for lengths\n"
+        "  --jobs=<n>              Threads of a batch or server (default: all\n"
+        "                          cores)\n"
+        "  --lockstep              Run a batch 32 records at a time in vector\n"
+        "                          lanes, with 8-bit wrapping cells\n"
+        "  --serve=<socket>        Run a session per connection to a Unix\n"
+        "                          socket, on --jobs threads, taking what the\n"
+        "                          client sends as its input and sending back\n"
+        "                          its output\n"
+        "  --cells=8|16|32         Cell width when running (default: 8)\n"
+        "  --overflow=wrap|saturate|trap\n"
+        "                          What cells do past their range when running\n"
+        "                          (default: wrap); optimizations assume 8-bit\n"
+        "                          wrapping cells and are off for other cells\n"
+        "  --eof=keep|zero|minus-one\n"
+        "                          What `,` stores at the end of input when\n"
+        "                          running (default: keep the cell)\n"
+        "  --tape=growable|paged|<n>\n"
+        "                          Run on a tape growing to the right, on one\n"
+        "                          reserved up front between guard pages, or on\n"
+        "                          one of <n> cells (default: growable)\n"
+        "  --huge-pages            Back a paged tape with huge pages\n"
+        "  --time-passes           Report wall time, allocations and peak RSS\n"
+        "                          for every stage on stderr\n"
+        "  -h, --help              Show this message\n";
+
+    std::expected<Options, std::string> parse_args(int argc, const char* const* argv) {
+        Options options;
+        bool has_input = false;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+
+            if (arg == "-h" || arg == "--help") {
+                options.help = true;
+            } else if (arg == "--time-passes") {
+                options.time_passes = true;
+            } else if (arg == "-o") {
+                if (++i == argc) {
+                    return std::unexpected("Option -o requires a path.");
+                }
+                options.output = argv[i];
+            } else if (arg.starts_with("--emit=")) {
+                auto emit = arg.substr(7);
+                if (emit == "ast") {
+                    options.emit = Emit::Ast;
+                } else if (emit == "labels") {
+                    options.emit = Emit::Labels;
+                } else if (emit == "bf") {
+                    options.emit = Emit::Bf;
+                } else if (emit == "c") {
+                    options.emit = Emit::C;
+                } else if (emit == "cost") {
+                    options.emit = Emit::Cost;
+                } else {
+                    return std::unexpected("Unknown emit kind: \"" + std::string(emit) + "\".");
+                }
+            } else if (arg.starts_with("--backend=")) {
+                auto backend = arg.substr(10);
+                if (backend == "absolute") {
+                    options.backend = bflabels::CBackend::Absolute;
+                } else if (backend == "pointer") {
+                    options.backend = bflabels::CBackend::Pointer;
+                } else {
+                    return std::unexpected("Unknown backend: \"" + std::string(backend) + "\".");
+                }
+            } else if (arg == "--run") {
+                options.run = true;
+            } else if (arg == "--profile" || arg == "--profile=flat") {
+                options.run = true;
+                options.profile = ProfileFormat::Flat;
+            } else if (arg == "--profile=folded") {
+                options.run = true;
+                options.profile = ProfileFormat::Folded;
+            } else if (arg.starts_with("--source-map=")) {
+                options.source_map = arg.substr(13);
+            } else if (arg.starts_with("--max-steps=")) {
+                auto steps = arg.substr(12);
+                auto [ptr, ec] = std::from_chars(steps.data(), steps.data() + steps.size(), options.max_steps);
+                if (ec != std::errc{} || ptr != steps.data() + steps.size()) {
+                    return std::unexpected("Invalid step count: \"" + std::string(steps) + "\".");
+                }
+            } else if (arg.starts_with("--timeout=")) {
+                auto timeout = arg.substr(10);
+                uint64_t ms;
+                auto [ptr, ec] = std::from_chars(timeout.data(), timeout.data() + timeout.size(), ms);
+                if (ec != std::errc{} || ptr != timeout.data() + timeout.size()) {
+                    return std::unexpected("Invalid timeout: \"" + std::string(timeout) + "\".");
+                }
+                options.timeout_ms = ms;
+            } else if (arg.starts_with("--cells=")) {
+                auto cells = arg.substr(8);
+                if (cells == "8") {
+                    options.dialect.cells = bfvm::CellWidth::Bits8;
+                } else if (cells == "16") {
+                    options.dialect.cells = bfvm::CellWidth::Bits16;
+                } else if (cells == "32") {
+                    options.dialect.cells = bfvm::CellWidth::Bits32;
+                } else {
+                    return std::unexpected("Unknown cell width: \"" + std::string(cells) + "\".");
+                }
+            } else if (arg.starts_with("--overflow=")) {
+                auto overflow = arg.substr(11);
+                if (overflow == "wrap") {
+                    options.dialect.overflow = bfvm::Overflow::Wrap;
+                } else if (overflow == "saturate") {
+                    options.dialect.overflow = bfvm::Overflow::Saturate;
+                } else if (overflow == "trap") {
+                    options.dialect.overflow = bfvm::Overflow::Trap;
+                } else {
+                    return std::unexpected("Unknown overflow mode: \"" + std::string(overflow) + "\".");
+                }
+            } else if (arg.starts_with("--eof=")) {
+                auto eof = arg.substr(6);
+                if (eof == "keep") {
+                    options.dialect.eof = bfvm::EofBehavior::Keep;
+                } else if (eof == "zero") {
+                    options.dialect.eof = bfvm::EofBehavior::Zero;
+                } else if (eof == "minus-one") {
+                    options.dialect.eof = bfvm::EofBehavior::MinusOne;
+                } else {
+                    return std::unexpected("Unknown EOF behavior: \"" + std::string(eof) + "\".");
+                }
+            } else if (arg.starts_with("--tape=")) {
+                auto tape = arg.substr(7);
+                if (tape == "growable") {
+                    options.dialect.tape = bfvm::TapePolicy::Growable;
+                } else if (tape == "paged") {
+                    options.dialect.tape = bfvm::TapePolicy::Paged;
+                } else {
+                    auto [ptr, ec] = std::from_chars(tape.data(), tape.data() + tape.size(), options.dialect.tape_cells);
+                    if (ec != std::errc{} || ptr != tape.data() + tape.size() || options.dialect.tape_cells == 0) {
+                        return std::unexpected("Invalid tape size: \"" + std::string(tape) + "\".");
+                    }
+                    options.dialect.tape = bfvm::TapePolicy::Fixed;
+                }
+            } else if (arg.starts_with("--batch=")) {
+                auto batch = arg.substr(8);
+                if (batch == "lines") {
+                    options.batch = Batch::Lines;
+                } else if (batch == "lengths") {
+                    options.batch = Batch::Lengths;
+                } else if (batch == "files") {
+                    options.batch = Batch::Files;
+                } else {
+                    return std::unexpected("Unknown batch kind: \"" + std::string(batch) + "\".");
+                }
+                options.run = true;
+            } else if (arg.starts_with("--jobs=")) {
+                auto jobs = arg.substr(7);
+                auto [ptr, ec] = std::from_chars(jobs.data(), jobs.data() + jobs.size(), options.jobs);
+                if (ec != std::errc{} || ptr != jobs.data() + jobs.size() || options.jobs == 0) {
+                    return std::unexpected("Invalid job count: \"" + std::string(jobs) + "\".");
+                }
+            } else if (arg.starts_with("--serve=")) {
+                options.serve = arg.substr(8);
+                if (options.serve.empty()) {
+                    return std::unexpected("No socket path to serve on.");
+                }
+                options.run = true;
+            } else if (arg == "--lockstep") {
+                options.lockstep = true;
+            } else if (arg == "--tiered") {
+                options.tiered = true;
+            } else if (arg == "--huge-pages") {
+                options.dialect.huge_pages = true;
+            } else if (arg.starts_with("-O")) {
+                auto level = arg.substr(2);
+                if (level.size() != 1 || level[0] < '0' || level[0] > '2') {
+                    return std::unexpected("Invalid optimization level: \"" + std::string(arg) + "\".");
+                }
+                options.opt_level = level[0] - '0';
+            } else if (arg == "-" || !arg.starts_with("-")) {
+                if (has_input) {
+                    return std::unexpected("Only one input file is supported.");
+                }
+                options.input = arg;
+                has_input = true;
+            } else {
+                return std::unexpected("Unknown option: \"" + std::string(arg) + "\".");
+            }
+        }
+
+        if (!has_input && !options.help) {
+            return std::unexpected("No input file.");
+        }
+
+        if (options.batch != Batch::None && (options.profile != ProfileFormat::None || options.input == "-")) {
+            return std::unexpected("Batches take records from stdin and can't be profiled.");
+        }
+
+        if (options.lockstep && options.batch == Batch::None) {
+            return std::unexpected("Only batches run in lockstep.");
+        }
+
+        if (!options.serve.empty() && (options.batch != Batch::None || options.profile != ProfileFormat::None)) {
+            return std::unexpected("Served sessions can't be batched or profiled.");
+        }
+
+        return options;
+    }
+}  // namespace bftrans::driver
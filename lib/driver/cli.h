@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+
+#include "../labels/bflabels.h"
+#include "../vm/dialect.h"
+
+
+namespace bftrans::driver {
+    enum class Emit {
+        Ast,
+        Labels,
+        Bf,
+        C,
+        Cost,
+    };
+
+    enum class Batch {
+        None,
+        Lines,
+        Lengths,
+        Files,
+    };
+
+    enum class ProfileFormat {
+        None,
+        Flat,
+        Folded,
+    };
+
+    struct Options {
+        std::string input;
+        std::string output = "-";
+        Emit emit = Emit::Bf;
+        unsigned opt_level = 0;
+        bflabels::CBackend backend = bflabels::CBackend::Absolute;
+        bool time_passes = false;
+        bool run = false;
+        ProfileFormat profile = ProfileFormat::None;
+        std::string source_map;
+        uint64_t max_steps = -1;
+        std::optional<uint64_t> timeout_ms;
+        bfvm::Dialect dialect;
+        bool tiered = false;
+        Batch batch = Batch::None;
+        unsigned jobs = 0;
+        bool lockstep = false;
+        std::string serve;
+        bool help = false;
+    };
+
+    extern const char* const USAGE;
+
+    std::expected<Options, std::string> parse_args(int argc, const char* const* argv);
+}  // namespace bftrans::driver
@@ -0,0 +1,72 @@
+#include "stats.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <sys/resource.h>
+
+
+namespace {
+    std::atomic<size_t> allocations = 0;
+}
+
+// Replacing the global allocation functions is the only portable way to count
+// allocations made inside the standard containers every stage is built on.
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+
+namespace bftrans::driver {
+    size_t allocation_count() {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    size_t peak_rss_kib() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    void PassTimer::report(std::ostream& os) const {
+        char line[128];
+
+        os << "===-- Pass timing report --===\n";
+        std::snprintf(line, sizeof(line), "  %-10s %12s %12s %16s\n", "stage", "wall (ms)", "allocs", "peak RSS (KiB)");
+        os << line;
+
+        double total_ms = 0;
+        size_t total_allocations = 0;
+
+        for (const auto& stage : stages) {
+            std::snprintf(
+                line, sizeof(line), "  %-10.*s %12.3f %12zu %16zu\n",
+                (int)stage.name.size(), stage.name.data(),
+                stage.wall_ms, stage.allocations, stage.peak_rss_kib
+            );
+            os << line;
+
+            total_ms += stage.wall_ms;
+            total_allocations += stage.allocations;
+        }
+
+        std::snprintf(line, sizeof(line), "  %-10s %12.3f %12zu %16zu\n", "total", total_ms, total_allocations, peak_rss_kib());
+        os << line;
+    }
+}  // namespace bftrans::driver
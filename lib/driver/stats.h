@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+
+namespace bftrans::driver {
+    // Number of global `operator new` calls made by the process so far.
+    size_t allocation_count();
+
+    // Peak resident set size of the process so far, in KiB.
+    size_t peak_rss_kib();
+
+    struct StageStats {
+        std::string_view name;
+        double wall_ms;
+        size_t allocations;
+        size_t peak_rss_kib;
+    };
+
+    class PassTimer {
+      private:
+        std::vector<StageStats> stages;
+        bool enabled;
+
+      public:
+        PassTimer(bool enabled) : enabled(enabled) {}
+
+        template <typename F>
+        std::invoke_result_t<F> time(std::string_view name, F&& stage) {
+            if (!enabled) {
+                return stage();
+            }
+
+            size_t allocations = allocation_count();
+            auto start = std::chrono::steady_clock::now();
+
+            auto record = [&] {
+                auto end = std::chrono::steady_clock::now();
+
+                stages.push_back(StageStats {
+                    .name = name,
+                    .wall_ms = std::chrono::duration<double, std::milli>(end - start).count(),
+                    .allocations = allocation_count() - allocations,
+                    .peak_rss_kib = peak_rss_kib(),
+                });
+            };
+
+            if constexpr (std::is_void_v<std::invoke_result_t<F>>) {
+                stage();
+                record();
+            } else {
+                auto result = stage();
+                record();
+                return result;
+            }
+        }
+
+        void report(std::ostream& os) const;
+    };
+}  // namespace bftrans::driver
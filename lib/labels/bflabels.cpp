@@ -1,6 +1,8 @@
 #include "bflabels.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <charconv>
 #include <set>
@@ -166,52 +168,47 @@ ParseResult<std::vector<Token>> Parser::parse() {
 }
 
 
-std::map<Label, int64_t> BFLCode::find_offsets() {
-    std::vector<Label> labels;
+void BFLCode::place_labels() {
+    std::vector<Label> unplaced_labels;
+    std::set<Label> used;
+    std::map<Label, size_t> extents = layout.label_extents;
 
     for (auto token : tokens) {
         if (const Label* label = std::get_if<Label>(&token)) {
-            labels.push_back(*label);
+            size_t& extent = extents[*label];
+            extent = std::max(extent, label->element_idx + 1);
+
+            if (used.insert(*label).second && !layout.label_offsets.contains(*label)) {
+                unplaced_labels.push_back(*label);
+            }
         }
     }
 
-    std::set<Label> unique_labels(labels.begin(), labels.end());
-
-    std::set<Label> placed_labels;
-    std::set<Label> unplaced_labels;
-
-    // for (auto label : unique_labels) {
-    //     if (!layout.label_offsets.contains(label)) {
-    //         std::cout << "Label " << label << '\n';
-    //         unplaced_labels.insert(label);
-    //     } else {
-    //         placed_labels.insert(label);
-    //     }
-    // }
-
-    // TODO TODO TODO TODO
-
-    std::map<Label, int64_t> offsets;
+    // Labels placed by the caller keep their cells; the rest are packed
+    // after the last reserved cell in order of first use.
+    int64_t free_offset = 0;
+    for (auto [label, offset] : layout.label_offsets) {
+        size_t extent = extents.contains(label) ? extents[label] : 1;
+        free_offset = std::max(free_offset, offset + (int64_t)extent);
+    }
 
-    size_t i = 0;
     for (auto label : unplaced_labels) {
-        offsets[label] = i++;
+        layout.label_offsets[label] = free_offset;
+        free_offset += extents[label];
     }
-
-    return offsets;
 }
 
 
-std::string BFLCode::compile() {
+std::string BFLCode::compile(std::vector<size_t>* token_map) {
     std::string code;
     int64_t last_pos = 0;
 
-    auto offsets = find_offsets();
+    for (size_t token_idx = 0; token_idx < tokens.size(); ++token_idx) {
+        auto token = tokens[token_idx];
 
-    for (auto token : tokens) {
         std::visit([&](auto token) {
             if constexpr (std::is_same_v<decltype(token), Label>) {
-                auto offset = offsets[token];
+                auto offset = this->offset(token);
                 char op = last_pos < offset ? '>' : '<';
 
                 for (size_t i = std::abs(last_pos - offset); i != 0; --i) {
@@ -223,6 +220,10 @@ std::string BFLCode::compile() {
                 code += token;
             }
         }, token);
+
+        if (token_map) {
+            token_map->resize(code.size(), token_idx);
+        }
     }
 
     return code;
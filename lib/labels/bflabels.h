@@ -6,6 +6,7 @@
 #include <string>
 #include <unordered_map>
 #include <map>
+#include <optional>
 #include <variant>
 #include <vector>
 
@@ -31,6 +32,28 @@ enum class Scope {
 
 using Token = std::variant<Operation, Label, Scope>;
 
+// Closed-form effect of running a loop to completion: every update adds the
+// sum of its terms, each a coefficient times the product of the values its
+// factor cells had on entry, and the counter cell ends at zero. Arithmetic
+// wraps at 8 bits.
+struct ClosedLoop {
+    struct Term {
+        uint8_t coefficient;
+        std::vector<Label> factors;
+    };
+
+    struct Update {
+        Label cell;
+        std::vector<Term> terms;
+    };
+
+    Label counter;
+    std::vector<Update> updates;
+};
+
+// Closed loops keyed by the token index of their `[`.
+using ClosedLoops = std::map<size_t, ClosedLoop>;
+
 } // namespace bflabels
 
 template <>
@@ -79,17 +102,46 @@ public:
 };
 
 
+struct MemoryLayout {
+    std::map<Label, int64_t> label_offsets;
+    // Cells to reserve for a label beyond those its elements name, for
+    // regions the code walks with raw moves.
+    std::map<Label, size_t> label_extents;
+};
+
+enum class CBackend {
+    Pointer,
+    Absolute,
+};
+
 class BFLCode {
 private:
     const std::vector<Token>& tokens;
+    MemoryLayout layout;
 
-    std::map<Label, int64_t> find_offsets();
+    void place_labels();
 
 public:
-    BFLCode(const std::vector<Token>& tokens) :
-          tokens(tokens) {};
+    BFLCode(const std::vector<Token>& tokens, MemoryLayout layout = {}) :
+          tokens(tokens),
+          layout(std::move(layout)) {
+        place_labels();
+    };
+
+    const MemoryLayout& memory_layout() const {
+        return layout;
+    }
+
+    int64_t offset(Label label) const {
+        return layout.label_offsets.at(label) + label.element_idx;
+    }
 
-    std::string compile();
+    // When `token_map` is given, it receives the index of the producing token
+    // for every emitted character; pointer moves belong to their label.
+    std::string compile(std::vector<size_t>* token_map = nullptr);
+    // Loops in `closed_loops` are emitted as their closed-form updates. Code
+    // with raw moves is always lowered with the pointer backend.
+    std::string compile_c(CBackend backend, const ClosedLoops& closed_loops = {});
 };
 
 } // namespace bflabels
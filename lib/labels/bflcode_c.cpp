@@ -0,0 +1,289 @@
+#include "bflabels.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels {
+
+namespace {
+
+class CWriter {
+private:
+    std::string code;
+    size_t depth = 1;
+
+    // Pending `+`/`-` run on the current cell, folded into a single statement.
+    int delta = 0;
+
+    void indent() {
+        code.append(depth * 4, ' ');
+    }
+
+public:
+    void flush(const std::string& cell) {
+        if (delta % 256 == 0) {
+            delta = 0;
+            return;
+        }
+
+        indent();
+        code += cell;
+        code += delta > 0 ? " += " : " -= ";
+        code += std::to_string(std::abs(delta));
+        code += ";\n";
+        delta = 0;
+    }
+
+    void move(int64_t by) {
+        if (by == 0) {
+            return;
+        }
+
+        indent();
+        code += by > 0 ? "p += " : "p -= ";
+        code += std::to_string(std::abs(by));
+        code += ";\n";
+    }
+
+    void operation(Operation op, const std::string& cell) {
+        switch (op) {
+            case '+':
+                ++delta;
+                return;
+
+            case '-':
+                --delta;
+                return;
+        }
+
+        flush(cell);
+
+        switch (op) {
+            case '[':
+                indent();
+                code += "while (" + cell + ") {\n";
+                ++depth;
+                break;
+
+            case ']':
+                --depth;
+                indent();
+                code += "}\n";
+                break;
+
+            case '.':
+                indent();
+                code += "putchar(" + cell + ");\n";
+                break;
+
+            case ',':
+                indent();
+                code += "input(&" + cell + ");\n";
+                break;
+        }
+    }
+
+    // `cell_of` renders the cell of a label as a C lvalue.
+    template <typename F>
+    void closed_loop(const ClosedLoop& loop, F&& cell_of) {
+        // Every factor is read before any cell is written.
+        std::map<std::string, std::string> values;
+        for (const auto& update : loop.updates) {
+            for (const auto& term : update.terms) {
+                for (Label factor : term.factors) {
+                    values.try_emplace(cell_of(factor), "v" + std::to_string(values.size()));
+                }
+            }
+        }
+
+        if (!values.empty()) {
+            indent();
+            code += "{\n";
+            ++depth;
+
+            for (const auto& [cell, value] : values) {
+                indent();
+                code += "unsigned " + value + " = " + cell + ";\n";
+            }
+        }
+
+        for (const auto& update : loop.updates) {
+            indent();
+            code += cell_of(update.cell) + " += ";
+
+            for (size_t i = 0; i < update.terms.size(); ++i) {
+                const auto& term = update.terms[i];
+                std::string product;
+
+                if (term.coefficient != 1 || term.factors.empty()) {
+                    product = std::to_string(term.coefficient) + "u";
+                }
+                for (Label factor : term.factors) {
+                    product += (product.empty() ? "" : " * ") + values[cell_of(factor)];
+                }
+
+                code += (i ? " + " : "") + product;
+            }
+
+            code += ";\n";
+        }
+
+        indent();
+        code += cell_of(loop.counter) + " = 0;\n";
+
+        if (!values.empty()) {
+            --depth;
+            indent();
+            code += "}\n";
+        }
+    }
+
+    std::string finish(size_t tape_size, int64_t origin, bool pointer) {
+        std::string out =
+            "#include <stdio.h>\n"
+            "\n"
+            "static unsigned char m[" + std::to_string(tape_size) + "];\n"
+            "\n"
+            "static void input(unsigned char* cell) {\n"
+            "    int ch = getchar();\n"
+            "    if (ch != EOF) *cell = (unsigned char)ch;\n"
+            "}\n"
+            "\n"
+            "int main(void) {\n";
+
+        if (pointer) {
+            out += "    unsigned char* p = m + " + std::to_string(origin) + ";\n";
+        }
+
+        out += code;
+        out += "    return 0;\n}\n";
+
+        return out;
+    }
+};
+
+} // namespace
+
+
+std::string BFLCode::compile_c(CBackend backend, const ClosedLoops& closed_loops) {
+    int64_t min_offset = 0;
+    int64_t max_offset = 0;
+
+    for (auto token : tokens) {
+        if (const Label* label = std::get_if<Label>(&token)) {
+            min_offset = std::min(min_offset, offset(*label));
+            max_offset = std::max(max_offset, offset(*label));
+        }
+    }
+
+    size_t tape_size = max_offset - min_offset + 1;
+    CWriter writer;
+
+    // Cells reached through raw moves have no fixed address.
+    bool raw_moves = std::ranges::any_of(tokens, [](Token token) {
+        return token == Token('<') || token == Token('>');
+    });
+
+    if (backend == CBackend::Pointer || raw_moves) {
+        std::string cell = "*p";
+        std::vector<size_t> token_map;
+        std::string code = compile(&token_map);
+
+        std::vector<size_t> matches(code.size());
+        std::vector<size_t> open_loops;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (code[i] == '[') {
+                open_loops.push_back(i);
+            } else if (code[i] == ']' && !open_loops.empty()) {
+                matches[open_loops.back()] = i;
+                open_loops.pop_back();
+            }
+        }
+
+        for (size_t i = 0; i < code.size();) {
+            auto closed = code[i] == '[' ? closed_loops.find(token_map[i]) : closed_loops.end();
+
+            if (closed != closed_loops.end()) {
+                writer.flush(cell);
+
+                int64_t counter = offset(closed->second.counter);
+                writer.closed_loop(closed->second, [&](Label label) {
+                    return "p[" + std::to_string(offset(label) - counter) + "]";
+                });
+
+                i = matches[i] + 1;
+                continue;
+            }
+
+
+            if (code[i] == '<' || code[i] == '>') {
+                writer.flush(cell);
+
+                int64_t by = 0;
+                for (; i < code.size() && (code[i] == '<' || code[i] == '>'); ++i) {
+                    by += code[i] == '>' ? 1 : -1;
+                }
+
+                writer.move(by);
+                continue;
+            }
+
+            writer.operation(code[i++], cell);
+        }
+
+        writer.flush(cell);
+
+        return writer.finish(tape_size, -min_offset, true);
+    }
+
+    std::string cell = "m[" + std::to_string(-min_offset) + "]";
+
+    std::vector<size_t> matches(tokens.size());
+    std::vector<size_t> open_loops;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens[i] == Token('[')) {
+            open_loops.push_back(i);
+        } else if (tokens[i] == Token(']') && !open_loops.empty()) {
+            matches[open_loops.back()] = i;
+            open_loops.pop_back();
+        }
+    }
+
+    auto cell_of = [&](Label label) {
+        return "m[" + std::to_string(offset(label) - min_offset) + "]";
+    };
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (auto closed = closed_loops.find(i); closed != closed_loops.end()) {
+            writer.flush(cell);
+            writer.closed_loop(closed->second, cell_of);
+            i = matches[i];
+            continue;
+        }
+
+        std::visit([&](auto token) {
+            if constexpr (std::is_same_v<decltype(token), Label>) {
+                std::string next = cell_of(token);
+
+                if (next != cell) {
+                    writer.flush(cell);
+                    cell = std::move(next);
+                }
+            } else if constexpr (std::is_same_v<decltype(token), Operation>) {
+                writer.operation(token, cell);
+            }
+        }, tokens[i]);
+    }
+
+    writer.flush(cell);
+
+    return writer.finish(tape_size, -min_offset, false);
+}
+
+} // namespace bflabels
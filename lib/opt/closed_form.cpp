@@ -0,0 +1,499 @@
+#include "closed_form.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels::opt {
+
+namespace {
+
+// (label_idx, element_idx); `Label::operator<` ignores the element.
+using Cell = std::pair<size_t, size_t>;
+
+// Multivariate polynomial over cell values, with 8-bit wrapping coefficients.
+class Poly {
+public:
+    // Sorted symbol ids, repeated for powers -> nonzero coefficient.
+    std::map<std::vector<size_t>, uint8_t> terms;
+
+    static Poly constant(uint8_t value) {
+        Poly poly;
+        if (value) {
+            poly.terms[{}] = value;
+        }
+        return poly;
+    }
+
+    static Poly symbol(size_t id) {
+        Poly poly;
+        poly.terms[{id}] = 1;
+        return poly;
+    }
+
+    bool is_zero() const {
+        return terms.empty();
+    }
+
+    std::optional<uint8_t> constant_value() const {
+        if (terms.empty()) {
+            return 0;
+        }
+        if (terms.size() == 1 && terms.begin()->first.empty()) {
+            return terms.begin()->second;
+        }
+        return std::nullopt;
+    }
+
+    bool mentions(size_t id) const {
+        for (const auto& [monomial, coefficient] : terms) {
+            if (std::find(monomial.begin(), monomial.end(), id) != monomial.end()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void add_term(const std::vector<size_t>& monomial, uint8_t coefficient) {
+        uint8_t& sum = terms[monomial];
+        sum += coefficient;
+        if (!sum) {
+            terms.erase(monomial);
+        }
+    }
+
+    Poly& operator+=(const Poly& other) {
+        for (const auto& [monomial, coefficient] : other.terms) {
+            add_term(monomial, coefficient);
+        }
+        return *this;
+    }
+
+    Poly operator-(const Poly& other) const {
+        Poly result = *this;
+        for (const auto& [monomial, coefficient] : other.terms) {
+            result.add_term(monomial, -coefficient);
+        }
+        return result;
+    }
+
+    Poly operator*(const Poly& other) const {
+        Poly result;
+        for (const auto& [a, ca] : terms) {
+            for (const auto& [b, cb] : other.terms) {
+                std::vector<size_t> monomial;
+                std::merge(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(monomial));
+                result.add_term(monomial, ca * cb);
+            }
+        }
+        return result;
+    }
+
+    template <typename F>
+    Poly substitute(F&& value_of) const {
+        Poly result;
+        for (const auto& [monomial, coefficient] : terms) {
+            Poly product = constant(coefficient);
+            for (size_t id : monomial) {
+                product = product * value_of(id);
+            }
+            result += product;
+        }
+        return result;
+    }
+};
+
+// Past this many terms in one cell the closed form is not worth it.
+constexpr size_t MAX_TERMS = 64;
+
+// Token visits spent on one outermost loop before giving up; nested loops
+// are re-run on every fixed-point round, which compounds with depth.
+constexpr size_t WORK_BUDGET = 1 << 16;
+
+// Inverse of an odd number modulo 256.
+uint8_t inverse(uint8_t odd) {
+    uint8_t x = odd;
+    for (int i = 0; i < 3; ++i) {
+        x *= 2 - odd * x;
+    }
+    return x;
+}
+
+using State = std::map<Cell, Poly>;
+
+class Analysis {
+private:
+    const std::vector<Token>& tokens;
+
+    // Cell each token operates on, if known, and matching brackets.
+    std::vector<std::optional<Cell>> cells;
+    std::vector<size_t> matches;
+
+    // Prefix counts of `.`, `,` and raw moves, none of which a closed form
+    // can contain.
+    std::vector<size_t> barriers;
+    std::map<size_t, std::set<Cell>> touched_cache;
+    size_t work = 0;
+
+    // Symbols below `base_cells.size()` are entry values of cells at the
+    // outermost loop being analyzed; later ones are per-loop fresh symbols.
+    std::vector<Cell> base_cells;
+    std::map<Cell, size_t> base_ids;
+    size_t next_symbol = 0;
+
+    Poly entry_value(const State& entry, Cell cell) const {
+        auto it = entry.find(cell);
+        return it != entry.end() ? it->second : Poly::symbol(base_ids.at(cell));
+    }
+
+    const std::set<Cell>& touched(size_t open) {
+        auto [it, inserted] = touched_cache.try_emplace(open);
+        if (inserted) {
+            for (size_t i = open; i <= matches[open]; ++i) {
+                if (cells[i]) {
+                    it->second.insert(*cells[i]);
+                }
+            }
+        }
+        return it->second;
+    }
+
+    // Runs the body of the loop at `open` once over `state`.
+    bool run_body(size_t open, State& state) {
+        for (size_t i = open + 1; i < matches[open]; ++i) {
+            if (++work > WORK_BUDGET) {
+                return false;
+            }
+
+            if (std::holds_alternative<Label>(tokens[i]) || std::holds_alternative<Scope>(tokens[i])) {
+                continue;
+            }
+
+            Operation op = std::get<Operation>(tokens[i]);
+
+            switch (op) {
+                case '+':
+                case '-':
+                    if (!cells[i]) {
+                        return false;
+                    }
+                    state[*cells[i]] += Poly::constant(op == '+' ? 1 : 255);
+                    break;
+
+                case '[': {
+                    auto effect = loop_effect(i, state);
+                    if (!effect) {
+                        return false;
+                    }
+                    state = std::move(*effect);
+                    i = matches[i];
+                    break;
+                }
+
+                default:
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    // One symbolic iteration of the loop at `open`, with the cells in
+    // `symbolic` (and the counter) as fresh symbols and the others at their
+    // entry value when that is a constant.
+    std::optional<std::pair<State, State>> iterate(size_t open, const State& entry, const std::set<Cell>& symbolic, std::map<size_t, Cell>& fresh) {
+        State generic;
+
+        for (Cell cell : touched(open)) {
+            Poly value = entry_value(entry, cell);
+
+            if (value.constant_value() && !symbolic.contains(cell)) {
+                generic[cell] = value;
+            } else {
+                fresh[next_symbol] = cell;
+                generic[cell] = Poly::symbol(next_symbol++);
+            }
+        }
+
+        State state = generic;
+        if (!run_body(open, state)) {
+            return std::nullopt;
+        }
+
+        return std::make_pair(std::move(generic), std::move(state));
+    }
+
+public:
+    // Final state after running the loop at `open` from `entry` to completion,
+    // or nullopt if it has no closed form.
+    std::optional<State> loop_effect(size_t open, const State& entry) {
+        size_t close = matches[open];
+
+        if (close == tokens.size() || !cells[open] || cells[close] != cells[open] || barriers[close] != barriers[open]) {
+            return std::nullopt;
+        }
+
+        Cell counter = *cells[open];
+
+        // Cells substituted by a constant must come back to it every
+        // iteration; those that do not are redone as symbols.
+        std::set<Cell> symbolic = {counter};
+        std::map<size_t, Cell> fresh;
+        State generic, after;
+
+        while (true) {
+            fresh.clear();
+            auto iteration = iterate(open, entry, symbolic, fresh);
+            if (!iteration) {
+                return std::nullopt;
+            }
+
+            std::tie(generic, after) = std::move(*iteration);
+
+            bool stable = true;
+            for (const auto& [cell, value] : generic) {
+                if (!symbolic.contains(cell) && !(after[cell] - value).is_zero()) {
+                    symbolic.insert(cell);
+                    stable = false;
+                }
+            }
+
+            if (stable) {
+                break;
+            }
+        }
+
+        std::map<Cell, Poly> deltas;
+        std::set<size_t> changing;
+        for (const auto& [cell, value] : generic) {
+            deltas[cell] = after[cell] - value;
+            if (!deltas[cell].is_zero()) {
+                for (const auto& [id, fresh_cell] : fresh) {
+                    if (fresh_cell == cell) {
+                        changing.insert(id);
+                    }
+                }
+            }
+        }
+
+        auto step = deltas[counter].constant_value();
+        if (!step || *step % 2 == 0) {
+            return std::nullopt;
+        }
+
+        // Every iteration must add the same amount: deltas may only depend on
+        // cells no iteration changes.
+        for (const auto& [cell, delta] : deltas) {
+            for (size_t id : changing) {
+                if (delta.mentions(id)) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+        // The counter reaches zero after n = -counter / step iterations.
+        Poly trips = generic[counter] * Poly::constant(-inverse(*step));
+
+        State result = entry;
+        for (const auto& [cell, value] : generic) {
+            Poly final_value = cell == counter ? Poly() : value;
+            if (cell != counter) {
+                final_value += trips * deltas[cell];
+            }
+
+            final_value = final_value.substitute([&](size_t id) {
+                auto it = fresh.find(id);
+                return it != fresh.end() ? entry_value(entry, it->second) : Poly::symbol(id);
+            });
+
+            if (final_value.terms.size() > MAX_TERMS) {
+                return std::nullopt;
+            }
+
+            result[cell] = std::move(final_value);
+        }
+
+        return result;
+    }
+
+    Analysis(const std::vector<Token>& tokens) :
+        tokens(tokens),
+        matches(tokens.size(), tokens.size()) {
+        std::optional<Cell> cell;
+        std::vector<size_t> open_loops;
+        size_t barrier_count = 0;
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (const Label* label = std::get_if<Label>(&tokens[i])) {
+                cell = Cell { label->label_idx, label->element_idx };
+
+                if (!base_ids.contains(*cell)) {
+                    base_ids[*cell] = base_cells.size();
+                    base_cells.push_back(*cell);
+                }
+            } else if (const Operation* op = std::get_if<Operation>(&tokens[i])) {
+                if (*op == '<' || *op == '>' || *op == '.' || *op == ',') {
+                    ++barrier_count;
+                }
+
+                if (*op == '<' || *op == '>') {
+                    cell = std::nullopt;
+                } else if (*op == '[') {
+                    open_loops.push_back(i);
+                } else if (*op == ']' && !open_loops.empty()) {
+                    matches[open_loops.back()] = i;
+                    matches[i] = open_loops.back();
+                    open_loops.pop_back();
+                }
+            }
+
+            cells.push_back(cell);
+            barriers.push_back(barrier_count);
+        }
+
+        next_symbol = base_cells.size();
+    }
+
+    ClosedLoops run() {
+        ClosedLoops result;
+
+        // Values known at the current point; every cell starts at zero.
+        std::map<Cell, uint8_t> known;
+        for (Cell cell : base_cells) {
+            known[cell] = 0;
+        }
+
+        // Values known on entry to every enclosing loop without a closed
+        // form, which is also what is known after it, as its body may not run.
+        std::vector<std::map<Cell, uint8_t>> loop_entries;
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            const Operation* op = std::get_if<Operation>(&tokens[i]);
+
+            if (!op) {
+                continue;
+            }
+
+            if (!cells[i]) {
+                // Raw pointer moves: nothing is known past this point.
+                break;
+            }
+
+            Cell cell = *cells[i];
+
+            switch (*op) {
+                case '+':
+                case '-':
+                    if (known.contains(cell)) {
+                        known[cell] += *op == '+' ? 1 : -1;
+                    }
+                    break;
+
+                case ',':
+                    known.erase(cell);
+                    break;
+
+                case ']':
+                    if (!loop_entries.empty()) {
+                        known = std::move(loop_entries.back());
+                        loop_entries.pop_back();
+                    }
+                    known[cell] = 0;
+                    break;
+
+                case '[': {
+                    if (matches[i] == tokens.size()) {
+                        break;
+                    }
+
+                    State entry;
+                    for (Cell touched_cell : touched(i)) {
+                        if (known.contains(touched_cell)) {
+                            entry[touched_cell] = Poly::constant(known[touched_cell]);
+                        }
+                    }
+
+                    next_symbol = base_cells.size();
+                    work = 0;
+
+                    if (auto effect = loop_effect(i, entry)) {
+                        result[i] = closed_loop(cell, entry, *effect);
+
+                        for (const auto& [touched_cell, value] : *effect) {
+                            if (auto constant = value.constant_value()) {
+                                known[touched_cell] = *constant;
+                            } else {
+                                known.erase(touched_cell);
+                            }
+                        }
+
+                        i = matches[i];
+                        break;
+                    }
+
+                    // Entering the body: cells the loop modifies are unknown
+                    // on every iteration but the first.
+                    for (size_t j = i; j < matches[i]; ++j) {
+                        const Operation* body_op = std::get_if<Operation>(&tokens[j]);
+                        if (body_op && cells[j] && (*body_op == '+' || *body_op == '-' || *body_op == ',')) {
+                            known.erase(*cells[j]);
+                        }
+                    }
+                    known.erase(cell);
+
+                    loop_entries.push_back(known);
+                    break;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    ClosedLoop closed_loop(Cell counter, const State& entry, const State& effect) const {
+        auto label = [](Cell cell) {
+            return Label { cell.first, cell.second };
+        };
+
+        ClosedLoop loop { label(counter), {} };
+
+        for (const auto& [cell, value] : effect) {
+            if (cell == counter) {
+                continue;
+            }
+
+            Poly delta = value - entry_value(entry, cell);
+            if (delta.is_zero()) {
+                continue;
+            }
+
+            ClosedLoop::Update update { label(cell), {} };
+            for (const auto& [monomial, coefficient] : delta.terms) {
+                ClosedLoop::Term term { coefficient, {} };
+                for (size_t id : monomial) {
+                    term.factors.push_back(label(base_cells[id]));
+                }
+                update.terms.push_back(std::move(term));
+            }
+
+            loop.updates.push_back(std::move(update));
+        }
+
+        return loop;
+    }
+};
+
+} // namespace
+
+
+ClosedLoops find_closed_loops(const std::vector<Token>& tokens) {
+    return Analysis(tokens).run();
+}
+
+} // namespace bflabels::opt
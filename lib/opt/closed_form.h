@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "../labels/bflabels.h"
+
+
+namespace bflabels::opt {
+
+// Finds loops whose every iteration adds the same amounts to the cells it
+// touches and steps its counter by an odd constant, such as transfer loops
+// `x[t+x-]` and nested multiplication loops `x[y[r+t+y-]t[y+t-]x-]`, and
+// computes their closed-form effect. Inner loops are folded into the effect
+// of the outermost closed loop containing them. Cell values known on entry
+// (every cell starts at zero) are taken into account, so the usual `t[-]`
+// before a loop lets its temp count as restored. Loops with I/O or raw
+// pointer moves are left alone.
+ClosedLoops find_closed_loops(const std::vector<Token>& tokens);
+
+} // namespace bflabels::opt
@@ -0,0 +1,562 @@
+#include "coalesce.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels::opt {
+
+namespace {
+
+// (label_idx, element_idx); `Label::operator<` ignores the element.
+using Cell = std::pair<size_t, size_t>;
+
+Cell cell_of(Label label) {
+    return Cell { label.label_idx, label.element_idx };
+}
+
+// Set of cells, or every cell once an operation goes through raw moves.
+struct Cells {
+    std::set<Cell> cells;
+    bool anywhere = false;
+
+    bool contains(Cell cell) const {
+        return anywhere || cells.contains(cell);
+    }
+
+    void insert(std::optional<Cell> cell) {
+        if (!cell) {
+            anywhere = true;
+            cells.clear();
+        } else if (!anywhere) {
+            cells.insert(*cell);
+        }
+    }
+
+    void erase(std::optional<Cell> cell) {
+        if (cell && !anywhere) {
+            cells.erase(*cell);
+        }
+    }
+
+    void merge(const Cells& other) {
+        if (other.anywhere) {
+            anywhere = true;
+            cells.clear();
+        } else if (!anywhere) {
+            cells.insert(other.cells.begin(), other.cells.end());
+        }
+    }
+};
+
+bool is_op(const std::vector<Token>& tokens, size_t i, Operation op) {
+    return i < tokens.size() && tokens[i] == Token(op);
+}
+
+// `[-]`, which clears the current cell without reading it.
+bool is_clear(const std::vector<Token>& tokens, size_t i) {
+    return is_op(tokens, i, '[') && is_op(tokens, i + 1, '-') && is_op(tokens, i + 2, ']');
+}
+
+struct Analysis {
+    // Cells of copies, the only ones whose writes and liveness are tracked.
+    std::set<Cell> tracked;
+
+    // Current cell at every token, unknown after raw moves.
+    std::vector<std::optional<Cell>> cell;
+    // Matching bracket of every bracket.
+    std::vector<size_t> match;
+    // Cells written inside every loop, keyed by its `[`.
+    std::map<size_t, Cells> writes;
+    // Cells a loop body reads before clearing them, the check at its `]`
+    // included; these are live across its back edge.
+    std::map<size_t, Cells> exposed;
+
+    // The cell of `i` (itself nullopt when unknown), or nullopt when it is a
+    // cell not tracked.
+    std::optional<std::optional<Cell>> tracked_cell(size_t i) const {
+        if (cell[i] && !tracked.contains(*cell[i])) {
+            return std::nullopt;
+        }
+        return cell[i];
+    }
+};
+
+std::optional<Analysis> analyze(const std::vector<Token>& tokens, std::set<Cell> tracked) {
+    Analysis analysis;
+    analysis.tracked = std::move(tracked);
+    analysis.cell.resize(tokens.size());
+    analysis.match.resize(tokens.size());
+
+    std::optional<Cell> cell;
+    std::vector<std::pair<size_t, Cells>> open_loops;
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (const Label* label = std::get_if<Label>(&tokens[i])) {
+            cell = cell_of(*label);
+            continue;
+        }
+
+        analysis.cell[i] = cell;
+
+        const Operation* op = std::get_if<Operation>(&tokens[i]);
+        if (!op) {
+            continue;
+        }
+
+        switch (*op) {
+            case '<':
+            case '>':
+                cell = std::nullopt;
+                analysis.cell[i] = cell;
+                break;
+
+            case '+':
+            case '-':
+            case ',':
+                if (!open_loops.empty() && (!cell || analysis.tracked.contains(*cell))) {
+                    open_loops.back().second.insert(cell);
+                }
+                break;
+
+            case '[':
+                open_loops.emplace_back(i, Cells {});
+                break;
+
+            case ']': {
+                if (open_loops.empty()) {
+                    return std::nullopt;
+                }
+
+                auto [open, loop] = std::move(open_loops.back());
+                open_loops.pop_back();
+
+                if (!open_loops.empty()) {
+                    open_loops.back().second.merge(loop);
+                }
+
+                analysis.match[open] = i;
+                analysis.match[i] = open;
+                analysis.writes[open] = std::move(loop);
+                break;
+            }
+        }
+    }
+
+    if (!open_loops.empty()) {
+        return std::nullopt;
+    }
+
+    // Walked backwards, one set per loop being walked through.
+    std::vector<Cells> bodies(1);
+
+    for (size_t i = tokens.size(); i-- > 0;) {
+        const Operation* op = std::get_if<Operation>(&tokens[i]);
+        if (!op) {
+            continue;
+        }
+
+        auto cell = analysis.tracked_cell(i);
+
+        if (*op == ']' && i >= 2 && is_clear(tokens, i - 2)) {
+            if (cell) {
+                bodies.back().erase(*cell);
+            }
+            i -= 2;
+            continue;
+        }
+
+        switch (*op) {
+            case '+':
+            case '-':
+            case ',':
+            case '.':
+                if (cell) {
+                    bodies.back().insert(*cell);
+                }
+                break;
+
+            case ']':
+                bodies.emplace_back();
+                if (cell) {
+                    bodies.back().insert(*cell);
+                }
+                break;
+
+            case '[': {
+                Cells body = std::move(bodies.back());
+                bodies.pop_back();
+
+                bodies.back().merge(body);
+                if (cell) {
+                    bodies.back().insert(*cell);
+                }
+                analysis.exposed[i] = std::move(body);
+                break;
+            }
+        }
+    }
+
+    return analysis;
+}
+
+// `source [ destination + temp + source - ] temp [ source + temp - ]`, the
+// two `+` in either order.
+struct Copy {
+    size_t start;
+    // Just past the restore loop, where the range starts.
+    size_t end;
+
+    Label source;
+    Label destination;
+    Label temp;
+
+    // Where `destination` is cleared, its block closes or the stream ends.
+    size_t range_end;
+    bool cleared;
+};
+
+std::optional<Copy> match_copy(const std::vector<Token>& tokens, size_t i) {
+    auto label_at = [&](size_t j) -> std::optional<Label> {
+        if (j < tokens.size()) {
+            if (const Label* label = std::get_if<Label>(&tokens[j])) {
+                return *label;
+            }
+        }
+        return std::nullopt;
+    };
+
+    auto source = label_at(i);
+    if (!source || !is_op(tokens, i + 1, '[')) {
+        return std::nullopt;
+    }
+
+    auto first = label_at(i + 2);
+    auto second = label_at(i + 4);
+    if (!first || !second || label_at(i + 6) != source
+        || !is_op(tokens, i + 3, '+') || !is_op(tokens, i + 5, '+')
+        || !is_op(tokens, i + 7, '-') || !is_op(tokens, i + 8, ']')
+        || *first == *source || *second == *source || *first == *second) {
+        return std::nullopt;
+    }
+
+    auto temp = label_at(i + 9);
+    if (!temp || (*temp != *first && *temp != *second)
+        || !is_op(tokens, i + 10, '[') || label_at(i + 11) != source
+        || !is_op(tokens, i + 12, '+') || label_at(i + 13) != temp
+        || !is_op(tokens, i + 14, '-') || !is_op(tokens, i + 15, ']')) {
+        return std::nullopt;
+    }
+
+    Label destination = *temp == *first ? *second : *first;
+
+    return Copy { i, i + 16, *source, destination, *temp, 0, false };
+}
+
+// Extends `copy` up to the next clear of its destination in the same block,
+// the end of that block or the end of the stream.
+bool find_range(const std::vector<Token>& tokens, Copy& copy) {
+    size_t depth = 0;
+
+    for (size_t i = copy.end; i < tokens.size(); ++i) {
+        if (i - copy.end > COALESCE_WINDOW || is_op(tokens, i, '<') || is_op(tokens, i, '>')) {
+            return false;
+        }
+
+        if (is_clear(tokens, i)) {
+            if (depth == 0 && i > copy.end && tokens[i - 1] == Token(copy.destination)) {
+                copy.range_end = i - 1;
+                copy.cleared = true;
+                return true;
+            }
+            i += 2;
+        } else if (is_op(tokens, i, '[')) {
+            ++depth;
+        } else if (is_op(tokens, i, ']')) {
+            if (depth == 0) {
+                copy.range_end = i;
+                return true;
+            }
+            --depth;
+        }
+    }
+
+    copy.range_end = tokens.size();
+    return true;
+}
+
+// Copies whose destination and temp are zero when the copy starts, and whose
+// ranges are free of raw moves.
+std::vector<Copy> find_copies(const std::vector<Token>& tokens, const Analysis& analysis) {
+    std::vector<Copy> copies;
+
+    // Cells are zero until first written; raw moves may write any of them.
+    std::set<Cell> zero;
+    std::set<Cell> touched;
+    bool raw_writes = false;
+
+    auto is_zero = [&](Label label) {
+        Cell cell = cell_of(label);
+        return zero.contains(cell) || (!raw_writes && !touched.contains(cell));
+    };
+
+    auto write = [&](std::optional<Cell> cell) {
+        if (cell) {
+            touched.insert(*cell);
+            zero.erase(*cell);
+        } else {
+            raw_writes = true;
+            zero.clear();
+        }
+    };
+
+    auto forget = [&](const Cells& loop) {
+        if (loop.anywhere) {
+            write(std::nullopt);
+        }
+        for (Cell cell : loop.cells) {
+            write(cell);
+        }
+    };
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (std::holds_alternative<Label>(tokens[i])) {
+            auto copy = match_copy(tokens, i);
+            if (copy && is_zero(copy->destination) && is_zero(copy->temp) && find_range(tokens, *copy)) {
+                copies.push_back(*copy);
+            }
+            continue;
+        }
+
+        const Operation* op = std::get_if<Operation>(&tokens[i]);
+        if (!op) {
+            continue;
+        }
+
+        std::optional<Cell> cell = analysis.cell[i];
+
+        switch (*op) {
+            case '+':
+            case '-':
+            case ',':
+                write(cell);
+                break;
+
+            case '[':
+                if (is_clear(tokens, i)) {
+                    write(cell);
+                    if (cell) {
+                        zero.insert(*cell);
+                    }
+                    i += 2;
+                } else {
+                    forget(analysis.writes.at(i));
+                }
+                break;
+
+            case ']':
+                forget(analysis.writes.at(analysis.match[i]));
+                if (cell) {
+                    zero.insert(*cell);
+                }
+                break;
+        }
+    }
+
+    return copies;
+}
+
+// Whether each copy can be merged: over its range, neither label is written
+// while the other is live, and the destination is dead where the range ends.
+// Nothing is live past the end of the stream.
+std::vector<bool> check_copies(const std::vector<Token>& tokens, const Analysis& analysis, const std::vector<Copy>& copies) {
+    std::vector<bool> valid(copies.size(), true);
+
+    // Both labels of every copy, each with the copy and the other label.
+    std::multimap<Cell, std::pair<size_t, Cell>> partners;
+    std::multimap<size_t, size_t> ends;
+
+    for (size_t k = 0; k < copies.size(); ++k) {
+        Cell source = cell_of(copies[k].source);
+        Cell destination = cell_of(copies[k].destination);
+
+        partners.emplace(source, std::pair { k, destination });
+        partners.emplace(destination, std::pair { k, source });
+
+        if (!copies[k].cleared) {
+            ends.emplace(copies[k].range_end, k);
+        }
+    }
+
+    Cells live;
+    std::vector<Cells> after_loops;
+
+    auto written = [&](size_t i) {
+        if (!analysis.cell[i]) {
+            return;
+        }
+
+        auto [first, last] = partners.equal_range(*analysis.cell[i]);
+        for (auto it = first; it != last; ++it) {
+            auto [k, other] = it->second;
+            if (i >= copies[k].end && i < copies[k].range_end && live.contains(other)) {
+                valid[k] = false;
+            }
+        }
+    };
+
+    for (size_t i = tokens.size(); i-- > 0;) {
+        const Operation* op = std::get_if<Operation>(&tokens[i]);
+        if (!op) {
+            continue;
+        }
+
+        auto cell = analysis.tracked_cell(i);
+
+        if (*op == ']' && i >= 2 && is_clear(tokens, i - 2)) {
+            written(i);
+            if (cell) {
+                live.erase(*cell);
+            }
+            i -= 2;
+            continue;
+        }
+
+        switch (*op) {
+            case '+':
+            case '-':
+            case ',':
+                written(i);
+                if (cell) {
+                    live.insert(*cell);
+                }
+                break;
+
+            case '.':
+                if (cell) {
+                    live.insert(*cell);
+                }
+                break;
+
+            case ']': {
+                after_loops.push_back(live);
+                live.merge(analysis.exposed.at(analysis.match[i]));
+
+                auto [first, last] = ends.equal_range(i);
+                for (auto it = first; it != last; ++it) {
+                    if (live.contains(cell_of(copies[it->second].destination))) {
+                        valid[it->second] = false;
+                    }
+                }
+
+                // The check at `]` reads its cell after the body writes.
+                if (cell) {
+                    live.insert(*cell);
+                }
+                break;
+            }
+
+            case '[':
+                live.merge(after_loops.back());
+                after_loops.pop_back();
+                if (cell) {
+                    live.insert(*cell);
+                }
+                break;
+        }
+    }
+
+    return valid;
+}
+
+bool coalesce_round(Stream& stream) {
+    std::set<Cell> tracked;
+    for (size_t i = 0; i < stream.tokens.size(); ++i) {
+        if (auto copy = match_copy(stream.tokens, i)) {
+            tracked.insert({ cell_of(copy->source), cell_of(copy->destination), cell_of(copy->temp) });
+        }
+    }
+
+    if (tracked.empty()) {
+        return false;
+    }
+
+    auto analysis = analyze(stream.tokens, std::move(tracked));
+    if (!analysis) {
+        return false;
+    }
+
+    auto copies = find_copies(stream.tokens, *analysis);
+    auto valid = check_copies(stream.tokens, *analysis, copies);
+
+    std::vector<Token> tokens = stream.tokens;
+    std::vector<bool> removed(tokens.size(), false);
+    bool changed = false;
+
+    // Copies sharing a label with one merged already wait for the next round,
+    // which sees the renamed stream.
+    std::set<Cell> claimed;
+
+    for (size_t k = 0; k < copies.size(); ++k) {
+        const Copy& copy = copies[k];
+        std::set<Cell> labels { cell_of(copy.source), cell_of(copy.destination), cell_of(copy.temp) };
+
+        if (!valid[k] || std::ranges::any_of(labels, [&](Cell cell) { return claimed.contains(cell); })) {
+            continue;
+        }
+        claimed.insert(labels.begin(), labels.end());
+
+        for (size_t i = copy.end; i < copy.range_end; ++i) {
+            if (tokens[i] == Token(copy.destination)) {
+                tokens[i] = copy.source;
+            }
+        }
+        std::fill(removed.begin() + copy.start, removed.begin() + copy.end, true);
+
+        stream.merged.insert(copy.source.label_idx);
+        stream.merged.insert(copy.destination.label_idx);
+        changed = true;
+    }
+
+    if (!changed) {
+        return false;
+    }
+
+    bool has_origins = !stream.origins.empty();
+    std::vector<Token> result;
+    std::vector<size_t> origins;
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (removed[i]) {
+            continue;
+        }
+
+        result.push_back(tokens[i]);
+        if (has_origins) {
+            origins.push_back(stream.origins[i]);
+        }
+    }
+
+    stream.tokens = std::move(result);
+    stream.origins = std::move(origins);
+
+    return true;
+}
+
+} // namespace
+
+
+void coalesce_copies(Stream& stream) {
+    for (size_t round = 0; round < COALESCE_ROUNDS; ++round) {
+        if (!coalesce_round(stream)) {
+            break;
+        }
+    }
+}
+
+} // namespace bflabels::opt
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pipeline.h"
+
+
+namespace bflabels::opt {
+
+// Merges the destination `d` of every copy `s[d+t+s-] t[s+t-]` (with `d` and
+// `t` known to be zero) into its source `s`: the two loops go, and `d` is
+// renamed to `s` from there up to where `d` is next cleared (or its block
+// ends). A copy is only merged when, over that range, neither label is
+// written while the other is live, so the shared cell always holds whichever
+// value is still going to be read.
+void coalesce_copies(Stream& stream);
+
+// Tokens scanned past a copy looking for the end of its range, beyond which
+// the copy is kept.
+constexpr size_t COALESCE_WINDOW = 1 << 16;
+
+// Rounds of merging, each over a fresh analysis of the stream; copies of
+// copies take one round per link.
+constexpr size_t COALESCE_ROUNDS = 8;
+
+} // namespace bflabels::opt
@@ -0,0 +1,343 @@
+#include "constants.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels::opt {
+
+namespace {
+
+// (label_idx, element_idx); `Label::operator<` ignores the element.
+using Cell = std::pair<size_t, size_t>;
+
+size_t run_length(uint8_t delta) {
+    return std::min<size_t>(delta, 256 - delta);
+}
+
+void run(std::vector<Token>& tokens, uint8_t delta) {
+    if (delta < 128) {
+        tokens.insert(tokens.end(), delta, Token('+'));
+    } else {
+        tokens.insert(tokens.end(), 256 - delta, Token('-'));
+    }
+}
+
+// Emitted size of synthesized code, charging every label switch as a temp
+// switch.
+size_t estimated_size(const std::vector<Token>& tokens) {
+    size_t size = 0;
+    for (auto token : tokens) {
+        size += std::holds_alternative<Label>(token) ? TEMP_DISTANCE : 1;
+    }
+    return size;
+}
+
+// `temp +*outer [ cell (+|-)*inner temp - ] cell` followed by a run of
+// `rest`, which together add `outer * inner` (or its negation) plus `rest`.
+struct LoopPlan {
+    size_t size = SIZE_MAX;
+    uint8_t outer = 0;
+    uint8_t inner = 0;
+    bool negative = false;
+    uint8_t rest = 0;
+};
+
+// Largest factor worth trying; a bigger one always costs more than a run.
+constexpr size_t MAX_FACTOR = 128;
+
+const std::array<LoopPlan, 256>& loop_plans() {
+    static const std::array<LoopPlan, 256> plans = [] {
+        std::array<LoopPlan, 256> plans;
+
+        for (size_t outer = 2; outer <= MAX_FACTOR; ++outer) {
+            for (size_t inner = 1; inner <= MAX_FACTOR; ++inner) {
+                for (bool negative : { false, true }) {
+                    uint8_t product = outer * inner;
+                    if (negative) {
+                        product = -product;
+                    }
+
+                    for (size_t delta = 0; delta < 256; ++delta) {
+                        uint8_t rest = delta - product;
+                        size_t size = outer + inner + run_length(rest) + 3 + 4 * TEMP_DISTANCE;
+
+                        if (size < plans[delta].size) {
+                            plans[delta] = LoopPlan { size, (uint8_t)outer, (uint8_t)inner, negative, rest };
+                        }
+                    }
+                }
+            }
+        }
+
+        return plans;
+    }();
+
+    return plans;
+}
+
+// Cells a loop may write, or every cell when it writes through raw moves.
+struct Writes {
+    std::set<Cell> cells;
+    bool anywhere = false;
+};
+
+} // namespace
+
+
+std::vector<Token> synthesize_constant(Label cell, uint8_t from, uint8_t to, std::optional<Label> temp) {
+    uint8_t delta = to - from;
+    std::vector<Token> tokens;
+
+    const LoopPlan& plan = loop_plans()[delta];
+
+    if (!temp || plan.size >= run_length(delta)) {
+        run(tokens, delta);
+        return tokens;
+    }
+
+    tokens.push_back(*temp);
+    tokens.insert(tokens.end(), plan.outer, Token('+'));
+    tokens.push_back('[');
+    tokens.push_back(cell);
+    tokens.insert(tokens.end(), plan.inner, Token(plan.negative ? '-' : '+'));
+    tokens.push_back(*temp);
+    tokens.push_back('-');
+    tokens.push_back(']');
+    tokens.push_back(cell);
+    run(tokens, plan.rest);
+
+    return tokens;
+}
+
+std::vector<Token> derive_constant(Label cell, uint8_t from, uint8_t to, Label source, uint8_t value, Label temp) {
+    std::vector<Token> tokens {
+        source, '[', cell, '+', temp, '+', source, '-', ']',
+        temp, '[', source, '+', temp, '-', ']',
+        cell,
+    };
+    run(tokens, to - from - value);
+
+    return tokens;
+}
+
+Label free_label(const std::vector<Token>& tokens) {
+    size_t next = 0;
+    for (auto token : tokens) {
+        if (const Label* label = std::get_if<Label>(&token)) {
+            next = std::max(next, label->label_idx + 1);
+        }
+    }
+    return Label { next, 0 };
+}
+
+void synthesize_constants(Stream& stream) {
+    const auto& tokens = stream.tokens;
+    bool has_origins = !stream.origins.empty();
+
+    // Cells written by every loop, keyed by both of its brackets.
+    std::map<size_t, Writes> writes;
+    std::set<Cell> all_cells;
+    {
+        std::optional<Cell> cell;
+        std::vector<std::pair<size_t, Writes>> open_loops;
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (const Label* label = std::get_if<Label>(&tokens[i])) {
+                cell = Cell { label->label_idx, label->element_idx };
+                all_cells.insert(*cell);
+                continue;
+            }
+
+            const Operation* op = std::get_if<Operation>(&tokens[i]);
+            if (!op) {
+                continue;
+            }
+
+            switch (*op) {
+                case '<':
+                case '>':
+                    cell = std::nullopt;
+                    break;
+
+                case '+':
+                case '-':
+                case ',':
+                    if (open_loops.empty()) {
+                        break;
+                    }
+
+                    if (cell) {
+                        open_loops.back().second.cells.insert(*cell);
+                    } else {
+                        open_loops.back().second.anywhere = true;
+                    }
+                    break;
+
+                case '[':
+                    open_loops.emplace_back(i, Writes {});
+                    break;
+
+                case ']': {
+                    if (open_loops.empty()) {
+                        break;
+                    }
+
+                    auto [open, loop] = std::move(open_loops.back());
+                    open_loops.pop_back();
+
+                    if (!open_loops.empty()) {
+                        auto& parent = open_loops.back().second;
+                        parent.cells.insert(loop.cells.begin(), loop.cells.end());
+                        parent.anywhere |= loop.anywhere;
+                    }
+
+                    writes[open] = loop;
+                    writes[i] = std::move(loop);
+                    break;
+                }
+            }
+        }
+    }
+
+    std::optional<Label> temp;
+
+    // Values known at the current point; every cell starts at zero.
+    std::map<Cell, uint8_t> known;
+    for (Cell cell : all_cells) {
+        known[cell] = 0;
+    }
+
+    std::optional<Cell> cell;
+    std::vector<Token> result;
+    std::vector<size_t> origins;
+
+    auto forget = [&](const Writes& loop) {
+        if (loop.anywhere) {
+            known.clear();
+        }
+        for (Cell written : loop.cells) {
+            known.erase(written);
+        }
+    };
+
+    for (size_t i = 0; i < tokens.size();) {
+        const Operation* op = std::get_if<Operation>(&tokens[i]);
+
+        if (cell && op && (*op == '+' || *op == '-')) {
+            uint8_t delta = 0;
+            size_t end = i;
+            for (; end < tokens.size() && (tokens[end] == Token('+') || tokens[end] == Token('-')); ++end) {
+                delta += tokens[end] == Token('+') ? 1 : -1;
+            }
+
+            auto value = known.find(*cell);
+            Label label { cell->first, cell->second };
+
+            std::vector<Token> replacement;
+            if (value != known.end()) {
+                if (!temp) {
+                    temp = free_label(tokens);
+                }
+
+                uint8_t from = value->second;
+                uint8_t to = from + delta;
+                replacement = synthesize_constant(label, from, to, temp);
+
+                // The known cell leaving the shortest correction to derive
+                // the value from.
+                std::optional<std::pair<Cell, uint8_t>> source;
+                for (auto [other, other_value] : known) {
+                    bool closer = !source || run_length(to - from - other_value) < run_length(to - from - source->second);
+                    if (other != *cell && other_value != 0 && closer) {
+                        source = { other, other_value };
+                    }
+                }
+
+                if (source) {
+                    auto derived = derive_constant(
+                        label, from, to, Label { source->first.first, source->first.second }, source->second, *temp
+                    );
+                    if (estimated_size(derived) < estimated_size(replacement)) {
+                        replacement = std::move(derived);
+                    }
+                }
+
+                value->second = to;
+            } else {
+                replacement = synthesize_constant(label, 0, delta, std::nullopt);
+            }
+
+            if (estimated_size(replacement) < end - i) {
+                result.insert(result.end(), replacement.begin(), replacement.end());
+                if (has_origins) {
+                    origins.insert(origins.end(), replacement.size(), stream.origins[i]);
+                }
+            } else {
+                result.insert(result.end(), tokens.begin() + i, tokens.begin() + end);
+                if (has_origins) {
+                    origins.insert(origins.end(), stream.origins.begin() + i, stream.origins.begin() + end);
+                }
+            }
+
+            i = end;
+            continue;
+        }
+
+        if (const Label* label = std::get_if<Label>(&tokens[i])) {
+            cell = Cell { label->label_idx, label->element_idx };
+        } else if (op) {
+            switch (*op) {
+                case '<':
+                case '>':
+                    cell = std::nullopt;
+                    break;
+
+                case '+':
+                case '-':
+                    // Writes through raw moves.
+                    known.clear();
+                    break;
+
+                case ',':
+                    if (cell) {
+                        known.erase(*cell);
+                    } else {
+                        known.clear();
+                    }
+                    break;
+
+                case '[':
+                case ']':
+                    if (auto loop = writes.find(i); loop != writes.end()) {
+                        forget(loop->second);
+                    } else {
+                        known.clear();
+                    }
+
+                    if (*op == ']' && cell) {
+                        known[*cell] = 0;
+                    }
+                    break;
+            }
+        }
+
+        result.push_back(tokens[i]);
+        if (has_origins) {
+            origins.push_back(stream.origins[i]);
+        }
+        ++i;
+    }
+
+    stream.tokens = std::move(result);
+    stream.origins = std::move(origins);
+}
+
+} // namespace bflabels::opt
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "pipeline.h"
+
+
+namespace bflabels::opt {
+
+// Pointer moves assumed for every switch between a cell and its temp, whose
+// distance is unknown until layout.
+constexpr size_t TEMP_DISTANCE = 4;
+
+// Shortest code found for taking the current cell `cell` from `from` to `to`:
+// a `+` or `-` run, whichever way is shorter with 8-bit wraparound, or a
+// multiplication loop through `temp` (which must be zero, and is left zero)
+// plus a short run to correct the remainder. Leaves `cell` current.
+std::vector<Token> synthesize_constant(Label cell, uint8_t from, uint8_t to, std::optional<Label> temp);
+
+// Code taking the current cell `cell` from `from` to `to` by adding the
+// value `value` of another cell `source` to it, copied through `temp` (which
+// must be zero, and is left zero), plus a short run to correct the
+// remainder. Leaves `source` as it was and `cell` current.
+std::vector<Token> derive_constant(Label cell, uint8_t from, uint8_t to, Label source, uint8_t value, Label temp);
+
+// A label not used anywhere in `tokens`, to be given a cell of its own.
+Label free_label(const std::vector<Token>& tokens);
+
+// Rewrites every `+`/`-` run as its shortest equivalent. Where the value the
+// cell had before the run is known (cells start at zero and loops leave
+// their counter at zero), the run is resynthesized from that value, or
+// derived from another cell of known value when that is shorter, through a
+// single temp shared by the whole stream.
+void synthesize_constants(Stream& stream);
+
+} // namespace bflabels::opt
@@ -0,0 +1,342 @@
+#include "cost.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <variant>
+
+
+namespace bflabels::opt {
+
+void CostPolynomial::add(const std::vector<size_t>& monomial, uint64_t coefficient) {
+    if (coefficient) {
+        terms[monomial] += coefficient;
+    }
+}
+
+std::optional<uint64_t> CostPolynomial::worst_case(const std::vector<TripSymbol>& symbols) const {
+    uint64_t total = 0;
+
+    for (const auto& [monomial, coefficient] : terms) {
+        uint64_t value = coefficient;
+
+        for (size_t symbol : monomial) {
+            if (!symbols[symbol].bound) {
+                return std::nullopt;
+            }
+            value *= *symbols[symbol].bound;
+        }
+
+        total += value;
+    }
+
+    return total;
+}
+
+void CostPolynomial::write(std::ostream& os, const std::vector<TripSymbol>& symbols) const {
+    std::vector<std::pair<std::vector<size_t>, uint64_t>> sorted(terms.begin(), terms.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.first.size() < b.first.size();
+    });
+
+    if (sorted.empty()) {
+        os << '0';
+    }
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const auto& [monomial, coefficient] = sorted[i];
+
+        if (i) {
+            os << " + ";
+        }
+
+        if (coefficient != 1 || monomial.empty()) {
+            os << coefficient;
+            if (!monomial.empty()) {
+                os << '*';
+            }
+        }
+
+        for (size_t j = 0; j < monomial.size(); ++j) {
+            os << (j ? "*" : "") << symbols[monomial[j]].name;
+        }
+    }
+}
+
+
+namespace {
+
+enum class Trips {
+    Symbolic,
+    AtMostOnce,
+};
+
+// Net effect of one loop iteration on the condition cell.
+struct CellState {
+    enum { Delta, Constant, Unknown } kind = Delta;
+    uint8_t value = 0;
+};
+
+class Estimator {
+private:
+    const std::vector<Token>& tokens;
+    const std::vector<std::string_view>& token_macros;
+
+    // Cell the pointer is at when each token executes, and the label that
+    // put it there.
+    std::vector<int64_t> cells;
+    std::vector<std::optional<Label>> cell_labels;
+    std::vector<size_t> token_moves;
+    std::vector<size_t> matches;
+
+    CostReport report;
+    std::map<std::string, size_t> symbol_ids;
+
+    size_t symbol(std::string name, std::optional<uint64_t> bound) {
+        auto [it, inserted] = symbol_ids.try_emplace(name, report.symbols.size());
+        if (inserted) {
+            report.symbols.push_back(TripSymbol { std::move(name), bound });
+        }
+        return it->second;
+    }
+
+    bool modifies(int64_t cell, size_t begin, size_t end) const {
+        for (size_t i = begin; i < end; ++i) {
+            const Operation* op = std::get_if<Operation>(&tokens[i]);
+
+            if (op && (*op == '<' || *op == '>')) {
+                return true;
+            }
+
+            if (op && cells[i] == cell && (*op == '+' || *op == '-' || *op == ',')) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Trip count of the loop opened at `open`: a symbol id, "at most once",
+    // or an unbounded symbol.
+    std::pair<Trips, size_t> classify(size_t open) {
+        size_t close = matches[open];
+        int64_t cell = cells[open];
+
+        std::string name = "var?";
+        if (cell_labels[open]) {
+            std::stringstream ss;
+            ss << Token(*cell_labels[open]);
+            name = ss.str();
+        }
+
+        CellState state;
+
+        if (cells[close] != cell) {
+            state.kind = CellState::Unknown;
+        }
+
+        for (size_t i = open + 1; i < close && state.kind != CellState::Unknown; ++i) {
+            const Operation* op = std::get_if<Operation>(&tokens[i]);
+
+            if (!op) {
+                continue;
+            }
+
+            if (*op == '[') {
+                size_t nested_close = matches[i];
+
+                if (cells[i] == cell && cells[nested_close] == cell) {
+                    state = CellState { CellState::Constant, 0 };
+                } else if (modifies(cell, i, nested_close)) {
+                    state.kind = CellState::Unknown;
+                }
+
+                i = nested_close;
+                continue;
+            }
+
+            if (*op == '<' || *op == '>') {
+                state.kind = CellState::Unknown;
+            } else if (cells[i] == cell) {
+                if (*op == '+') {
+                    ++state.value;
+                } else if (*op == '-') {
+                    --state.value;
+                } else if (*op == ',') {
+                    state.kind = CellState::Unknown;
+                }
+            }
+        }
+
+        switch (state.kind) {
+            case CellState::Constant:
+                if (state.value == 0) {
+                    return {Trips::AtMostOnce, 0};
+                }
+                break;
+
+            case CellState::Delta:
+                if (state.value == 255) {
+                    return {Trips::Symbolic, symbol(name, 255)};
+                }
+                if (state.value == 1) {
+                    return {Trips::Symbolic, symbol("(256-" + name + ")", 255)};
+                }
+                if (state.value % 2 == 1) {
+                    return {Trips::Symbolic, symbol("trips(" + name + ")", 255)};
+                }
+                break;
+
+            case CellState::Unknown:
+                break;
+        }
+
+        return {Trips::Symbolic, symbol('?' + name, std::nullopt)};
+    }
+
+    void charge(size_t token, const std::vector<size_t>& monomial, size_t size, size_t moves) {
+        auto charge_entry = [&](CostEntry& entry) {
+            entry.size += size;
+            entry.moves += moves;
+            entry.ops.add(monomial, size);
+
+            if (entry.min_cell > entry.max_cell) {
+                entry.min_cell = entry.max_cell = cells[token];
+            } else {
+                entry.min_cell = std::min(entry.min_cell, cells[token]);
+                entry.max_cell = std::max(entry.max_cell, cells[token]);
+            }
+        };
+
+        charge_entry(report.program);
+
+        if (!token_macros.empty()) {
+            charge_entry(report.macros[token_macros[token]]);
+        }
+    }
+
+public:
+    Estimator(const std::vector<Token>& tokens, const std::vector<std::string_view>& token_macros) :
+        tokens(tokens),
+        token_macros(token_macros) {}
+
+    CostReport run(const BFLCode& code) {
+        int64_t pos = 0;
+        std::optional<Label> label;
+        std::vector<size_t> open_loops;
+
+        matches.assign(tokens.size(), tokens.size());
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            size_t moves = 0;
+
+            if (const Label* l = std::get_if<Label>(&tokens[i])) {
+                int64_t offset = code.offset(*l);
+                moves = std::abs(offset - pos);
+                pos = offset;
+                label = *l;
+            } else if (const Operation* op = std::get_if<Operation>(&tokens[i])) {
+                if (*op == '<' || *op == '>') {
+                    pos += *op == '>' ? 1 : -1;
+                    label = std::nullopt;
+                } else if (*op == '[') {
+                    open_loops.push_back(i);
+                } else if (*op == ']' && !open_loops.empty()) {
+                    matches[open_loops.back()] = i;
+                    matches[i] = open_loops.back();
+                    open_loops.pop_back();
+                }
+            }
+
+            cells.push_back(pos);
+            cell_labels.push_back(label);
+            token_moves.push_back(moves);
+        }
+
+        std::vector<std::vector<size_t>> multiplicity = {{}};
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (std::holds_alternative<Label>(tokens[i])) {
+                if (token_moves[i]) {
+                    charge(i, multiplicity.back(), token_moves[i], token_moves[i]);
+                }
+                continue;
+            }
+
+            const Operation* op = std::get_if<Operation>(&tokens[i]);
+
+            if (!op) {
+                continue;
+            }
+
+            bool raw_move = *op == '<' || *op == '>';
+            charge(i, multiplicity.back(), 1, raw_move);
+
+            if (*op == '[' && matches[i] != tokens.size()) {
+                auto [trips, symbol] = classify(i);
+                std::vector<size_t> body = multiplicity.back();
+
+                if (trips == Trips::Symbolic) {
+                    body.insert(std::upper_bound(body.begin(), body.end(), symbol), symbol);
+                }
+
+                multiplicity.push_back(std::move(body));
+            } else if (*op == ']' && multiplicity.size() > 1) {
+                multiplicity.pop_back();
+            }
+        }
+
+        return std::move(report);
+    }
+};
+
+void write_entry(std::ostream& os, const CostEntry& entry, const std::vector<TripSymbol>& symbols) {
+    char share[32];
+    std::snprintf(share, sizeof(share), "%.1f%%", entry.size ? 100.0 * entry.moves / entry.size : 0.0);
+
+    os << " size=" << entry.size << " moves=" << entry.moves << " (" << share << ")";
+
+    if (entry.min_cell <= entry.max_cell) {
+        os << " cells=" << entry.min_cell << ".." << entry.max_cell
+           << " extent=" << entry.max_cell - entry.min_cell + 1;
+    } else {
+        os << " cells=- extent=0";
+    }
+
+    os << " ops<=";
+    entry.ops.write(os, symbols);
+
+    os << " worst=";
+    if (auto worst = entry.ops.worst_case(symbols)) {
+        os << *worst;
+    } else {
+        os << "unbounded";
+    }
+
+    os << '\n';
+}
+
+} // namespace
+
+
+void CostReport::write(std::ostream& os) const {
+    os << "program";
+    write_entry(os, program, symbols);
+
+    for (const auto& [macro, entry] : macros) {
+        os << "macro " << macro;
+        write_entry(os, entry, symbols);
+    }
+}
+
+CostReport estimate_cost(
+    const std::vector<Token>& tokens,
+    const BFLCode& code,
+    const std::vector<std::string_view>& token_macros
+) {
+    return Estimator(tokens, token_macros).run(code);
+}
+
+} // namespace bflabels::opt
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../labels/bflabels.h"
+
+
+namespace bflabels::opt {
+
+// Trip count of a loop, named after its condition cell. `bound` is the largest
+// count possible with 8-bit cells, or nullopt when the loop may not terminate.
+struct TripSymbol {
+    std::string name;
+    std::optional<uint64_t> bound;
+};
+
+// Sum of coefficient * product of trip symbols. Every executed op is charged
+// to the monomial of its enclosing loops, so this is an upper bound on ops.
+class CostPolynomial {
+public:
+    // Sorted symbol ids -> coefficient.
+    std::map<std::vector<size_t>, uint64_t> terms;
+
+    void add(const std::vector<size_t>& monomial, uint64_t coefficient);
+
+    // Value with every symbol at its bound; nullopt if any symbol is unbounded.
+    std::optional<uint64_t> worst_case(const std::vector<TripSymbol>& symbols) const;
+
+    void write(std::ostream& os, const std::vector<TripSymbol>& symbols) const;
+};
+
+struct CostEntry {
+    // Emitted brainfuck characters, and how many of them are `<`/`>`.
+    size_t size = 0;
+    size_t moves = 0;
+
+    // Tape cells touched, inclusive.
+    int64_t min_cell = 0;
+    int64_t max_cell = -1;
+
+    CostPolynomial ops;
+};
+
+struct CostReport {
+    std::vector<TripSymbol> symbols;
+    CostEntry program;
+    std::map<std::string_view, CostEntry> macros;
+
+    // One `program ...` line and one `macro <name> ...` line per macro.
+    void write(std::ostream& os) const;
+};
+
+// Estimates the cost of `tokens` as laid out by `code` without running them.
+// Loops are classified by the net effect of their body on the condition cell:
+// a -1 step runs "value" times (transfer loops like `x[temp1+x-]`), any odd
+// step at most 255 times, a body that leaves the cell zero at most once; all
+// other loops are reported as unbounded. `token_macros`, if not empty, names
+// the macro every token was expanded from.
+CostReport estimate_cost(
+    const std::vector<Token>& tokens,
+    const BFLCode& code,
+    const std::vector<std::string_view>& token_macros = {}
+);
+
+} // namespace bflabels::opt
@@ -0,0 +1,444 @@
+#include "invariants.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels::opt {
+
+namespace {
+
+// (label_idx, element_idx); `Label::operator<` ignores the element.
+using Cell = std::pair<size_t, size_t>;
+
+Cell cell_of(Label label) {
+    return Cell { label.label_idx, label.element_idx };
+}
+
+bool is_op(const std::vector<Token>& tokens, size_t i, Operation op) {
+    return i < tokens.size() && tokens[i] == Token(op);
+}
+
+// `[-]`, which clears the current cell.
+bool is_clear(const std::vector<Token>& tokens, size_t i) {
+    return is_op(tokens, i, '[') && is_op(tokens, i + 1, '-') && is_op(tokens, i + 2, ']');
+}
+
+// Cells a loop may write, or every cell when it makes raw moves.
+struct Writes {
+    std::set<Cell> cells;
+    bool anywhere = false;
+
+    bool contains(Cell cell) const {
+        return anywhere || cells.contains(cell);
+    }
+};
+
+struct Structure {
+    // Current cell at every token, unknown after raw moves.
+    std::vector<std::optional<Cell>> cell;
+    // Matching bracket of every bracket.
+    std::vector<size_t> match;
+    // Cells written by every loop, keyed by its `[`.
+    std::map<size_t, Writes> writes;
+};
+
+std::optional<Structure> analyze(const std::vector<Token>& tokens) {
+    Structure structure;
+    structure.cell.resize(tokens.size());
+    structure.match.resize(tokens.size());
+
+    std::optional<Cell> cell;
+    std::vector<std::pair<size_t, Writes>> open_loops;
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (const Label* label = std::get_if<Label>(&tokens[i])) {
+            cell = cell_of(*label);
+        } else if (is_op(tokens, i, '<') || is_op(tokens, i, '>')) {
+            cell = std::nullopt;
+            if (!open_loops.empty()) {
+                open_loops.back().second.anywhere = true;
+            }
+        } else if ((is_op(tokens, i, '+') || is_op(tokens, i, '-') || is_op(tokens, i, ',')) && !open_loops.empty()) {
+            if (cell) {
+                open_loops.back().second.cells.insert(*cell);
+            } else {
+                open_loops.back().second.anywhere = true;
+            }
+        } else if (is_op(tokens, i, '[')) {
+            open_loops.emplace_back(i, Writes {});
+        } else if (is_op(tokens, i, ']')) {
+            if (open_loops.empty()) {
+                return std::nullopt;
+            }
+
+            auto [open, loop] = std::move(open_loops.back());
+            open_loops.pop_back();
+
+            if (!open_loops.empty()) {
+                auto& parent = open_loops.back().second;
+                parent.cells.insert(loop.cells.begin(), loop.cells.end());
+                parent.anywhere |= loop.anywhere;
+            }
+
+            structure.match[open] = i;
+            structure.match[i] = open;
+            structure.writes[open] = std::move(loop);
+        }
+
+        structure.cell[i] = cell;
+    }
+
+    if (!open_loops.empty()) {
+        return std::nullopt;
+    }
+
+    return structure;
+}
+
+// `cell [-]` and a `+`/`-` run, setting `cell` to `value`.
+struct SetUp {
+    // The `[` of the loop it is in.
+    size_t loop;
+
+    size_t start;
+    size_t end;
+
+    Label cell;
+    uint8_t value;
+};
+
+std::optional<SetUp> match_set_up(const std::vector<Token>& tokens, size_t i) {
+    const Label* label = std::get_if<Label>(&tokens[i]);
+    if (!label || !is_clear(tokens, i + 1)) {
+        return std::nullopt;
+    }
+
+    uint8_t value = 0;
+    size_t end = i + 4;
+    for (; is_op(tokens, end, '+') || is_op(tokens, end, '-'); ++end) {
+        value += is_op(tokens, end, '+') ? 1 : -1;
+    }
+
+    return SetUp { 0, i, end, *label, value };
+}
+
+bool is_access(const std::vector<Token>& tokens, size_t i) {
+    return std::holds_alternative<Operation>(tokens[i]) && !is_op(tokens, i, '<') && !is_op(tokens, i, '>');
+}
+
+// Whether any op in [begin, end) uses `cell`.
+bool touches(const std::vector<Token>& tokens, const Structure& structure, size_t begin, size_t end, Cell cell) {
+    for (size_t i = begin; i < end; ++i) {
+        if (is_access(tokens, i) && structure.cell[i] == cell) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Value `cell` has at `end` if it has `value` at `begin`, both at the same
+// depth, or nullopt when unknown.
+std::optional<uint8_t> value_at(
+    const std::vector<Token>& tokens,
+    const Structure& structure,
+    size_t begin,
+    size_t end,
+    Cell cell,
+    uint8_t value
+) {
+    std::optional<uint8_t> known = value;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (!is_access(tokens, i)) {
+            continue;
+        }
+
+        bool on_cell = structure.cell[i] == cell;
+
+        if (is_op(tokens, i, '[')) {
+            size_t close = structure.match[i];
+
+            if (structure.cell[close] == cell) {
+                known = 0;
+            } else if (structure.writes.at(i).contains(cell)) {
+                known = std::nullopt;
+            }
+
+            i = close;
+        } else if (on_cell && known && (is_op(tokens, i, '+') || is_op(tokens, i, '-'))) {
+            *known += is_op(tokens, i, '+') ? 1 : -1;
+        } else if (on_cell && is_op(tokens, i, ',')) {
+            known = std::nullopt;
+        }
+    }
+
+    return known;
+}
+
+// Whether `cell` is cleared after the loop closing at `close` before anything
+// else uses it, in the same block.
+bool cleared_after(const std::vector<Token>& tokens, const Structure& structure, size_t close, Cell cell) {
+    size_t depth = 0;
+
+    for (size_t i = close + 1; i < tokens.size(); ++i) {
+        if (!is_access(tokens, i)) {
+            continue;
+        }
+
+        if (structure.cell[i] == cell) {
+            return depth == 0 && is_clear(tokens, i);
+        }
+
+        if (is_clear(tokens, i)) {
+            i += 2;
+        } else if (is_op(tokens, i, '[')) {
+            ++depth;
+        } else if (is_op(tokens, i, ']')) {
+            if (depth == 0) {
+                return false;
+            }
+            --depth;
+        }
+    }
+
+    return false;
+}
+
+// Invariant set-ups directly in loop bodies, for loops free of raw moves.
+std::vector<SetUp> find_set_ups(const std::vector<Token>& tokens, const Structure& structure) {
+    std::vector<SetUp> set_ups;
+
+    for (size_t open = 0; open < tokens.size(); ++open) {
+        if (!is_op(tokens, open, '[') || is_clear(tokens, open) || !structure.cell[open]) {
+            continue;
+        }
+
+        size_t close = structure.match[open];
+        if (structure.writes.at(open).anywhere) {
+            continue;
+        }
+
+        for (size_t i = open + 1; i < close; ++i) {
+            if (is_op(tokens, i, '[')) {
+                i = structure.match[i];
+                continue;
+            }
+
+            auto set_up = match_set_up(tokens, i);
+            if (!set_up) {
+                continue;
+            }
+
+            Cell cell = cell_of(set_up->cell);
+            if (cell != structure.cell[open] && cell != structure.cell[close]
+                && !touches(tokens, structure, open + 1, i, cell)
+                && value_at(tokens, structure, set_up->end, close, cell, set_up->value) == set_up->value) {
+                set_up->loop = open;
+                set_ups.push_back(*set_up);
+            }
+
+            i = set_up->end - 1;
+        }
+    }
+
+    return set_ups;
+}
+
+// Value of every cell in `cells` on entry to every loop in `loops`, where
+// known. Cells start at zero, and loops leave the cell of their `]` at zero.
+std::map<std::pair<size_t, Cell>, uint8_t> entry_values(
+    const std::vector<Token>& tokens,
+    const Structure& structure,
+    const std::vector<SetUp>& set_ups
+) {
+    std::map<size_t, std::vector<Cell>> queries;
+    std::set<Cell> cells;
+    for (const auto& set_up : set_ups) {
+        queries[set_up.loop].push_back(cell_of(set_up.cell));
+        cells.insert(cell_of(set_up.cell));
+    }
+
+    std::map<Cell, uint8_t> known;
+    for (Cell cell : cells) {
+        known[cell] = 0;
+    }
+
+    std::map<std::pair<size_t, Cell>, uint8_t> values;
+
+    auto forget = [&](size_t open) {
+        const Writes& writes = structure.writes.at(open);
+        for (auto it = known.begin(); it != known.end();) {
+            if (writes.contains(it->first)) {
+                it = known.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (!is_access(tokens, i)) {
+            if (is_op(tokens, i, '<') || is_op(tokens, i, '>')) {
+                known.clear();
+            }
+            continue;
+        }
+
+        auto cell = structure.cell[i];
+        auto value = cell ? known.find(*cell) : known.end();
+
+        switch (std::get<Operation>(tokens[i])) {
+            case '+':
+            case '-':
+                if (!cell) {
+                    known.clear();
+                } else if (value != known.end()) {
+                    value->second += is_op(tokens, i, '+') ? 1 : -1;
+                }
+                break;
+
+            case ',':
+                if (!cell) {
+                    known.clear();
+                } else if (value != known.end()) {
+                    known.erase(value);
+                }
+                break;
+
+            case '[':
+                if (is_clear(tokens, i)) {
+                    if (cell && cells.contains(*cell)) {
+                        known[*cell] = 0;
+                    }
+                    i += 2;
+                    break;
+                }
+
+                if (auto query = queries.find(i); query != queries.end()) {
+                    for (Cell queried : query->second) {
+                        if (auto entry = known.find(queried); entry != known.end()) {
+                            values[{ i, queried }] = entry->second;
+                        }
+                    }
+                }
+
+                forget(i);
+                break;
+
+            case ']':
+                forget(structure.match[i]);
+                if (cell && cells.contains(*cell)) {
+                    known[*cell] = 0;
+                }
+                break;
+        }
+    }
+
+    return values;
+}
+
+bool hoist_round(Stream& stream) {
+    const auto& tokens = stream.tokens;
+    bool has_origins = !stream.origins.empty();
+
+    auto structure = analyze(tokens);
+    if (!structure) {
+        return false;
+    }
+
+    auto set_ups = find_set_ups(tokens, *structure);
+    if (set_ups.empty()) {
+        return false;
+    }
+
+    auto values = entry_values(tokens, *structure, set_ups);
+
+    // Tokens removed, and tokens to insert in front of a given token.
+    std::vector<bool> removed(tokens.size(), false);
+    std::map<size_t, std::vector<size_t>> hoisted;
+
+    // One set-up per cell a round, so no two moves interfere.
+    std::set<Cell> claimed;
+
+    for (const auto& set_up : set_ups) {
+        Cell cell = cell_of(set_up.cell);
+        if (claimed.contains(cell)) {
+            continue;
+        }
+
+        auto entry = values.find({ set_up.loop, cell });
+        bool redundant = entry != values.end() && entry->second == set_up.value;
+
+        if (!redundant && !cleared_after(tokens, *structure, structure->match[set_up.loop], cell)) {
+            continue;
+        }
+
+        claimed.insert(cell);
+
+        // The label stays for ops after the set-up that use the current cell.
+        size_t start = std::holds_alternative<Label>(tokens[set_up.end]) ? set_up.start : set_up.start + 1;
+        for (size_t i = start; i < set_up.end; ++i) {
+            removed[i] = true;
+        }
+
+        if (!redundant) {
+            auto& moved = hoisted[set_up.loop];
+            for (size_t i = set_up.start; i < set_up.end; ++i) {
+                moved.push_back(i);
+            }
+        }
+    }
+
+    if (claimed.empty()) {
+        return false;
+    }
+
+    std::vector<Token> result;
+    std::vector<size_t> origins;
+
+    auto emit = [&](Token token, size_t from) {
+        result.push_back(token);
+        if (has_origins) {
+            origins.push_back(stream.origins[from]);
+        }
+    };
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (auto moved = hoisted.find(i); moved != hoisted.end()) {
+            for (size_t from : moved->second) {
+                emit(tokens[from], from);
+            }
+
+            auto [label_idx, element_idx] = *structure->cell[i];
+            emit(Label { label_idx, element_idx }, i);
+        }
+
+        if (!removed[i]) {
+            emit(tokens[i], i);
+        }
+    }
+
+    stream.tokens = std::move(result);
+    stream.origins = std::move(origins);
+
+    return true;
+}
+
+} // namespace
+
+
+void hoist_invariants(Stream& stream) {
+    for (size_t round = 0; round < INVARIANT_ROUNDS; ++round) {
+        if (!hoist_round(stream)) {
+            break;
+        }
+    }
+}
+
+} // namespace bflabels::opt
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pipeline.h"
+
+
+namespace bflabels::opt {
+
+// Moves loop-invariant set-ups out of loops. A set-up is `t[-]` and a `+`/`-`
+// run on `t` directly in a loop body, which gives `t` the same value `k` on
+// every iteration when nothing in the body touches `t` before it, neither
+// loop check reads `t`, and `t` is back to `k` at the end of the body.
+// Such a set-up is dropped when `t` is known to be `k` on entry to the loop
+// (cells start at zero and loops leave their counter at zero), and otherwise
+// hoisted in front of the loop when `t` is cleared after it before being
+// read, so a loop that never runs may set `t` too.
+void hoist_invariants(Stream& stream);
+
+// Rounds of hoisting; every round moves a set-up out of one more level of
+// nested loops.
+constexpr size_t INVARIANT_ROUNDS = 4;
+
+} // namespace bflabels::opt
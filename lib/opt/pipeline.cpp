@@ -0,0 +1,27 @@
+#include "pipeline.h"
+
+#include "coalesce.h"
+#include "constants.h"
+#include "invariants.h"
+#include "prefix.h"
+#include "schedule.h"
+
+
+namespace bflabels::opt {
+
+void optimize(Stream& stream, unsigned level, const MemoryLayout& reserved) {
+    if (level == 0 || stream.tokens.empty()) {
+        return;
+    }
+
+    if (level >= 2) {
+        evaluate_prefix(stream);
+    }
+
+    coalesce_copies(stream);
+    hoist_invariants(stream);
+    schedule_operations(stream, reserved);
+    synthesize_constants(stream);
+}
+
+} // namespace bflabels::opt
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <set>
+#include <vector>
+
+#include "../labels/bflabels.h"
+
+
+namespace bflabels::opt {
+
+// Compiled label stream together with the provenance of every token, as
+// produced by `bfasm::compiler::Compiler` (`result` and `result_origins`).
+// `origins` is either empty or parallel to `tokens`; passes keep it that way,
+// giving tokens they synthesize the origin of the code they replace.
+struct Stream {
+    std::vector<Token> tokens;
+    std::vector<size_t> origins;
+
+    // Labels merged with another label's cell past their last read, whose own
+    // cells need not end up holding their final values.
+    std::set<size_t> merged;
+};
+
+// Runs the passes enabled at optimization `level` (0 runs none). `reserved`
+// is the layout the stream will be given, as `Compiler::layout`.
+void optimize(Stream& stream, unsigned level, const MemoryLayout& reserved = {});
+
+} // namespace bflabels::opt
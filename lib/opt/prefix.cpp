@@ -0,0 +1,182 @@
+#include "prefix.h"
+
+#include "constants.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels::opt {
+
+namespace {
+
+// (label_idx, element_idx); `Label::operator<` ignores the element.
+using Cell = std::pair<size_t, size_t>;
+
+struct Snapshot {
+    size_t position = 0;
+    std::map<Cell, uint8_t> cells;
+    std::optional<Cell> cell;
+    std::string output;
+};
+
+Label label(Cell cell) {
+    return Label { cell.first, cell.second };
+}
+
+} // namespace
+
+
+void evaluate_prefix(Stream& stream) {
+    const auto& tokens = stream.tokens;
+
+    std::vector<size_t> matches(tokens.size(), tokens.size());
+    std::vector<size_t> open_loops;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (tokens[i] == Token('[')) {
+            open_loops.push_back(i);
+        } else if (tokens[i] == Token(']') && !open_loops.empty()) {
+            matches[open_loops.back()] = i;
+            matches[i] = open_loops.back();
+            open_loops.pop_back();
+        }
+    }
+
+    // `state` is the machine; `cut` is its copy on entry to the outermost
+    // loop being run, where the prefix ends if it stops inside that loop.
+    Snapshot state, cut;
+    size_t depth = 0;
+    size_t steps = 0;
+
+    for (size_t& i = state.position; i < tokens.size(); ++i) {
+        if (const Label* token = std::get_if<Label>(&tokens[i])) {
+            state.cell = Cell { token->label_idx, token->element_idx };
+            state.cells.try_emplace(*state.cell, 0);
+            continue;
+        }
+
+        const Operation* op = std::get_if<Operation>(&tokens[i]);
+        if (!op) {
+            continue;
+        }
+
+        bool unmatched = (*op == '[' || *op == ']') && matches[i] == tokens.size();
+
+        if (!state.cell || *op == ',' || *op == '<' || *op == '>' || unmatched || ++steps > PREFIX_BUDGET) {
+            break;
+        }
+
+        uint8_t& value = state.cells[*state.cell];
+
+        switch (*op) {
+            case '+':
+                ++value;
+                break;
+
+            case '-':
+                --value;
+                break;
+
+            case '.':
+                state.output += value;
+                break;
+
+            case '[':
+                if (value) {
+                    if (depth++ == 0) {
+                        cut = state;
+                    }
+                } else {
+                    i = matches[i];
+                }
+                break;
+
+            case ']':
+                if (value) {
+                    i = matches[i];
+                } else {
+                    --depth;
+                }
+                break;
+        }
+    }
+
+    if (depth == 0) {
+        cut = std::move(state);
+    }
+
+    if (cut.position == 0) {
+        return;
+    }
+
+    std::vector<Token> result;
+    Label temp = free_label(tokens);
+
+    auto set = [&](Cell cell, uint8_t from, uint8_t to) {
+        auto code = synthesize_constant(label(cell), from, to, temp);
+        result.insert(result.end(), code.begin(), code.end());
+    };
+
+    // Literal output goes through the cell whose final value is closest to
+    // the last byte printed; it is then set along with the others.
+    auto distance = [](uint8_t from, uint8_t to) {
+        uint8_t delta = to - from;
+        return delta <= 128 ? delta : 256 - delta;
+    };
+
+    auto scratch = cut.cells.begin();
+    uint8_t printed = 0;
+    if (!cut.output.empty()) {
+        uint8_t last = cut.output.back();
+        for (auto it = cut.cells.begin(); it != cut.cells.end(); ++it) {
+            if (distance(last, it->second) < distance(last, scratch->second)) {
+                scratch = it;
+            }
+        }
+
+        result.push_back(label(scratch->first));
+        for (uint8_t byte : cut.output) {
+            set(scratch->first, printed, byte);
+            result.push_back('.');
+            printed = byte;
+        }
+    }
+
+    for (auto it = cut.cells.begin(); it != cut.cells.end(); ++it) {
+        uint8_t from = it == scratch ? printed : 0;
+        if (it->second != from) {
+            result.push_back(label(it->first));
+            set(it->first, from, it->second);
+        }
+    }
+
+    // Operations right after the cut apply to the cell current there.
+    std::optional<Label> current;
+    for (auto it = result.rbegin(); it != result.rend() && !current; ++it) {
+        if (const Label* token = std::get_if<Label>(&*it)) {
+            current = *token;
+        }
+    }
+
+    if (cut.cell && cut.position < tokens.size() && !std::holds_alternative<Label>(tokens[cut.position]) && current != label(*cut.cell)) {
+        result.push_back(label(*cut.cell));
+    }
+
+    size_t synthesized = result.size();
+    result.insert(result.end(), tokens.begin() + cut.position, tokens.end());
+
+    if (!stream.origins.empty()) {
+        std::vector<size_t> origins(synthesized, stream.origins.front());
+        origins.insert(origins.end(), stream.origins.begin() + cut.position, stream.origins.end());
+        stream.origins = std::move(origins);
+    }
+
+    stream.tokens = std::move(result);
+}
+
+} // namespace bflabels::opt
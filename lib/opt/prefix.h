@@ -0,0 +1,18 @@
+#pragma once
+
+#include "pipeline.h"
+
+
+namespace bflabels::opt {
+
+// Runs the start of the program at compile time, up to the first `,`, raw
+// pointer move or `PREFIX_BUDGET` executed operations, and replaces it with
+// straight-line code: the bytes it printed as literals, then every cell it
+// left nonzero set directly. The cut is made at the last point outside any
+// loop, so the rest of the stream is kept as is.
+void evaluate_prefix(Stream& stream);
+
+// Operations executed at compile time before the prefix is cut short.
+constexpr size_t PREFIX_BUDGET = 1 << 20;
+
+} // namespace bflabels::opt
@@ -0,0 +1,246 @@
+#include "schedule.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace bflabels::opt {
+
+namespace {
+
+// (label_idx, element_idx); `Label::operator<` ignores the element.
+using Cell = std::pair<size_t, size_t>;
+
+// Every op a run applies to one cell, in their original order.
+struct Group {
+    Label label;
+    int64_t offset;
+    size_t origin;
+    std::vector<Token> ops;
+    std::vector<size_t> origins;
+};
+
+bool in_run(const Token& token) {
+    return std::holds_alternative<Label>(token) || token == Token('+') || token == Token('-');
+}
+
+class Scheduler {
+private:
+    const Stream& stream;
+    bool has_origins;
+
+    // Cell offset of every label token.
+    std::vector<int64_t> offsets;
+
+    // The cell ops apply to, unknown after raw moves, and where the pointer
+    // was last moved to.
+    std::optional<Label> current;
+    int64_t position = 0;
+
+    size_t origin(size_t i) const {
+        return has_origins ? stream.origins[i] : 0;
+    }
+
+    void emit(Token token, size_t origin) {
+        result.tokens.push_back(token);
+        if (has_origins) {
+            result.origins.push_back(origin);
+        }
+    }
+
+    void emit_original(size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (const Label* label = std::get_if<Label>(&stream.tokens[i])) {
+                current = *label;
+                position = offsets[i];
+            }
+            emit(stream.tokens[i], origin(i));
+        }
+    }
+
+    size_t travel(const std::vector<Group>& groups, const std::vector<size_t>& order) const {
+        size_t travel = 0;
+        int64_t at = position;
+        for (size_t group : order) {
+            travel += std::abs(groups[group].offset - at);
+            at = groups[group].offset;
+        }
+        return travel;
+    }
+
+    void schedule_run(size_t begin, size_t end) {
+        const auto& tokens = stream.tokens;
+
+        // Ops on a cell left unknown by raw moves stay in front.
+        size_t first = begin;
+        if (!current) {
+            while (first < end && !std::holds_alternative<Label>(tokens[first])) {
+                ++first;
+            }
+            emit_original(begin, first);
+        }
+
+        if (std::none_of(tokens.begin() + first, tokens.begin() + end, [](const Token& token) {
+            return std::holds_alternative<Label>(token);
+        })) {
+            emit_original(first, end);
+            return;
+        }
+
+        std::vector<Group> groups;
+        std::map<Cell, size_t> index;
+
+        auto group_of = [&](Label label, int64_t offset, size_t origin) -> Group& {
+            auto [it, inserted] = index.try_emplace(Cell { label.label_idx, label.element_idx }, groups.size());
+            if (inserted) {
+                groups.push_back(Group { label, offset, origin, {}, {} });
+            }
+            return groups[it->second];
+        };
+
+        std::optional<Label> cell = current;
+        size_t original = 0;
+        int64_t at = position;
+
+        for (size_t i = first; i < end; ++i) {
+            if (const Label* label = std::get_if<Label>(&tokens[i])) {
+                cell = *label;
+                original += std::abs(offsets[i] - at);
+                at = offsets[i];
+                group_of(*label, at, origin(i));
+                continue;
+            }
+
+            Group& group = group_of(*cell, at, origin(i));
+            group.ops.push_back(tokens[i]);
+            group.origins.push_back(origin(i));
+        }
+
+        // Ops after the run use the cell it ends on.
+        std::optional<size_t> last;
+        if (end < tokens.size()) {
+            last = index.at(Cell { cell->label_idx, cell->element_idx });
+        }
+
+        std::vector<size_t> sweep;
+        for (size_t group = 0; group < groups.size(); ++group) {
+            if (group != last && !groups[group].ops.empty()) {
+                sweep.push_back(group);
+            }
+        }
+
+        std::ranges::sort(sweep, {}, [&](size_t group) {
+            return groups[group].offset;
+        });
+
+        std::vector<size_t> ascending = sweep;
+        std::vector<size_t> descending(sweep.rbegin(), sweep.rend());
+        if (last) {
+            ascending.push_back(*last);
+            descending.push_back(*last);
+        }
+
+        const auto& order = travel(groups, descending) < travel(groups, ascending) ? descending : ascending;
+
+        if (travel(groups, order) >= original) {
+            emit_original(first, end);
+            return;
+        }
+
+        for (size_t i : order) {
+            const Group& group = groups[i];
+
+            if (current != group.label) {
+                emit(group.label, group.origin);
+                current = group.label;
+                position = group.offset;
+            }
+
+            for (size_t op = 0; op < group.ops.size(); ++op) {
+                emit(group.ops[op], group.origins[op]);
+            }
+        }
+    }
+
+public:
+    Stream result;
+
+    Scheduler(const Stream& stream, const BFLCode& code) :
+        stream(stream),
+        has_origins(!stream.origins.empty()),
+        offsets(stream.tokens.size()) {
+        for (size_t i = 0; i < stream.tokens.size(); ++i) {
+            if (const Label* label = std::get_if<Label>(&stream.tokens[i])) {
+                offsets[i] = code.offset(*label);
+            }
+        }
+        result.merged = stream.merged;
+    }
+
+    void run() {
+        const auto& tokens = stream.tokens;
+
+        for (size_t i = 0; i < tokens.size();) {
+            if (!in_run(tokens[i])) {
+                if (tokens[i] == Token('<') || tokens[i] == Token('>')) {
+                    current = std::nullopt;
+                }
+                emit(tokens[i], origin(i));
+                ++i;
+                continue;
+            }
+
+            size_t end = i;
+            while (end < tokens.size() && in_run(tokens[end])) {
+                ++end;
+            }
+
+            schedule_run(i, end);
+            i = end;
+        }
+    }
+};
+
+} // namespace
+
+
+size_t label_travel(const std::vector<Token>& tokens, const BFLCode& code) {
+    size_t travel = 0;
+    int64_t position = 0;
+
+    for (auto token : tokens) {
+        if (const Label* label = std::get_if<Label>(&token)) {
+            travel += std::abs(code.offset(*label) - position);
+            position = code.offset(*label);
+        }
+    }
+
+    return travel;
+}
+
+void schedule_operations(Stream& stream, const MemoryLayout& reserved) {
+    auto layout = BFLCode(stream.tokens, reserved).memory_layout();
+    size_t travel = label_travel(stream.tokens, BFLCode(stream.tokens, layout));
+
+    for (size_t round = 0; round < SCHEDULE_ROUNDS; ++round) {
+        Scheduler scheduler(stream, BFLCode(stream.tokens, layout));
+        scheduler.run();
+
+        BFLCode scheduled(scheduler.result.tokens, reserved);
+        size_t scheduled_travel = label_travel(scheduler.result.tokens, scheduled);
+        if (scheduled_travel >= travel) {
+            break;
+        }
+
+        stream = std::move(scheduler.result);
+        layout = scheduled.memory_layout();
+        travel = scheduled_travel;
+    }
+}
+
+} // namespace bflabels::opt
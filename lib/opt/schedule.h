@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pipeline.h"
+
+
+namespace bflabels::opt {
+
+// Pointer moves the stream costs when laid out by `code`, as `BFLCode::compile`
+// emits them for label switches (raw moves not included).
+size_t label_travel(const std::vector<Token>& tokens, const BFLCode& code);
+
+// Reorders every straight-line run of labels and `+`/`-` (which commute
+// across cells) into one group per cell, visited in a single sweep over the
+// layout `BFLCode` gives the stream with `reserved` cells. The run still ends
+// on its last cell when an op after it uses the current cell. Since the
+// layout follows first use, rounds repeat while the travel shrinks.
+void schedule_operations(Stream& stream, const MemoryLayout& reserved);
+
+// Layout-and-schedule rounds at most.
+constexpr size_t SCHEDULE_ROUNDS = 4;
+
+} // namespace bflabels::opt
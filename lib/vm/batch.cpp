@@ -0,0 +1,183 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#include "deadline.h"
+#include "lockstep.h"
+
+
+namespace bfvm {
+
+namespace {
+
+// What a thread has left of the inputs, `[begin, end)` packed in one word,
+// so that its owner taking from the front and thieves taking from the back
+// never get the same input.
+struct alignas(64) Share {
+    std::atomic<uint64_t> range;
+
+    static uint64_t pack(uint32_t begin, uint32_t end) {
+        return (uint64_t)begin << 32 | end;
+    }
+
+    // The next input, taken from the front.
+    std::optional<uint32_t> take() {
+        uint64_t current = range.load(std::memory_order_relaxed);
+
+        while (true) {
+            uint32_t begin = current >> 32;
+            uint32_t end = current;
+            if (begin >= end) {
+                return std::nullopt;
+            }
+            if (range.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_relaxed)) {
+                return begin;
+            }
+        }
+    }
+
+    // The back half of what is left, at least one input when there is any.
+    std::optional<std::pair<uint32_t, uint32_t>> steal() {
+        uint64_t current = range.load(std::memory_order_relaxed);
+
+        while (true) {
+            uint32_t begin = current >> 32;
+            uint32_t end = current;
+            if (begin >= end) {
+                return std::nullopt;
+            }
+
+            uint32_t middle = begin + (end - begin) / 2;
+            if (range.compare_exchange_weak(current, pack(begin, middle), std::memory_order_relaxed)) {
+                return std::pair { middle, end };
+            }
+        }
+    }
+};
+
+} // namespace
+
+std::optional<std::vector<std::string_view>> split_records(std::string_view data, RecordFormat format) {
+    std::vector<std::string_view> records;
+
+    while (!data.empty()) {
+        if (format == RecordFormat::Lines) {
+            size_t end = std::min(data.find('\n'), data.size());
+            records.push_back(data.substr(0, end));
+            data.remove_prefix(std::min(end + 1, data.size()));
+            continue;
+        }
+
+        if (data.size() < 4) {
+            return std::nullopt;
+        }
+
+        uint32_t length = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            length |= (uint32_t)(uint8_t)data[i] << (8 * i);
+        }
+        data.remove_prefix(4);
+
+        if (data.size() < length) {
+            return std::nullopt;
+        }
+
+        records.push_back(data.substr(0, length));
+        data.remove_prefix(length);
+    }
+
+    return records;
+}
+
+void write_record(std::ostream& out, std::string_view record, RecordFormat format) {
+    if (format == RecordFormat::Lengths) {
+        for (size_t i = 0; i < 4; ++i) {
+            out.put((char)(record.size() >> (8 * i)));
+        }
+    }
+
+    out.write(record.data(), record.size());
+}
+
+std::vector<BatchRun> run_batch(
+    const Program& program,
+    const Dialect& dialect,
+    std::span<const std::string_view> inputs,
+    unsigned threads,
+    uint64_t max_steps,
+    bool lockstep,
+    std::optional<std::chrono::milliseconds> timeout
+) {
+    std::vector<BatchRun> runs(inputs.size());
+
+    // Shares are of groups of `width` inputs.
+    lockstep = lockstep && dialect.byte_cells();
+    size_t width = lockstep ? LOCKSTEP_LANES : 1;
+    size_t groups = (inputs.size() + width - 1) / width;
+
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(groups, 1));
+    std::vector<Share> shares(threads);
+
+    for (size_t i = 0; i < threads; ++i) {
+        shares[i].range = Share::pack(groups * i / threads, groups * (i + 1) / threads);
+    }
+
+    auto work = [&](size_t self) {
+        std::unique_ptr<Runner> runner;
+        std::optional<Lockstep> group;
+
+        if (lockstep) {
+            group.emplace(program, dialect);
+        } else {
+            runner = make_runner(program, dialect);
+        }
+
+        while (true) {
+            while (auto taken = shares[self].take()) {
+                size_t first = *taken * width;
+                size_t count = std::min(width, inputs.size() - first);
+
+                // Timed by the record, or by the group of lockstep lanes.
+                std::optional<Deadline> deadline;
+                if (timeout) {
+                    deadline.emplace(*timeout);
+                }
+                const std::atomic<bool>* timed_out = deadline ? &deadline->flag() : nullptr;
+
+                if (group) {
+                    group->run(inputs.subspan(first, count), std::span(runs).subspan(first, count), max_steps, timed_out);
+                } else {
+                    BatchRun& run = runs[first];
+                    run.result = runner->run(inputs[first], run.output, max_steps, timed_out);
+                }
+            }
+
+            // Only this thread adds to its share, and only when it is empty.
+            std::optional<std::pair<uint32_t, uint32_t>> stolen;
+            for (size_t k = 1; k < threads && !stolen; ++k) {
+                stolen = shares[(self + k) % threads].steal();
+            }
+            if (!stolen) {
+                return;
+            }
+
+            shares[self].range.store(Share::pack(stolen->first, stolen->second), std::memory_order_relaxed);
+        }
+    };
+
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back(work, i);
+        }
+        work(0);
+    }
+
+    return runs;
+}
+
+} // namespace bfvm
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dialect.h"
+#include "interpreter.h"
+#include "program.h"
+
+
+namespace bfvm {
+
+// How the inputs of a batch are laid out in one stream.
+enum class RecordFormat {
+    // A record per line, without its newline.
+    Lines,
+    // Every record after its length, in 4 bytes, least significant first.
+    Lengths,
+};
+
+// Records of `data`, viewing into it; nullopt when a length runs past its
+// end. A last line without a newline is a record too.
+std::optional<std::vector<std::string_view>> split_records(std::string_view data, RecordFormat format);
+
+// Writes the output of a run on a record of `format`: after its length, or
+// as it is for lines, since runs print their own newlines.
+void write_record(std::ostream& out, std::string_view record, RecordFormat format);
+
+struct BatchRun {
+    std::string output;
+    std::expected<void, RunError> result;
+};
+
+// Runs `program` on each of `inputs` on `threads` threads, each running
+// with a `Runner` of its own. Every thread starts on an even share of the
+// inputs and, once done with it, steals half of what is left of another's.
+// Runs are returned in the order of `inputs`. With `lockstep` and 8-bit
+// wrapping cells, threads run groups of inputs in a `Lockstep` instead. With
+// `timeout`, a run stops with `RunError::TimeLimit` once it has taken that
+// long, timed from its own start; lockstep lanes are timed as a group.
+std::vector<BatchRun> run_batch(
+    const Program& program,
+    const Dialect& dialect,
+    std::span<const std::string_view> inputs,
+    unsigned threads,
+    uint64_t max_steps = Interpreter::UNLIMITED,
+    bool lockstep = false,
+    std::optional<std::chrono::milliseconds> timeout = std::nullopt
+);
+
+} // namespace bfvm
@@ -0,0 +1,17 @@
+#include "deadline.h"
+
+
+namespace bfvm {
+
+Deadline::Deadline(std::chrono::milliseconds after) :
+    timer([this, after](std::stop_token stop) {
+        std::unique_lock lock(mutex);
+
+        // Wakes early only when the deadline is destroyed first.
+        wake.wait_for(lock, stop, after, [] { return false; });
+        if (!stop.stop_requested()) {
+            passed.store(true, std::memory_order_relaxed);
+        }
+    }) {}
+
+} // namespace bfvm
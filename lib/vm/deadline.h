@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+namespace bfvm {
+
+// A flag never raised, polled by runs given no deadline.
+inline const std::atomic<bool> NEVER_TIMED_OUT = false;
+
+// A flag raised once `after` has passed, by a timer thread of its own, for
+// runs to poll through `BasicInterpreter::timed_out`. Destroying the deadline
+// stops its timer.
+class Deadline {
+private:
+    std::atomic<bool> passed = false;
+    std::mutex mutex;
+    std::condition_variable_any wake;
+
+    // Declared last, so the timer stops before what it uses goes away.
+    std::jthread timer;
+
+public:
+    explicit Deadline(std::chrono::milliseconds after);
+
+    Deadline(const Deadline&) = delete;
+    Deadline& operator=(const Deadline&) = delete;
+
+    const std::atomic<bool>& flag() const {
+        return passed;
+    }
+};
+
+} // namespace bfvm
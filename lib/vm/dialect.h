@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace bfvm {
+
+enum class CellWidth {
+    Bits8,
+    Bits16,
+    Bits32,
+};
+
+// What `+` and `-` do past the range of a cell.
+enum class Overflow {
+    Wrap,
+    Saturate,
+    Trap,
+};
+
+// What `,` does at the end of input.
+enum class EofBehavior {
+    Keep,
+    Zero,
+    MinusOne,
+};
+
+enum class TapePolicy {
+    Growable,
+    Fixed,
+    // Reserved up front between guard pages (see `PagedTape`), so moves need
+    // no bounds checks.
+    Paged,
+};
+
+// The brainfuck dialect a program runs under. The defaults are what bfasm
+// compiles for.
+struct Dialect {
+    CellWidth cells = CellWidth::Bits8;
+    Overflow overflow = Overflow::Wrap;
+    EofBehavior eof = EofBehavior::Keep;
+    TapePolicy tape = TapePolicy::Growable;
+
+    // Size of a fixed tape.
+    size_t tape_cells = 30000;
+
+    // Whether a paged tape asks for huge pages.
+    bool huge_pages = false;
+
+    // Whether cells are 8-bit and wrap, as closed forms and the optimizer
+    // assume.
+    bool byte_cells() const {
+        return cells == CellWidth::Bits8 && overflow == Overflow::Wrap;
+    }
+};
+
+} // namespace bfvm
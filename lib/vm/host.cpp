@@ -0,0 +1,396 @@
+#include "host.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "io.h"
+
+
+namespace bfvm {
+
+Host::Host(
+    const Program& program,
+    const Dialect& dialect,
+    SessionEvents events,
+    unsigned threads,
+    uint64_t max_steps,
+    uint64_t slice,
+    std::optional<std::chrono::milliseconds> timeout
+) :
+    program(program),
+    dialect(dialect),
+    events(std::move(events)),
+    max_steps(max_steps),
+    slice(std::max<uint64_t>(slice, 1)),
+    timeout(timeout) {
+    for (unsigned i = 0; i < std::max(threads, 1u); ++i) {
+        this->threads.emplace_back([this](std::stop_token stop) {
+            work(stop);
+        });
+    }
+}
+
+void Host::ready(uint64_t session, Entry& entry) {
+    if (entry.state == State::Waiting) {
+        entry.state = State::Queued;
+        queue.push_back(session);
+        wake.notify_one();
+    }
+}
+
+uint64_t Host::open() {
+    auto session = make_session(program, dialect);
+
+    std::lock_guard lock(mutex);
+    uint64_t id = next_session++;
+
+    entries.emplace(id, Entry { .session = std::move(session) });
+    queue.push_back(id);
+    wake.notify_one();
+
+    return id;
+}
+
+void Host::feed(uint64_t session, std::string_view input) {
+    std::lock_guard lock(mutex);
+
+    auto found = entries.find(session);
+    if (found == entries.end() || found->second.ended) {
+        return;
+    }
+
+    found->second.inbox.append(input);
+    ready(session, found->second);
+}
+
+void Host::end_input(uint64_t session) {
+    std::lock_guard lock(mutex);
+
+    auto found = entries.find(session);
+    if (found == entries.end()) {
+        return;
+    }
+
+    found->second.ended = true;
+    ready(session, found->second);
+}
+
+void Host::close(uint64_t session) {
+    std::lock_guard lock(mutex);
+
+    auto found = entries.find(session);
+    if (found == entries.end()) {
+        return;
+    }
+
+    // Queued sessions leave their place in the queue, skipped once gone.
+    if (found->second.state == State::Running) {
+        found->second.closed = true;
+    } else {
+        entries.erase(found);
+    }
+}
+
+void Host::work(std::stop_token stop) {
+    std::unique_lock lock(mutex);
+
+    // Sessions still queued when the host goes away are left where they are.
+    while (wake.wait(lock, stop, [&] { return !queue.empty(); }) && !stop.stop_requested()) {
+        uint64_t id = queue.front();
+        queue.pop_front();
+
+        auto found = entries.find(id);
+        if (found == entries.end()) {
+            continue;
+        }
+
+        // Entries stay where they are while others come and go.
+        Entry& entry = found->second;
+        Session& session = *entry.session;
+
+        session.feed(entry.inbox);
+        entry.inbox.clear();
+        if (entry.ended) {
+            session.end_input();
+        }
+        entry.state = State::Running;
+
+        bool expired = timeout && std::chrono::steady_clock::now() - entry.opened >= *timeout;
+
+        lock.unlock();
+
+        uint64_t steps = session.steps();
+        std::string output;
+        std::expected<void, RunError> result = std::unexpected(RunError::TimeLimit);
+        if (!expired) {
+            result = session.resume(output, steps + std::min(slice, max_steps - std::min(steps, max_steps)));
+        }
+
+        // Runs stopped by the slice, rather than by `max_steps`, go on.
+        bool waiting = !result && result.error() == RunError::InputWait;
+        bool sliced = !result && result.error() == RunError::StepLimit && session.steps() < max_steps;
+
+        if (!output.empty() && events.output) {
+            events.output(id, output);
+        }
+
+        lock.lock();
+
+        if (!waiting && !sliced) {
+            entries.erase(id);
+
+            lock.unlock();
+            if (events.finished) {
+                events.finished(id, result);
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (entry.closed) {
+            entries.erase(id);
+        } else if (waiting && entry.inbox.empty() && !entry.ended) {
+            entry.state = State::Waiting;
+        } else {
+            entry.state = State::Queued;
+            queue.push_back(id);
+        }
+    }
+}
+
+namespace {
+
+// What the sessions of a server printed since the poll loop last looked, and
+// how their runs ended.
+struct Outbox {
+    std::string bytes;
+    std::optional<std::expected<void, RunError>> result;
+};
+
+struct Client {
+    int fd;
+    std::string sending;
+    bool reading = true;
+    std::optional<std::expected<void, RunError>> result;
+};
+
+} // namespace
+
+std::expected<void, std::string> serve_unix(
+    const std::string& path,
+    const Program& program,
+    const Dialect& dialect,
+    unsigned threads,
+    uint64_t max_steps,
+    std::optional<std::chrono::milliseconds> timeout,
+    std::ostream& log,
+    std::stop_token stop
+) {
+    auto failed = [&](std::string_view what) {
+        return std::unexpected("Can't " + std::string(what) + " \"" + path + "\": " + std::strerror(errno) + ".");
+    };
+
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return failed("listen on");
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        return failed("listen on");
+    }
+
+    // A connection per session takes as many descriptors as allowed.
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    // A socket left by an earlier server would fail the bind.
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        auto error = failed("listen on");
+        ::close(listener);
+        return error;
+    }
+
+    // Counts what sessions told since the poll loop last looked.
+    int wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup < 0) {
+        auto error = failed("serve");
+        ::close(listener);
+        return error;
+    }
+
+    auto notify = [&] {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = write(wakeup, &one, sizeof(one));
+    };
+
+    std::stop_callback on_stop(stop, notify);
+
+    // Only sessions with a client get an outbox, so that events of sessions
+    // dropped meanwhile go nowhere.
+    std::mutex mutex;
+    std::unordered_map<uint64_t, Outbox> outboxes;
+
+    // Declared after what its threads use, so they stop first.
+    Host host(
+        program, dialect,
+        SessionEvents {
+            .output = [&](uint64_t session, std::string_view output) {
+                {
+                    std::lock_guard lock(mutex);
+                    if (auto found = outboxes.find(session); found != outboxes.end()) {
+                        found->second.bytes.append(output);
+                    }
+                }
+                notify();
+            },
+            .finished = [&](uint64_t session, std::expected<void, RunError> result) {
+                {
+                    std::lock_guard lock(mutex);
+                    if (auto found = outboxes.find(session); found != outboxes.end()) {
+                        found->second.result = result;
+                    }
+                }
+                notify();
+            },
+        },
+        threads, max_steps, HOST_SLICE_STEPS, timeout
+    );
+
+    std::unordered_map<uint64_t, Client> clients;
+    std::vector<pollfd> polled;
+    std::vector<uint64_t> polled_sessions;
+    std::vector<char> buffer(IO_BUFFER_BYTES);
+
+    // Off while out of descriptors, until a client leaves.
+    bool accepting = true;
+
+    auto drop = [&](uint64_t session) {
+        accepting = true;
+        host.close(session);
+        {
+            std::lock_guard lock(mutex);
+            outboxes.erase(session);
+        }
+        ::close(clients.at(session).fd);
+        clients.erase(session);
+    };
+
+    while (!stop.stop_requested()) {
+        polled.assign({ { listener, short(accepting ? POLLIN : 0), 0 }, { wakeup, POLLIN, 0 } });
+        polled_sessions.clear();
+
+        for (auto& [session, client] : clients) {
+            short events = (client.reading ? POLLIN : 0) | (client.sending.empty() ? 0 : POLLOUT);
+            polled.push_back({ client.fd, events, 0 });
+            polled_sessions.push_back(session);
+        }
+
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (polled[1].revents & POLLIN) {
+            uint64_t count;
+            [[maybe_unused]] ssize_t bytes = read(wakeup, &count, sizeof(count));
+
+            std::lock_guard lock(mutex);
+            for (auto& [session, outbox] : outboxes) {
+                Client& client = clients.at(session);
+                client.sending.append(outbox.bytes);
+                outbox.bytes.clear();
+                if (outbox.result) {
+                    client.result = outbox.result;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < polled_sessions.size(); ++i) {
+            uint64_t session = polled_sessions[i];
+            Client& client = clients.at(session);
+            short events = polled[i + 2].revents;
+
+            if (events & POLLIN) {
+                ssize_t bytes = recv(client.fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+                if (bytes > 0) {
+                    host.feed(session, std::string_view(buffer.data(), bytes));
+                } else if (bytes == 0) {
+                    host.end_input(session);
+                    client.reading = false;
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    drop(session);
+                    continue;
+                }
+            }
+
+            if (events & POLLOUT) {
+                ssize_t bytes = send(client.fd, client.sending.data(), client.sending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (bytes > 0) {
+                    client.sending.erase(0, bytes);
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    drop(session);
+                    continue;
+                }
+            }
+
+            // Clients gone, or which can't take output any more.
+            if (events & (POLLERR | POLLHUP)) {
+                drop(session);
+                continue;
+            }
+
+            if (client.result && client.sending.empty()) {
+                if (!*client.result) {
+                    log << "Session " << session << ": " << client.result->error() << '\n';
+                }
+                drop(session);
+            }
+        }
+
+        if (polled[0].revents & POLLIN) {
+            while (true) {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    accepting = errno != EMFILE && errno != ENFILE;
+                    break;
+                }
+
+                // The outbox is there before the session can print.
+                std::lock_guard lock(mutex);
+                uint64_t session = host.open();
+                outboxes.emplace(session, Outbox {});
+                clients.emplace(session, Client { fd });
+            }
+        }
+    }
+
+    for (auto& [session, client] : clients) {
+        ::close(client.fd);
+    }
+    ::close(wakeup);
+    ::close(listener);
+    unlink(path.c_str());
+
+    return {};
+}
+
+} // namespace bfvm
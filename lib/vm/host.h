@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "dialect.h"
+#include "interpreter.h"
+#include "program.h"
+
+
+namespace bfvm {
+
+// Steps a session runs before the others get a turn.
+constexpr uint64_t HOST_SLICE_STEPS = uint64_t(1) << 20;
+
+// What a host tells of its sessions, called from its threads, never for one
+// session at once.
+struct SessionEvents {
+    // Output a session printed, as it prints it.
+    std::function<void(uint64_t session, std::string_view output)> output;
+
+    // The end of the run of a session, after all of its output. The session
+    // is gone by the time this is called.
+    std::function<void(uint64_t session, std::expected<void, RunError> result)> finished;
+};
+
+// Runs many sessions of one program on a few threads. A session takes a
+// turn until it awaits input it wasn't fed, or for at most a slice of steps,
+// and then goes back to the queue, or waits for its input aside. Sessions run
+// until their program ends, or until `max_steps` steps in total, or, with a
+// `timeout`, until a turn starting that long after they were opened ends them
+// with `RunError::TimeLimit`. Turns are at most a slice long, which bounds how
+// far a session runs past its time.
+class Host {
+private:
+    enum class State {
+        Queued,
+        Running,
+        Waiting,
+    };
+
+    struct Entry {
+        std::unique_ptr<Session> session;
+
+        // Input fed while the session wasn't running, handed over on its
+        // next turn.
+        std::string inbox;
+        bool ended = false;
+
+        State state = State::Queued;
+
+        // Closed while running, to drop once its turn is over.
+        bool closed = false;
+
+        std::chrono::steady_clock::time_point opened = std::chrono::steady_clock::now();
+    };
+
+    const Program& program;
+    Dialect dialect;
+    SessionEvents events;
+    uint64_t max_steps;
+    uint64_t slice;
+    std::optional<std::chrono::milliseconds> timeout;
+
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::deque<uint64_t> queue;
+    uint64_t next_session = 0;
+
+    // Declared last, so threads stop before what they use goes away.
+    std::vector<std::jthread> threads;
+
+    // Makes a waiting session queued again; `mutex` is held.
+    void ready(uint64_t session, Entry& entry);
+
+    void work(std::stop_token stop);
+
+public:
+    // Runs sessions of `program`, which must outlive the host, on `threads`
+    // threads.
+    Host(
+        const Program& program,
+        const Dialect& dialect,
+        SessionEvents events,
+        unsigned threads,
+        uint64_t max_steps = Interpreter::UNLIMITED,
+        uint64_t slice = HOST_SLICE_STEPS,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt
+    );
+
+    Host(const Host&) = delete;
+    Host& operator=(const Host&) = delete;
+
+    // Starts a session, which runs until it first awaits input.
+    uint64_t open();
+
+    // Adds `input` to what `session` reads. Ignored once its input ended or
+    // it is gone.
+    void feed(uint64_t session, std::string_view input);
+
+    // Ends the input of `session`, for `,` to read EOF past what was fed.
+    void end_input(uint64_t session);
+
+    // Drops `session` without waiting for its run to end. Events of a turn
+    // it is taking are still told.
+    void close(uint64_t session);
+};
+
+// Serves a session of `program` per connection to a Unix socket made at
+// `path`, on a `Host` of `threads` threads. What a client sends is the input
+// of its session, which ends as the client shuts down writing, and what the
+// session prints is sent back; the connection is closed once the run ends,
+// errors going to `log`. Sessions are timed as `Host` times them. Returns once
+// `stop` is requested, or when the socket can't be made.
+std::expected<void, std::string> serve_unix(
+    const std::string& path,
+    const Program& program,
+    const Dialect& dialect,
+    unsigned threads,
+    uint64_t max_steps,
+    std::optional<std::chrono::milliseconds> timeout,
+    std::ostream& log,
+    std::stop_token stop = {}
+);
+
+} // namespace bfvm
@@ -0,0 +1,762 @@
+#include "interpreter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <expected>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <spanstream>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "deadline.h"
+#include "io.h"
+
+
+namespace bfvm {
+
+namespace {
+
+// Adds `delta` to `cell`; false when a trapping cell overflows.
+template <Overflow Mode, typename Cell>
+bool add(Cell& cell, int64_t delta) {
+    if constexpr (Mode == Overflow::Wrap) {
+        cell += (Cell)delta;
+    } else {
+        constexpr int64_t max = std::numeric_limits<Cell>::max();
+        int64_t value = (int64_t)cell + delta;
+
+        if (value < 0 || value > max) {
+            if constexpr (Mode == Overflow::Trap) {
+                return false;
+            }
+            value = std::clamp<int64_t>(value, 0, max);
+        }
+
+        cell = value;
+    }
+
+    return true;
+}
+
+// Reads a byte into `cell`, first flushing `sink` when `source` has nothing
+// buffered, so prompts show before a run waits for its answer.
+template <EofBehavior Eof, typename Cell>
+void input(std::streambuf& source, std::streambuf& sink, Cell& cell) {
+    if (source.in_avail() <= 0) {
+        sink.pubsync();
+    }
+
+    int ch = source.sbumpc();
+
+    if (ch != std::streambuf::traits_type::eof()) {
+        cell = (uint8_t)ch;
+    } else if constexpr (Eof == EofBehavior::Zero) {
+        cell = 0;
+    } else if constexpr (Eof == EofBehavior::MinusOne) {
+        cell = std::numeric_limits<Cell>::max();
+    }
+}
+
+} // namespace
+
+
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+std::expected<void, RunError> BasicInterpreter<Cell, OverflowMode, Eof, Tape>::apply(const ClosedForm& form, size_t counter) {
+    // Checked even on paged tapes, whose guards are sized for the program a
+    // run started with, not for forms a tier-up brings in.
+    if (form.min_cell < 0 && counter < (size_t)-form.min_cell) {
+        return std::unexpected(RunError::TapeUnderflow);
+    }
+
+    if (counter + form.max_cell >= tape.size()) {
+        if constexpr (Tape != TapePolicy::Growable) {
+            return std::unexpected(RunError::TapeOverflow);
+        } else {
+            tape.resize(std::max(tape.size() * 2, counter + form.max_cell + 1));
+        }
+    }
+
+    // Factors are entry values: compute every delta first.
+    deltas.resize(form.updates.size());
+    for (size_t i = 0; i < form.updates.size(); ++i) {
+        Cell delta = 0;
+        for (const auto& term : form.updates[i].terms) {
+            Cell product = term.coefficient;
+            for (int32_t factor : term.factors) {
+                product *= tape[counter + factor];
+            }
+            delta += product;
+        }
+        deltas[i] = delta;
+    }
+
+    for (size_t i = 0; i < form.updates.size(); ++i) {
+        tape[counter + form.updates[i].cell] += deltas[i];
+    }
+
+    tape[counter] = 0;
+
+    return {};
+}
+
+// GCC and Clang can take the address of a label, which lets every handler
+// jump straight to the handler of the next op (direct threading) instead of
+// going back through a single switch.
+#if defined(__GNUC__)
+#define BFVM_THREADED 1
+#else
+#define BFVM_THREADED 0
+#endif
+
+// Threaded dispatch has `finish` as the handler past the last op, so only
+// switch dispatch checks for the end.
+#if BFVM_THREADED
+#define BFVM_FETCH()                                                \
+    if constexpr (Profile) {                                        \
+        if (pc < size) {                                            \
+            ++op_counts[pc];                                        \
+        }                                                           \
+    }                                                               \
+    op = &ops[pc]
+#else
+#define BFVM_FETCH()                                                \
+    if (pc >= size) {                                               \
+        goto finish;                                                \
+    }                                                               \
+    if constexpr (Profile) {                                        \
+        ++op_counts[pc];                                            \
+    }                                                               \
+    op = &ops[pc]
+#endif
+
+// Steps are charged in bulk, for the ops from `mark` up to a jump, and the
+// op failing counts as executed.
+#define BFVM_FAIL(what)                                             \
+    error = what;                                                   \
+    ++steps;                                                        \
+    goto finish
+
+#define BFVM_JUMP(target)                                           \
+    steps += pc + 1 - mark;                                         \
+    pc = (target);                                                  \
+    mark = pc + 1
+
+// Budgets are only checked at back-edges: code between two of them runs a
+// bounded number of ops, so a run overshoots its budget by less than a pass
+// through the program.
+#define BFVM_CHECK_BUDGET()                                         \
+    if (steps >= max_steps) {                                       \
+        error = RunError::StepLimit;                                \
+        pc = mark;                                                  \
+        goto finish;                                                \
+    }                                                               \
+    if (timed_out.load(std::memory_order_relaxed)) {                \
+        error = RunError::TimeLimit;                                \
+        pc = mark;                                                  \
+        goto finish;                                                \
+    }
+
+#define BFVM_ADD(cell, delta)                                       \
+    if (!add<OverflowMode>(cell, delta)) {                          \
+        BFVM_FAIL(RunError::CellOverflow);                          \
+    }
+
+// Paged tapes catch stray accesses in their guards, so moves go unchecked.
+#define BFVM_MOVE(delta)                                            \
+    if constexpr (Tape != TapePolicy::Paged) {                      \
+        if ((delta) < 0 && pointer < (size_t)-(delta)) {            \
+            BFVM_FAIL(RunError::TapeUnderflow);                     \
+        }                                                           \
+    }                                                               \
+    pointer += (delta);                                             \
+    if constexpr (Tape != TapePolicy::Paged) {                      \
+        if (!reach(pointer)) {                                      \
+            BFVM_FAIL(RunError::TapeOverflow);                      \
+        }                                                           \
+    }
+
+// Stops at `,` when awaiting input that hasn't come yet, for another call to
+// read it once it has. Streams tell having nothing yet with an `in_avail` of
+// 0, and the end of input with -1.
+#define BFVM_AWAIT_INPUT()                                          \
+    if (await_input && source.in_avail() == 0) {                    \
+        error = RunError::InputWait;                                \
+        goto finish;                                                \
+    }
+
+// A jump back to the opening op `open`, counting up to the threshold.
+#define BFVM_BACK_EDGE(open)                                        \
+    BFVM_JUMP(open);                                                \
+    if constexpr (Count) {                                          \
+        if (back_edges[pc] < threshold) {                           \
+            ++back_edges[pc];                                       \
+        }                                                           \
+    }                                                               \
+    BFVM_CHECK_BUDGET()
+
+// A loop leaving with its back-edges at the threshold stops the run right
+// after it, where its entry state no longer matters.
+#define BFVM_LOOP_EXIT(open)                                        \
+    if constexpr (Count) {                                          \
+        if (back_edges[open] == threshold) {                        \
+            hot_loop = open;                                        \
+            ++pc;                                                   \
+            goto finish;                                            \
+        }                                                           \
+    }
+
+#if BFVM_THREADED
+#define BFVM_CASE(kind) op_##kind
+#define BFVM_NEXT() ++pc; BFVM_FETCH(); goto *threaded[pc]
+#else
+#define BFVM_CASE(kind) case OpKind::kind
+#define BFVM_NEXT() ++pc; continue
+#endif
+
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+template <bool Profile, bool Count>
+std::expected<void, RunError> BasicInterpreter<Cell, OverflowMode, Eof, Tape>::run_impl(uint64_t max_steps, uint64_t threshold) {
+    const Op* ops = program.ops.data();
+    const size_t size = program.ops.size();
+
+    // Kept in locals, since any cell write could alias the members.
+    size_t pc = this->pc;
+    size_t pointer = this->pointer;
+    uint64_t steps = this->steps;
+    Cell* cells = tape.data();
+
+    // First op not yet charged to `steps`.
+    size_t mark = pc;
+
+    const std::atomic<bool>& timed_out = this->timed_out ? *this->timed_out : NEVER_TIMED_OUT;
+
+    const Op* op = nullptr;
+    std::optional<RunError> error;
+
+    // I/O goes straight to the buffers, without a sentry per byte.
+    std::streambuf& source = *in.rdbuf();
+    std::streambuf& sink = *out.rdbuf();
+
+    auto reach = [&](size_t cell) {
+        if (cell >= tape.size()) {
+            if constexpr (Tape != TapePolicy::Growable) {
+                return false;
+            } else {
+                tape.resize(std::max(tape.size() * 2, cell + 1));
+                cells = tape.data();
+            }
+        }
+        return true;
+    };
+
+    auto closed = [&](size_t counter) {
+        auto result = apply(program.closed_forms[op->arg], counter);
+        cells = tape.data();
+        if (!result) {
+            error = result.error();
+        }
+        return result.has_value();
+    };
+
+#if BFVM_THREADED
+    // Handlers in `OpKind` order.
+    static void* const handlers[] = {
+        &&op_Add, &&op_Move, &&op_Open, &&op_Close, &&op_Out, &&op_In, &&op_Closed,
+        &&op_AddAt, &&op_OpenAt, &&op_CloseAt, &&op_OutAt, &&op_InAt, &&op_ClosedAt,
+        &&op_Seek,
+        &&op_MoveAdd, &&op_AddClose, &&op_Set, &&op_AddCloseAt, &&op_SetAt,
+    };
+    static_assert(std::size(handlers) == (size_t)OpKind::SetAt + 1);
+
+    if (threaded_ops != ops || threaded_handlers != handlers || threaded.size() != size + 1) {
+        threaded.resize(size + 1);
+        for (size_t i = 0; i < size; ++i) {
+            threaded[i] = handlers[(size_t)ops[i].kind];
+        }
+        threaded[size] = &&finish;
+
+        threaded_ops = ops;
+        threaded_handlers = handlers;
+    }
+
+    BFVM_FETCH();
+    goto *threaded[pc];
+#else
+    for (;;) {
+        BFVM_FETCH();
+
+        switch (op->kind) {
+#endif
+
+        BFVM_CASE(Add):
+            BFVM_ADD(cells[pointer], op->arg);
+            BFVM_NEXT();
+
+        BFVM_CASE(Move):
+            BFVM_MOVE(op->arg);
+            BFVM_NEXT();
+
+        BFVM_CASE(Open):
+            if (!cells[pointer]) {
+                BFVM_JUMP(op->arg);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(Close):
+            if (cells[pointer]) {
+                BFVM_BACK_EDGE(op->arg);
+            } else {
+                BFVM_LOOP_EXIT(op->arg);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(Out):
+            sink.sputc(cells[pointer]);
+            BFVM_NEXT();
+
+        BFVM_CASE(In):
+            BFVM_AWAIT_INPUT();
+            input<Eof>(source, sink, cells[pointer]);
+            BFVM_NEXT();
+
+        BFVM_CASE(Closed):
+            if (!closed(pointer)) {
+                BFVM_FAIL(*error);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(AddAt):
+            BFVM_ADD(cells[op->cell], op->arg);
+            BFVM_NEXT();
+
+        BFVM_CASE(OpenAt):
+            if (!cells[op->cell]) {
+                BFVM_JUMP(op->arg);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(CloseAt):
+            if (cells[op->cell]) {
+                BFVM_BACK_EDGE(op->arg);
+            } else {
+                BFVM_LOOP_EXIT(op->arg);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(OutAt):
+            sink.sputc(cells[op->cell]);
+            BFVM_NEXT();
+
+        BFVM_CASE(InAt):
+            BFVM_AWAIT_INPUT();
+            input<Eof>(source, sink, cells[op->cell]);
+            BFVM_NEXT();
+
+        BFVM_CASE(ClosedAt):
+            if (!closed(op->cell)) {
+                BFVM_FAIL(*error);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(Seek):
+            pointer = op->cell;
+            BFVM_NEXT();
+
+        BFVM_CASE(MoveAdd):
+            BFVM_MOVE(op->arg);
+            BFVM_ADD(cells[pointer], op->value);
+            BFVM_NEXT();
+
+        BFVM_CASE(AddClose):
+            BFVM_ADD(cells[pointer], op->value);
+            if (cells[pointer]) {
+                BFVM_BACK_EDGE(op->arg);
+            } else {
+                BFVM_LOOP_EXIT(op->arg);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(Set):
+            cells[pointer] = (Cell)op->value;
+            BFVM_NEXT();
+
+        BFVM_CASE(AddCloseAt):
+            BFVM_ADD(cells[op->cell], op->value);
+            if (cells[op->cell]) {
+                BFVM_BACK_EDGE(op->arg);
+            } else {
+                BFVM_LOOP_EXIT(op->arg);
+            }
+            BFVM_NEXT();
+
+        BFVM_CASE(SetAt):
+            cells[op->cell] = (Cell)op->value;
+            BFVM_NEXT();
+
+#if !BFVM_THREADED
+        }
+    }
+#endif
+
+finish:
+    steps += pc - mark;
+
+    this->pc = pc;
+    this->pointer = pointer;
+    this->steps = steps;
+
+    // Output up to an error is still the program's.
+    out.flush();
+
+    if (error) {
+        return std::unexpected(*error);
+    }
+
+    return {};
+}
+
+#undef BFVM_NEXT
+#undef BFVM_CASE
+#undef BFVM_LOOP_EXIT
+#undef BFVM_BACK_EDGE
+#undef BFVM_AWAIT_INPUT
+#undef BFVM_MOVE
+#undef BFVM_ADD
+#undef BFVM_CHECK_BUDGET
+#undef BFVM_JUMP
+#undef BFVM_FAIL
+#undef BFVM_FETCH
+
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+template <bool Profile, bool Count>
+std::expected<void, RunError> BasicInterpreter<Cell, OverflowMode, Eof, Tape>::start(uint64_t max_steps, uint64_t threshold) {
+    if constexpr (Tape == TapePolicy::Paged) {
+        if (!tape.pages().valid()) {
+            return std::unexpected(RunError::OutOfMemory);
+        }
+    }
+
+    if (tape.size() < program.tape_size) {
+        if constexpr (Tape != TapePolicy::Growable) {
+            return std::unexpected(RunError::TapeOverflow);
+        } else {
+            tape.resize(program.tape_size);
+        }
+    }
+
+    if constexpr (Tape == TapePolicy::Paged) {
+        std::expected<void, RunError> result;
+        auto body = [&] {
+            result = run_impl<Profile, Count>(max_steps, threshold);
+        };
+
+        auto fault = tape.pages().guard(body);
+        if (fault == PagedRegion::Fault::None) {
+            return result;
+        }
+
+        // The fault left `run_impl` where it was, with where it stopped only
+        // in its locals, so the run can't go on from there.
+        out.flush();
+        reset();
+
+        return std::unexpected(fault == PagedRegion::Fault::Below ? RunError::TapeUnderflow : RunError::TapeOverflow);
+    } else {
+        return run_impl<Profile, Count>(max_steps, threshold);
+    }
+}
+
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+std::expected<void, RunError> BasicInterpreter<Cell, OverflowMode, Eof, Tape>::run(uint64_t max_steps, bool profile) {
+    if (profile) {
+        op_counts.resize(program.ops.size());
+        return start<true, false>(max_steps, 0);
+    }
+
+    return start<false, false>(max_steps, 0);
+}
+
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+void BasicInterpreter<Cell, OverflowMode, Eof, Tape>::reset() {
+    if constexpr (Tape == TapePolicy::Paged) {
+        tape.pages().clear();
+    } else {
+        std::fill(tape.begin(), tape.end(), 0);
+    }
+
+    pointer = 0;
+    pc = 0;
+    steps = 0;
+}
+
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+std::expected<std::optional<size_t>, RunError> BasicInterpreter<Cell, OverflowMode, Eof, Tape>::run_counting(
+    uint64_t threshold,
+    uint64_t max_steps
+) {
+    back_edges.resize(program.ops.size());
+    hot_loop.reset();
+
+    auto result = start<false, true>(max_steps, threshold);
+    if (!result) {
+        return std::unexpected(result.error());
+    }
+
+    return hot_loop;
+}
+
+template class BasicInterpreter<uint8_t, Overflow::Wrap, EofBehavior::Keep, TapePolicy::Growable>;
+
+namespace {
+
+template <CellWidth Width>
+using CellOf = std::conditional_t<
+    Width == CellWidth::Bits8,
+    uint8_t,
+    std::conditional_t<Width == CellWidth::Bits16, uint16_t, uint32_t>>;
+
+// Runs `interpreter` on `program`, recompiling it whenever a hot loop exits
+// and resuming after that loop in the new program. A closed form may rely
+// on what is known of cells on entry to its loop, which only holds for the
+// first iteration, hence not swapping it in mid-loop.
+template <typename Machine>
+std::expected<void, RunError> run_tiered(Machine& interpreter, Program& program, const TierUp& tier_up, uint64_t max_steps) {
+    std::set<uint32_t> hot;
+
+    // Loops past the threshold count no further, so they stop the run once.
+    uint64_t offered = tier_up.threshold + 1;
+
+    while (true) {
+        auto stop = interpreter.run_counting(tier_up.threshold, max_steps);
+        if (!stop) {
+            return std::unexpected(stop.error());
+        }
+        if (!*stop) {
+            return {};
+        }
+
+        uint32_t pos = program.ops[**stop].pos;
+        hot.insert(pos);
+        interpreter.back_edges[**stop] = offered;
+
+        auto recompiled = tier_up.recompile(hot);
+        if (!recompiled) {
+            continue;
+        }
+
+        // Where the loop ends up in the recompiled program.
+        std::optional<size_t> after;
+        std::vector<uint64_t> back_edges(recompiled->ops.size(), 0);
+
+        for (size_t i = 0; i < recompiled->ops.size(); ++i) {
+            const Op& op = recompiled->ops[i];
+            bool closed = op.kind == OpKind::Closed || op.kind == OpKind::ClosedAt;
+            bool open = op.kind == OpKind::Open || op.kind == OpKind::OpenAt;
+
+            if ((closed || open) && hot.contains(op.pos)) {
+                back_edges[i] = offered;
+            }
+            if ((closed || open) && op.pos == pos) {
+                after = closed ? i + 1 : op.arg + 1;
+            }
+        }
+
+        if (!after) {
+            continue;
+        }
+
+        program = std::move(*recompiled);
+        interpreter.back_edges = std::move(back_edges);
+        interpreter.pc = *after;
+    }
+}
+
+template <typename Machine>
+class BasicRunner : public Runner {
+private:
+    std::ispanstream in;
+    std::ostringstream out;
+    Machine interpreter;
+
+public:
+    BasicRunner(const Program& program, const Dialect& dialect) :
+        in(std::span<const char> {}),
+        interpreter(
+            program, in, out, dialect.tape == TapePolicy::Fixed ? dialect.tape_cells : 1024, dialect.huge_pages
+        ) {}
+
+    std::expected<void, RunError> run(
+        std::string_view input,
+        std::string& output,
+        uint64_t max_steps,
+        const std::atomic<bool>* timed_out
+    ) override {
+        in.clear();
+        in.span(std::span(input.data(), input.size()));
+
+        interpreter.reset();
+        interpreter.timed_out = timed_out;
+        auto result = interpreter.run(max_steps);
+
+        output = std::move(out).str();
+        return result;
+    }
+};
+
+template <typename Machine>
+class BasicSession : public Session {
+private:
+    InputQueue input;
+    std::istream in;
+    std::ostringstream out;
+    Machine interpreter;
+
+public:
+    BasicSession(const Program& program, const Dialect& dialect) :
+        in(&input),
+        interpreter(
+            program, in, out, dialect.tape == TapePolicy::Fixed ? dialect.tape_cells : 1024, dialect.huge_pages
+        ) {
+        interpreter.await_input = true;
+    }
+
+    void feed(std::string_view bytes) override {
+        input.feed(bytes);
+    }
+
+    void end_input() override {
+        input.end();
+    }
+
+    std::expected<void, RunError> resume(
+        std::string& output,
+        uint64_t max_steps,
+        const std::atomic<bool>* timed_out
+    ) override {
+        interpreter.timed_out = timed_out;
+        auto result = interpreter.run(max_steps);
+
+        output = std::move(out).str();
+        return result;
+    }
+
+    uint64_t steps() const override {
+        return interpreter.steps;
+    }
+};
+
+// Calls `f` with the one of `Values` equal to `value`, as an
+// `std::integral_constant`.
+template <auto First, auto... Rest, typename F>
+auto select(decltype(First) value, F&& f) {
+    if constexpr (sizeof...(Rest) == 0) {
+        return f(std::integral_constant<decltype(First), First> {});
+    } else {
+        if (value == First) {
+            return f(std::integral_constant<decltype(First), First> {});
+        }
+        return select<Rest...>(value, std::forward<F>(f));
+    }
+}
+
+// Calls `f` with an `std::type_identity` of the interpreter compiled for
+// `dialect`.
+template <typename F>
+auto with_machine(const Dialect& dialect, F&& f) {
+    using enum CellWidth;
+    using enum Overflow;
+    using enum EofBehavior;
+    using enum TapePolicy;
+
+    return select<Bits8, Bits16, Bits32>(dialect.cells, [&](auto width) {
+        return select<Wrap, Saturate, Trap>(dialect.overflow, [&](auto overflow) {
+            return select<Keep, Zero, MinusOne>(dialect.eof, [&](auto eof) {
+                return select<Growable, Fixed, Paged>(dialect.tape, [&](auto tape) {
+                    return f(std::type_identity<BasicInterpreter<CellOf<width()>, overflow(), eof(), tape()>> {});
+                });
+            });
+        });
+    });
+}
+
+} // namespace
+
+
+std::unique_ptr<Runner> make_runner(const Program& program, const Dialect& dialect) {
+    return with_machine(dialect, [&](auto machine) -> std::unique_ptr<Runner> {
+        return std::make_unique<BasicRunner<typename decltype(machine)::type>>(program, dialect);
+    });
+}
+
+std::unique_ptr<Session> make_session(const Program& program, const Dialect& dialect) {
+    return with_machine(dialect, [&](auto machine) -> std::unique_ptr<Session> {
+        return std::make_unique<BasicSession<typename decltype(machine)::type>>(program, dialect);
+    });
+}
+
+std::expected<void, RunError> run_dialect(
+    const Program& program,
+    const Dialect& dialect,
+    std::istream& in,
+    std::ostream& out,
+    uint64_t max_steps,
+    std::vector<uint64_t>* op_counts,
+    const TierUp* tier_up,
+    const std::atomic<bool>* timed_out
+) {
+    return with_machine(dialect, [&](auto machine) {
+        // Tiered runs swap the program they run for recompiled ones.
+        Program tiered;
+        if (tier_up) {
+            tiered = program;
+        }
+
+        typename decltype(machine)::type interpreter(
+            tier_up ? tiered : program, in, out, dialect.tape == TapePolicy::Fixed ? dialect.tape_cells : 1024,
+            dialect.huge_pages
+        );
+        interpreter.timed_out = timed_out;
+
+        if (tier_up) {
+            return run_tiered(interpreter, tiered, *tier_up, max_steps);
+        }
+
+        auto result = interpreter.run(max_steps, op_counts != nullptr);
+        if (op_counts) {
+            *op_counts = std::move(interpreter.op_counts);
+        }
+        return result;
+    });
+}
+
+} // namespace bfvm
+
+std::ostream& operator<<(std::ostream& os, bfvm::RunError error) {
+    switch (error) {
+        case bfvm::RunError::UnbalancedLoops:
+            return os << "Unbalanced loops.";
+        case bfvm::RunError::StepLimit:
+            return os << "Step limit exceeded.";
+        case bfvm::RunError::TimeLimit:
+            return os << "Time limit exceeded.";
+        case bfvm::RunError::InputWait:
+            return os << "Waiting for input.";
+        case bfvm::RunError::TapeUnderflow:
+            return os << "Pointer moved left of the tape start.";
+        case bfvm::RunError::TapeOverflow:
+            return os << "Pointer moved right of the tape end.";
+        case bfvm::RunError::CellOverflow:
+            return os << "Cell overflowed.";
+        case bfvm::RunError::OutOfMemory:
+            return os << "Can't map the tape.";
+    }
+    return os;
+}
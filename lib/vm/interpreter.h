@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "dialect.h"
+#include "paged_tape.h"
+#include "program.h"
+
+
+namespace bfvm {
+
+// An interpreter compiled for one dialect: the cell type, what cells do on
+// overflow, what `,` does at EOF and whether the tape grows are all template
+// parameters, so the run loop never branches on them.
+template <typename Cell, Overflow OverflowMode, EofBehavior Eof, TapePolicy Tape>
+class BasicInterpreter {
+public:
+    using Storage = std::conditional_t<Tape == TapePolicy::Paged, PagedTape<Cell>, std::vector<Cell>>;
+
+private:
+    const Program& program;
+    std::istream& in;
+    std::ostream& out;
+
+    // Scratch space for `Closed` ops.
+    std::vector<Cell> deltas;
+
+    // Handler of every op, when dispatch is threaded, kept across runs. It is
+    // built anew when the ops move, change in number, or are run by another
+    // instantiation of `run_impl`, as programs are only ever swapped whole.
+    std::vector<void*> threaded;
+    const Op* threaded_ops = nullptr;
+    void* const* threaded_handlers = nullptr;
+
+    // Opening op of the loop that stopped a counting run.
+    std::optional<size_t> hot_loop;
+
+    // Applies a closed form with its counter at `counter`.
+    std::expected<void, RunError> apply(const ClosedForm& form, size_t counter);
+
+    template <bool Profile, bool Count>
+    std::expected<void, RunError> run_impl(uint64_t max_steps, uint64_t threshold);
+
+    // Gets the tape ready and runs `run_impl` within its guards.
+    template <bool Profile, bool Count>
+    std::expected<void, RunError> start(uint64_t max_steps, uint64_t threshold);
+
+    static Storage make_tape(const Program& program, size_t cells, bool huge_pages) {
+        if constexpr (Tape == TapePolicy::Paged) {
+            return Storage(max_stride(program), huge_pages);
+        } else {
+            return Storage(cells);
+        }
+    }
+
+public:
+    static constexpr uint64_t UNLIMITED = std::numeric_limits<uint64_t>::max();
+
+    Storage tape;
+    size_t pointer = 0;
+    size_t pc = 0;
+    uint64_t steps = 0;
+
+    // Executions of every op of the program, filled when profiling.
+    std::vector<uint64_t> op_counts;
+
+    // Back-edges taken by every loop, at the index of its opening op, filled
+    // by `run_counting`.
+    std::vector<uint64_t> back_edges;
+
+    // Polled at back-edges when set, stopping the run with
+    // `RunError::TimeLimit` once it reads true; see `Deadline`. A `,` blocked
+    // on input is not interrupted.
+    const std::atomic<bool>* timed_out = nullptr;
+
+    // When set, `,` with no input buffered stops the run before it with
+    // `RunError::InputWait`, unless the input stream tells it has ended.
+    bool await_input = false;
+
+    // The tape starts with `cells` cells, which is all it gets when fixed.
+    // Paged tapes are as large as they get from the start, with guards wide
+    // enough for the strides of `program`.
+    BasicInterpreter(
+        const Program& program,
+        std::istream& in,
+        std::ostream& out,
+        size_t cells = 1024,
+        bool huge_pages = false
+    ) :
+        program(program),
+        in(in),
+        out(out),
+        tape(make_tape(program, cells, huge_pages)) {}
+
+    // Runs until the end of the program or until `max_steps` ops were executed
+    // in total. Steps are charged at jumps and checked at back-edges only, so
+    // a run may go past `max_steps` by less than a pass through the program.
+    // A run stopped by a limit, or awaiting input, leaves the tape, pointer
+    // and `pc` where it stopped, and another call resumes it. A run faulting
+    // in the guards of a paged tape can't tell where it stopped, and resets
+    // the interpreter instead.
+    std::expected<void, RunError> run(uint64_t max_steps = UNLIMITED, bool profile = false);
+
+    // Clears the tape and goes back to the start of the program, for the
+    // interpreter to run it anew.
+    void reset();
+
+    // Runs like `run`, counting back-edges up to `threshold`. A loop exiting
+    // with exactly that many stops the run right after it and has the index
+    // of its opening op returned, so the program can be recompiled before
+    // another call resumes the run.
+    std::expected<std::optional<size_t>, RunError> run_counting(uint64_t threshold, uint64_t max_steps = UNLIMITED);
+};
+
+// What bfasm compiles for: 8-bit wrapping cells, `,` at EOF leaving the cell
+// unchanged, and a tape growing to the right.
+using Interpreter = BasicInterpreter<uint8_t, Overflow::Wrap, EofBehavior::Keep, TapePolicy::Growable>;
+
+extern template class BasicInterpreter<uint8_t, Overflow::Wrap, EofBehavior::Keep, TapePolicy::Growable>;
+
+// Back-edges a loop takes before a tiered run recompiles it.
+constexpr uint64_t HOT_LOOP_BACK_EDGES = 1000;
+
+// How a tiered run speeds hot loops up. The run starts on a cheaply built
+// program, and once a hot loop exits, the program is swapped for `recompile`
+// of the positions (`Op::pos`) of every loop hot so far, or kept when that
+// gives nothing. A recompiled program must lay cells out as the one it
+// replaces, and keep the loop at each position.
+struct TierUp {
+    std::function<std::optional<Program>(const std::set<uint32_t>& hot)> recompile;
+    uint64_t threshold = HOT_LOOP_BACK_EDGES;
+};
+
+// An interpreter for a dialect chosen at run time, kept to run one program
+// many times over. Every run starts afresh on the tape of the previous one,
+// cleared, and reads `input` and writes `output` in memory.
+class Runner {
+public:
+    virtual ~Runner() = default;
+
+    virtual std::expected<void, RunError> run(
+        std::string_view input,
+        std::string& output,
+        uint64_t max_steps = Interpreter::UNLIMITED,
+        const std::atomic<bool>* timed_out = nullptr
+    ) = 0;
+};
+
+// A runner of `program`, which must outlive it, under `dialect`.
+std::unique_ptr<Runner> make_runner(const Program& program, const Dialect& dialect);
+
+// One run of a program, for a dialect chosen at run time, that goes on as
+// its input comes in. All it needs between calls is in the interpreter, so
+// idle sessions hold no thread, only their tape.
+class Session {
+public:
+    virtual ~Session() = default;
+
+    // Adds `input` after what was fed so far.
+    virtual void feed(std::string_view input) = 0;
+
+    // Ends the input, for `,` to read EOF past it.
+    virtual void end_input() = 0;
+
+    // Resumes the run as `BasicInterpreter::run`, stopping with
+    // `RunError::InputWait` at `,` once all input fed is read, unless input
+    // has ended. `output` gets what the run printed meanwhile.
+    virtual std::expected<void, RunError> resume(
+        std::string& output,
+        uint64_t max_steps = Interpreter::UNLIMITED,
+        const std::atomic<bool>* timed_out = nullptr
+    ) = 0;
+
+    // Steps run so far, over every call to `resume`.
+    virtual uint64_t steps() const = 0;
+};
+
+// A session running `program`, which must outlive it, under `dialect`.
+std::unique_ptr<Session> make_session(const Program& program, const Dialect& dialect);
+
+// Runs `program` in the interpreter instantiated for `dialect`, chosen once
+// up front. `op_counts`, when given, receives a profile as with
+// `BasicInterpreter::op_counts`; `tier_up`, when given, makes the run tiered;
+// `timed_out` is as `BasicInterpreter::timed_out`.
+std::expected<void, RunError> run_dialect(
+    const Program& program,
+    const Dialect& dialect,
+    std::istream& in,
+    std::ostream& out,
+    uint64_t max_steps = Interpreter::UNLIMITED,
+    std::vector<uint64_t>* op_counts = nullptr,
+    const TierUp* tier_up = nullptr,
+    const std::atomic<bool>* timed_out = nullptr
+);
+
+} // namespace bfvm
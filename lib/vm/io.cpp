@@ -0,0 +1,177 @@
+#include "io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+namespace bfvm {
+
+FdOutput::FdOutput(int fd) :
+    fd(fd),
+    line_buffered(isatty(fd)),
+    buffer(IO_BUFFER_BYTES) {
+    reset(0);
+}
+
+FdOutput::~FdOutput() {
+    drain();
+}
+
+void FdOutput::reset(size_t used) {
+    // A line-buffered put area ends where it is filled, so every byte goes
+    // through `overflow`.
+    setp(buffer.data(), buffer.data() + (line_buffered ? used : buffer.size()));
+    pbump(used);
+}
+
+bool FdOutput::drain(const char* data, size_t bytes) {
+    iovec parts[] = {
+        { pbase(), size_t(pptr() - pbase()) },
+        { const_cast<char*>(data), bytes },
+    };
+
+    reset(0);
+
+    iovec* part = parts;
+    int count = std::size(parts);
+
+    while (count > 0) {
+        if (part->iov_len == 0) {
+            ++part;
+            --count;
+            continue;
+        }
+
+        ssize_t written = writev(fd, part, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        for (size_t left = written; left > 0;) {
+            size_t step = std::min(left, part->iov_len);
+            part->iov_base = static_cast<char*>(part->iov_base) + step;
+            part->iov_len -= step;
+            left -= step;
+
+            if (part->iov_len == 0) {
+                ++part;
+                --count;
+            }
+        }
+    }
+
+    return true;
+}
+
+FdOutput::int_type FdOutput::overflow(int_type ch) {
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+        return drain() ? traits_type::not_eof(ch) : traits_type::eof();
+    }
+
+    size_t used = pptr() - pbase();
+    if (used == buffer.size()) {
+        if (!drain()) {
+            return traits_type::eof();
+        }
+        used = 0;
+    }
+
+    buffer[used++] = traits_type::to_char_type(ch);
+    reset(used);
+
+    if (line_buffered && traits_type::to_char_type(ch) == '\n' && !drain()) {
+        return traits_type::eof();
+    }
+
+    return ch;
+}
+
+std::streamsize FdOutput::xsputn(const char* data, std::streamsize count) {
+    if (line_buffered) {
+        return std::streambuf::xsputn(data, count);
+    }
+
+    if (count <= epptr() - pptr()) {
+        std::memcpy(pptr(), data, count);
+        pbump(count);
+        return count;
+    }
+
+    return drain(data, count) ? count : 0;
+}
+
+int FdOutput::sync() {
+    return drain() ? 0 : -1;
+}
+
+FdInput::FdInput(int fd) : fd(fd) {
+    struct stat info;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && offset >= 0 && info.st_size > offset) {
+        void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+
+            mapping = static_cast<char*>(mapped);
+            mapping_bytes = info.st_size;
+            setg(mapping, mapping + offset, mapping + mapping_bytes);
+            return;
+        }
+    }
+
+    buffer.resize(IO_BUFFER_BYTES);
+    setg(buffer.data(), buffer.data(), buffer.data());
+}
+
+FdInput::~FdInput() {
+    if (mapping) {
+        // Leave the descriptor where reading stopped, as `read` would have.
+        lseek(fd, gptr() - mapping, SEEK_SET);
+        munmap(mapping, mapping_bytes);
+    }
+}
+
+FdInput::int_type FdInput::underflow() {
+    if (mapping) {
+        return traits_type::eof();
+    }
+
+    ssize_t bytes;
+    do {
+        bytes = read(fd, buffer.data(), buffer.size());
+    } while (bytes < 0 && errno == EINTR);
+
+    if (bytes <= 0) {
+        return traits_type::eof();
+    }
+
+    setg(buffer.data(), buffer.data(), buffer.data() + bytes);
+    return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize InputQueue::showmanyc() {
+    return ended ? -1 : 0;
+}
+
+InputQueue::int_type InputQueue::underflow() {
+    return traits_type::eof();
+}
+
+void InputQueue::feed(std::string_view bytes) {
+    pending.erase(0, gptr() - eback());
+    pending.append(bytes);
+    setg(pending.data(), pending.data(), pending.data() + pending.size());
+}
+
+} // namespace bfvm
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace bfvm {
+
+// Bytes an `FdOutput` gathers before writing, and an `FdInput` reads at once.
+constexpr size_t IO_BUFFER_BYTES = size_t(1) << 16;
+
+// Output of a run to a file descriptor, in writes of a whole buffer. Writes
+// larger than the buffer go out in one writev together with what is
+// buffered. Terminals get a write per line instead, so interactive programs
+// show lines as they print them.
+class FdOutput : public std::streambuf {
+private:
+    int fd;
+    bool line_buffered;
+    std::vector<char> buffer;
+
+    // Makes the first `used` bytes of the buffer the pending output.
+    void reset(size_t used);
+
+    // Writes the buffer and then `bytes` of `data`; false on write errors.
+    bool drain(const char* data = nullptr, size_t bytes = 0);
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* data, std::streamsize count) override;
+    int sync() override;
+
+public:
+    explicit FdOutput(int fd);
+    ~FdOutput() override;
+
+    FdOutput(const FdOutput&) = delete;
+    FdOutput& operator=(const FdOutput&) = delete;
+};
+
+// Input of a run from a file descriptor. Regular files are mapped whole and
+// read ahead by the kernel; pipes and terminals are read a buffer at a time,
+// taking whatever is there rather than waiting for a full buffer.
+class FdInput : public std::streambuf {
+private:
+    int fd;
+    char* mapping = nullptr;
+    size_t mapping_bytes = 0;
+    std::vector<char> buffer;
+
+protected:
+    int_type underflow() override;
+
+public:
+    explicit FdInput(int fd);
+    ~FdInput() override;
+
+    FdInput(const FdInput&) = delete;
+    FdInput& operator=(const FdInput&) = delete;
+};
+
+// Input of a run fed as it comes, for runs awaiting input (see
+// `BasicInterpreter::await_input`). Once all that was fed is read, `in_avail`
+// is 0 until more is fed, and -1 once the input has ended.
+class InputQueue : public std::streambuf {
+private:
+    std::string pending;
+    bool ended = false;
+
+protected:
+    std::streamsize showmanyc() override;
+    int_type underflow() override;
+
+public:
+    // Adds `bytes` after what was fed so far, dropping what was read.
+    void feed(std::string_view bytes);
+
+    void end() {
+        ended = true;
+    }
+};
+
+} // namespace bfvm
@@ -0,0 +1,536 @@
+#include "lockstep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <expected>
+
+#include "deadline.h"
+
+
+namespace bfvm {
+
+namespace {
+
+using Lanes = Lockstep::Lanes;
+
+// Lane loops below run over the whole group, without branches, so that
+// they vectorize.
+
+void add(Lanes& cells, uint8_t delta, const Lanes& mask) {
+    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+        cells[l] += delta & mask[l];
+    }
+}
+
+void set(Lanes& cells, uint8_t value, const Lanes& mask) {
+    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+        cells[l] = (cells[l] & ~mask[l]) | (value & mask[l]);
+    }
+}
+
+// Lanes of `mask` whose cell is not zero.
+Lanes nonzero(const Lanes& cells, const Lanes& mask) {
+    Lanes result;
+    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+        result[l] = mask[l] & -(uint8_t)(cells[l] != 0);
+    }
+    return result;
+}
+
+bool any(const Lanes& mask) {
+    uint8_t seen = 0;
+    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+        seen |= mask[l];
+    }
+    return seen;
+}
+
+// Charges `count` steps to the lanes of `mask`.
+void charge(std::array<uint64_t, LOCKSTEP_LANES>& steps, uint64_t count, const Lanes& mask) {
+    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+        steps[l] += count & (uint64_t)(int64_t)(int8_t)mask[l];
+    }
+}
+
+} // namespace
+
+Lockstep::Lockstep(const Program& program, const Dialect& dialect) :
+    program(program),
+    dialect(dialect),
+    tape(dialect.tape == TapePolicy::Fixed ? dialect.tape_cells : 1024) {}
+
+bool Lockstep::reach(size_t cells) {
+    if (cells <= tape.size()) {
+        return true;
+    }
+    if (dialect.tape == TapePolicy::Fixed) {
+        return false;
+    }
+
+    tape.resize(std::max(tape.size() * 2, cells));
+    return true;
+}
+
+// Built for AVX2 as well where the loader can pick the build at run time;
+// otherwise lane loops get the vectors of the baseline, SSE2 on x86-64.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+[[gnu::target_clones("avx2", "default")]]
+#endif
+void Lockstep::run(
+    std::span<const std::string_view> inputs,
+    std::span<BatchRun> runs,
+    uint64_t max_steps,
+    const std::atomic<bool>* timed_out
+) {
+    const size_t lanes = std::min(inputs.size(), LOCKSTEP_LANES);
+    const std::atomic<bool>& deadline = timed_out ? *timed_out : NEVER_TIMED_OUT;
+
+    std::fill(tape.begin(), tape.end(), Row {});
+    pointer.fill(0);
+    uniform = true;
+    shared = 0;
+    steps.fill(0);
+    masks.clear();
+
+    std::array<size_t, LOCKSTEP_LANES> read {};
+
+    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+        alive.lanes[l] = l < lanes ? 0xff : 0;
+    }
+    for (size_t l = 0; l < lanes; ++l) {
+        runs[l].output.clear();
+        runs[l].result = {};
+    }
+
+    Lanes active = alive.lanes;
+
+    auto stop = [&](size_t l, RunError error) {
+        runs[l].result = std::unexpected(error);
+        alive.lanes[l] = 0;
+        active[l] = 0;
+    };
+
+    auto row = [&](size_t cell) -> Lanes& {
+        return tape[cell].lanes;
+    };
+
+    // Cell under the pointer of lane `l`.
+    auto at = [&](size_t l) -> uint8_t& {
+        return tape[uniform ? shared : pointer[l]].lanes[l];
+    };
+
+    // Narrows the lanes taking part down to `mask`. Lanes sitting out from
+    // now on keep their place in `pointer`.
+    auto narrow = [&](const Lanes& mask) {
+        if (mask == active) {
+            return;
+        }
+        if (uniform) {
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                pointer[l] = active[l] & ~mask[l] ? shared : pointer[l];
+            }
+        }
+        active = mask;
+    };
+
+    // Widens the lanes taking part up to `mask`, sharing their pointer again
+    // when they all have it in the same place.
+    auto widen = [&](const Lanes& mask) {
+        if (mask == active) {
+            return;
+        }
+        if (uniform) {
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                pointer[l] = active[l] ? shared : pointer[l];
+            }
+        }
+        active = mask;
+
+        size_t low = SIZE_MAX;
+        size_t high = 0;
+        for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+            low = std::min(low, active[l] ? pointer[l] : SIZE_MAX);
+            high = std::max(high, active[l] ? pointer[l] : 0);
+        }
+
+        uniform = low >= high;
+        shared = uniform ? high : shared;
+    };
+
+    // Moves the shared pointer, along with every lane taking part. The
+    // pointer stays where it was when the lanes stop, for uniform ops to
+    // keep to the tape while no lane takes part.
+    auto move_shared = [&](int64_t delta) {
+        RunError error;
+        if (delta < 0 && shared < (size_t)-delta) {
+            error = RunError::TapeUnderflow;
+        } else if (!reach(shared + delta + 1)) {
+            error = RunError::TapeOverflow;
+        } else {
+            shared += delta;
+            return true;
+        }
+
+        for (size_t l = 0; l < lanes; ++l) {
+            if (active[l]) {
+                stop(l, error);
+            }
+        }
+        return false;
+    };
+
+    auto move = [&](size_t l, int64_t delta) {
+        if (delta < 0 && pointer[l] < (size_t)-delta) {
+            stop(l, RunError::TapeUnderflow);
+            return false;
+        }
+        pointer[l] += delta;
+        if (!reach(pointer[l] + 1)) {
+            stop(l, RunError::TapeOverflow);
+            return false;
+        }
+        return true;
+    };
+
+    auto input = [&](size_t l, uint8_t& cell) {
+        if (read[l] < inputs[l].size()) {
+            cell = inputs[l][read[l]++];
+        } else if (dialect.eof == EofBehavior::Zero) {
+            cell = 0;
+        } else if (dialect.eof == EofBehavior::MinusOne) {
+            cell = 0xff;
+        }
+    };
+
+    // Whether the extent of `form` fits around `counter`, stopping lane `l`
+    // when it doesn't.
+    auto fits = [&](const ClosedForm& form, size_t counter, size_t l) {
+        if (form.min_cell < 0 && counter < (size_t)-form.min_cell) {
+            stop(l, RunError::TapeUnderflow);
+            return false;
+        }
+        if (!reach(counter + form.max_cell + 1)) {
+            stop(l, RunError::TapeOverflow);
+            return false;
+        }
+        return true;
+    };
+
+    // Closed forms take factors at their entry values, as in
+    // `BasicInterpreter::apply`.
+    std::vector<Lanes> deltas;
+
+    auto closed_at = [&](const ClosedForm& form, size_t counter) {
+        for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+            if (active[l]) {
+                fits(form, counter, l);
+            }
+        }
+        if (!any(active)) {
+            return;
+        }
+
+        deltas.assign(form.updates.size(), Lanes {});
+        for (size_t i = 0; i < form.updates.size(); ++i) {
+            for (const auto& term : form.updates[i].terms) {
+                Lanes product;
+                product.fill(term.coefficient);
+                for (int32_t factor : term.factors) {
+                    const Lanes& cells = row(counter + factor);
+                    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                        product[l] *= cells[l];
+                    }
+                }
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    deltas[i][l] += product[l];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < form.updates.size(); ++i) {
+            Lanes& cells = row(counter + form.updates[i].cell);
+            for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                cells[l] += deltas[i][l] & active[l];
+            }
+        }
+        set(row(counter), 0, active);
+    };
+
+    auto closed = [&](const ClosedForm& form, size_t l) {
+        size_t counter = pointer[l];
+        if (!fits(form, counter, l)) {
+            return;
+        }
+
+        std::vector<uint8_t> lane_deltas(form.updates.size());
+        for (size_t i = 0; i < form.updates.size(); ++i) {
+            for (const auto& term : form.updates[i].terms) {
+                uint8_t product = term.coefficient;
+                for (int32_t factor : term.factors) {
+                    product *= tape[counter + factor].lanes[l];
+                }
+                lane_deltas[i] += product;
+            }
+        }
+
+        for (size_t i = 0; i < form.updates.size(); ++i) {
+            tape[counter + form.updates[i].cell].lanes[l] += lane_deltas[i];
+        }
+        tape[counter].lanes[l] = 0;
+    };
+
+    if (!reach(program.tape_size)) {
+        for (size_t l = 0; l < lanes; ++l) {
+            stop(l, RunError::TapeOverflow);
+        }
+        return;
+    }
+
+    const Op* ops = program.ops.data();
+    const size_t size = program.ops.size();
+
+    // First op not yet charged to the steps of the lanes taking part.
+    size_t pc = 0;
+    size_t mark = 0;
+    const bool counting = max_steps != Interpreter::UNLIMITED;
+
+    // Lanes at `[` with a nonzero cell enter the loop; the rest wait for it
+    // to end, skipping it along with the others when none enters.
+    auto open = [&](const Lanes& entering) {
+        if (counting) {
+            charge(steps, pc + 1 - mark, active);
+        }
+        mark = pc + 1;
+
+        if (!any(entering)) {
+            pc = ops[pc].arg;
+            mark = pc + 1;
+            return;
+        }
+
+        masks.push_back(Row { active });
+        narrow(entering);
+    };
+
+    // Lanes at `]` with a nonzero cell go round again, and the loop ends
+    // once none does. Past the deadline, lanes going round stop there, as
+    // they would alone, while lanes waiting for the loop to end go on.
+    auto close = [&](const Lanes& staying) {
+        if (counting) {
+            charge(steps, pc + 1 - mark, active);
+        }
+        mark = pc + 1;
+
+        if (any(staying)) {
+            narrow(staying);
+
+            if (counting) {
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l] && steps[l] >= max_steps) {
+                        stop(l, RunError::StepLimit);
+                    }
+                }
+            }
+
+            if (deadline.load(std::memory_order_relaxed)) {
+                for (size_t l = 0; l < lanes; ++l) {
+                    if (active[l]) {
+                        stop(l, RunError::TimeLimit);
+                    }
+                }
+            }
+
+            if (any(active)) {
+                pc = ops[pc].arg;
+                mark = pc + 1;
+                return;
+            }
+        }
+
+        Lanes restored;
+        for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+            restored[l] = masks.back().lanes[l] & alive.lanes[l];
+        }
+        masks.pop_back();
+        widen(restored);
+    };
+
+    for (; pc < size; ++pc) {
+        const Op& op = ops[pc];
+
+        switch (op.kind) {
+            case OpKind::Add:
+                if (uniform) {
+                    add(row(shared), op.arg, active);
+                    break;
+                }
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        at(l) += op.arg;
+                    }
+                }
+                break;
+
+            case OpKind::Move:
+                if (uniform) {
+                    move_shared(op.arg);
+                    break;
+                }
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        move(l, op.arg);
+                    }
+                }
+                break;
+
+            case OpKind::Open: {
+                if (uniform) {
+                    open(nonzero(row(shared), active));
+                    break;
+                }
+                Lanes entering;
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    entering[l] = active[l] && at(l) ? 0xff : 0;
+                }
+                open(entering);
+                break;
+            }
+
+            case OpKind::Close: {
+                Lanes staying;
+                if (uniform) {
+                    staying = nonzero(row(shared), active);
+                } else {
+                    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                        staying[l] = active[l] && at(l) ? 0xff : 0;
+                    }
+                }
+                close(staying);
+                break;
+            }
+
+            case OpKind::Out:
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        runs[l].output.push_back(at(l));
+                    }
+                }
+                break;
+
+            case OpKind::In:
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        input(l, at(l));
+                    }
+                }
+                break;
+
+            case OpKind::Closed:
+                if (uniform) {
+                    closed_at(program.closed_forms[op.arg], shared);
+                    break;
+                }
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        closed(program.closed_forms[op.arg], l);
+                    }
+                }
+                break;
+
+            case OpKind::AddAt:
+                add(row(op.cell), op.arg, active);
+                break;
+
+            case OpKind::OpenAt:
+                open(nonzero(row(op.cell), active));
+                break;
+
+            case OpKind::CloseAt:
+                close(nonzero(row(op.cell), active));
+                break;
+
+            case OpKind::OutAt:
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        runs[l].output.push_back(row(op.cell)[l]);
+                    }
+                }
+                break;
+
+            case OpKind::InAt:
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        input(l, row(op.cell)[l]);
+                    }
+                }
+                break;
+
+            case OpKind::ClosedAt:
+                closed_at(program.closed_forms[op.arg], op.cell);
+                break;
+
+            case OpKind::Seek:
+                uniform = true;
+                shared = op.cell;
+                break;
+
+            case OpKind::MoveAdd:
+                if (uniform) {
+                    if (move_shared(op.arg)) {
+                        add(row(shared), op.value, active);
+                    }
+                    break;
+                }
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l] && move(l, op.arg)) {
+                        at(l) += op.value;
+                    }
+                }
+                break;
+
+            case OpKind::AddClose: {
+                Lanes staying;
+                if (uniform) {
+                    Lanes& cells = row(shared);
+                    add(cells, op.value, active);
+                    staying = nonzero(cells, active);
+                } else {
+                    for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                        if (active[l]) {
+                            at(l) += op.value;
+                        }
+                        staying[l] = active[l] && at(l) ? 0xff : 0;
+                    }
+                }
+                close(staying);
+                break;
+            }
+
+            case OpKind::Set:
+                if (uniform) {
+                    set(row(shared), op.value, active);
+                    break;
+                }
+                for (size_t l = 0; l < LOCKSTEP_LANES; ++l) {
+                    if (active[l]) {
+                        at(l) = op.value;
+                    }
+                }
+                break;
+
+            case OpKind::AddCloseAt: {
+                Lanes& cells = row(op.cell);
+                add(cells, op.value, active);
+                close(nonzero(cells, active));
+                break;
+            }
+
+            case OpKind::SetAt:
+                set(row(op.cell), op.value, active);
+                break;
+        }
+    }
+}
+
+} // namespace bfvm
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "batch.h"
+#include "dialect.h"
+#include "interpreter.h"
+#include "program.h"
+
+
+namespace bfvm {
+
+// Inputs a lockstep group runs at once: a 256-bit vector of byte cells.
+constexpr size_t LOCKSTEP_LANES = 32;
+
+// Runs one program on up to `LOCKSTEP_LANES` inputs at once, every op going
+// over the whole group. Cell `c` of every lane sits in row `c` of the tape,
+// so label-addressed ops work on a row at a time, which compilers turn into
+// vector instructions. Lanes whose loop has ended, or that skipped it, are
+// masked off until the loop ends for all of them. Cells are 8-bit and wrap;
+// paged tapes run as growable ones.
+class Lockstep {
+public:
+    using Lanes = std::array<uint8_t, LOCKSTEP_LANES>;
+
+private:
+    // Row of byte cells, or of masks that are 0xff for lanes taking part.
+    struct alignas(LOCKSTEP_LANES) Row {
+        Lanes lanes;
+    };
+
+    const Program& program;
+    Dialect dialect;
+
+    std::vector<Row> tape;
+
+    // The pointer of every lane, or, while they are `uniform`, `shared` for
+    // the lanes taking part, so that pointer-relative ops work on a row too.
+    // Lanes sitting out keep theirs in `pointer` all along.
+    std::array<size_t, LOCKSTEP_LANES> pointer;
+    bool uniform = true;
+    size_t shared = 0;
+
+    std::array<uint64_t, LOCKSTEP_LANES> steps;
+
+    // Lanes not stopped by an error, and masks to restore as loops end.
+    Row alive;
+    std::vector<Row> masks;
+
+    // Makes the tape hold `cells` cells; false when it can't.
+    bool reach(size_t cells);
+
+public:
+    Lockstep(const Program& program, const Dialect& dialect);
+
+    // Runs the program on every one of `inputs`, at most `LOCKSTEP_LANES`,
+    // into the run of the same index. Steps are counted for every lane as
+    // they would be alone.
+    void run(
+        std::span<const std::string_view> inputs,
+        std::span<BatchRun> runs,
+        uint64_t max_steps = Interpreter::UNLIMITED,
+        const std::atomic<bool>* timed_out = nullptr
+    );
+};
+
+} // namespace bfvm
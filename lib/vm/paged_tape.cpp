@@ -0,0 +1,132 @@
+#include "paged_tape.h"
+
+#include <csetjmp>
+#include <csignal>
+#include <cstddef>
+#include <mutex>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+namespace bfvm {
+
+namespace {
+
+size_t round_to_pages(size_t bytes) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+// The guarded run of this thread, if any.
+struct ActiveGuard {
+    const PagedRegion* region = nullptr;
+    sigjmp_buf* jump = nullptr;
+    PagedRegion::Fault fault = PagedRegion::Fault::None;
+};
+
+thread_local ActiveGuard active;
+
+struct sigaction previous_action;
+
+void on_fault(int signal, siginfo_t* info, void* context) {
+    if (active.region) {
+        auto fault = active.region->classify(info->si_addr);
+        if (fault != PagedRegion::Fault::None) {
+            active.fault = fault;
+            siglongjmp(*active.jump, 1);
+        }
+    }
+
+    // Not ours: hand the fault to whoever had it before.
+    if (previous_action.sa_flags & SA_SIGINFO) {
+        previous_action.sa_sigaction(signal, info, context);
+    } else if (previous_action.sa_handler != SIG_IGN && previous_action.sa_handler != SIG_DFL) {
+        previous_action.sa_handler(signal);
+    } else {
+        // Returning retries the access, which now gets the default action.
+        sigaction(SIGSEGV, &previous_action, nullptr);
+    }
+}
+
+void install_handler() {
+    static std::once_flag installed;
+
+    std::call_once(installed, [] {
+        struct sigaction action {};
+        action.sa_sigaction = on_fault;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_action);
+    });
+}
+
+} // namespace
+
+
+PagedRegion::PagedRegion(size_t bytes, size_t guard_bytes, bool huge_pages) {
+    bytes = round_to_pages(bytes);
+    guard_bytes = round_to_pages(guard_bytes + 1);
+    mapping_bytes = bytes + 2 * guard_bytes;
+
+    void* mapped = mmap(nullptr, mapping_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return;
+    }
+
+    mapping = static_cast<std::byte*>(mapped);
+
+    if (mprotect(mapping + guard_bytes, bytes, PROT_READ | PROT_WRITE) != 0) {
+        return;
+    }
+
+    if (huge_pages) {
+        madvise(mapping + guard_bytes, bytes, MADV_HUGEPAGE);
+    }
+
+    begin = mapping + guard_bytes;
+    this->bytes = bytes;
+}
+
+PagedRegion::~PagedRegion() {
+    if (mapping) {
+        munmap(mapping, mapping_bytes);
+    }
+}
+
+void PagedRegion::clear() const {
+    if (begin) {
+        madvise(begin, bytes, MADV_DONTNEED);
+    }
+}
+
+PagedRegion::Fault PagedRegion::classify(const void* address) const {
+    auto byte = static_cast<const std::byte*>(address);
+
+    if (byte >= mapping && byte < begin) {
+        return Fault::Below;
+    }
+    if (byte >= begin + bytes && byte < mapping + mapping_bytes) {
+        return Fault::Above;
+    }
+    return Fault::None;
+}
+
+PagedRegion::Fault PagedRegion::guard(void (*body)(void*), void* context) const {
+    install_handler();
+
+    sigjmp_buf jump;
+    ActiveGuard outer = active;
+    active = ActiveGuard { this, &jump, Fault::None };
+
+    if (sigsetjmp(jump, 1) == 0) {
+        body(context);
+    }
+
+    Fault fault = active.fault;
+    active = outer;
+
+    return fault;
+}
+
+} // namespace bfvm
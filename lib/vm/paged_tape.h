@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace bfvm {
+
+// Cells a paged tape reserves address space for.
+constexpr size_t PAGED_TAPE_CELLS = size_t(1) << 30;
+
+// An anonymous mapping of `bytes` between two inaccessible guards. The
+// kernel commits its pages on first touch, so untouched cells cost nothing.
+class PagedRegion {
+private:
+    std::byte* mapping = nullptr;
+    size_t mapping_bytes = 0;
+
+    std::byte* begin = nullptr;
+    size_t bytes = 0;
+
+public:
+    // Which guard an address falls into.
+    enum class Fault {
+        None,
+        Below,
+        Above,
+    };
+
+    // With `huge_pages`, the kernel is asked to back the region with
+    // transparent huge pages, which saves TLB misses on spread-out cells.
+    PagedRegion(size_t bytes, size_t guard_bytes, bool huge_pages);
+    ~PagedRegion();
+
+    PagedRegion(const PagedRegion&) = delete;
+    PagedRegion& operator=(const PagedRegion&) = delete;
+
+    // Whether the mapping could be made.
+    bool valid() const {
+        return begin != nullptr;
+    }
+
+    std::byte* data() const {
+        return begin;
+    }
+
+    // Zeroes the region by giving its pages back to the kernel.
+    void clear() const;
+
+    Fault classify(const void* address) const;
+
+    // Runs `body(context)`, turning a segmentation fault in a guard into an
+    // early return of the guard it hit. The fault unwinds `body` without
+    // running destructors, so it must not own anything.
+    Fault guard(void (*body)(void*), void* context) const;
+
+    template <typename F>
+    Fault guard(F& body) const {
+        return guard([](void* context) { (*static_cast<F*>(context))(); }, &body);
+    }
+};
+
+// A tape of `PAGED_TAPE_CELLS` cells in a `PagedRegion`.
+template <typename Cell>
+class PagedTape {
+private:
+    PagedRegion region;
+
+public:
+    // Accesses may land up to `guard_cells` cells past either end.
+    PagedTape(size_t guard_cells, bool huge_pages) :
+        region(PAGED_TAPE_CELLS * sizeof(Cell), guard_cells * sizeof(Cell), huge_pages) {}
+
+    const PagedRegion& pages() const {
+        return region;
+    }
+
+    Cell* data() const {
+        return reinterpret_cast<Cell*>(region.data());
+    }
+
+    size_t size() const {
+        return region.valid() ? PAGED_TAPE_CELLS : 0;
+    }
+
+    Cell& operator[](size_t cell) const {
+        return data()[cell];
+    }
+};
+
+} // namespace bfvm
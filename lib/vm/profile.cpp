@@ -0,0 +1,132 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+
+namespace bfvm {
+
+using bfasm::compiler::Frame;
+using bfasm::compiler::Origin;
+
+
+Profile::Profile(const Program& program, const std::vector<uint64_t>& op_counts, const bfasm::compiler::SourceMap& map) :
+    map(map),
+    origin_counts(map.origins.size()),
+    frame_counts(map.frames.size()) {
+    for (size_t i = 0; i < program.ops.size(); ++i) {
+        size_t origin = map.code_origins[program.ops[i].pos];
+
+        origin_counts[origin] += op_counts[i];
+        frame_counts[map.origins[origin].frame] += op_counts[i];
+        total += op_counts[i];
+    }
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+void Profile::write_flat(std::ostream& os) const {
+    std::map<std::string_view, std::pair<uint64_t, uint64_t>> macros;
+
+    for (size_t frame = 0; frame < map.frames.size(); ++frame) {
+        if (!frame_counts[frame]) {
+            continue;
+        }
+
+        macros[map.frames[frame].macro].first += frame_counts[frame];
+
+        // A macro appearing twice in one USE chain is only charged once.
+        std::set<std::string_view> seen;
+        for (std::string_view macro : map.stack(frame)) {
+            if (seen.insert(macro).second) {
+                macros[macro].second += frame_counts[frame];
+            }
+        }
+    }
+
+    std::vector<std::tuple<uint64_t, uint64_t, std::string_view>> rows;
+    for (const auto& [macro, counts] : macros) {
+        rows.emplace_back(counts.first, counts.second, macro);
+    }
+    std::sort(rows.rbegin(), rows.rend());
+
+    char line[256];
+
+    os << "Flat profile (" << total << " executed ops):\n";
+    std::snprintf(line, sizeof(line), "  %14s %7s %14s %7s  %s\n", "self", "%", "inclusive", "%", "macro");
+    os << line;
+
+    for (const auto& [self, inclusive, macro] : rows) {
+        std::snprintf(
+            line, sizeof(line), "  %14llu %6.2f%% %14llu %6.2f%%  %.*s\n",
+            (unsigned long long)self, percent(self, total),
+            (unsigned long long)inclusive, percent(inclusive, total),
+            (int)macro.size(), macro.data()
+        );
+        os << line;
+    }
+
+    std::map<std::pair<std::string_view, size_t>, uint64_t> lines;
+    for (size_t origin = 0; origin < map.origins.size(); ++origin) {
+        if (!origin_counts[origin]) {
+            continue;
+        }
+
+        const Origin& o = map.origins[origin];
+        lines[{map.frames[o.frame].macro, o.pos.line}] += origin_counts[origin];
+    }
+
+    std::vector<std::tuple<uint64_t, std::string_view, size_t>> line_rows;
+    for (const auto& [key, count] : lines) {
+        line_rows.emplace_back(count, key.first, key.second);
+    }
+    std::sort(line_rows.rbegin(), line_rows.rend());
+
+    os << "\nLines:\n";
+    std::snprintf(line, sizeof(line), "  %14s %7s  %s\n", "self", "%", "macro:line");
+    os << line;
+
+    for (const auto& [count, macro, source_line] : line_rows) {
+        std::string where = std::string(macro) + ':';
+        where += source_line == bfasm::parse::Position::END.line ? "-" : std::to_string(source_line);
+
+        std::snprintf(
+            line, sizeof(line), "  %14llu %6.2f%%  %s\n",
+            (unsigned long long)count, percent(count, total), where.c_str()
+        );
+        os << line;
+    }
+}
+
+void Profile::write_folded(std::ostream& os) const {
+    std::map<std::string, uint64_t> stacks;
+
+    for (size_t frame = 0; frame < map.frames.size(); ++frame) {
+        if (!frame_counts[frame]) {
+            continue;
+        }
+
+        std::string stack;
+        for (std::string_view macro : map.stack(frame)) {
+            if (!stack.empty()) {
+                stack += ';';
+            }
+            stack += macro;
+        }
+
+        stacks[stack] += frame_counts[frame];
+    }
+
+    for (const auto& [stack, count] : stacks) {
+        os << stack << ' ' << count << '\n';
+    }
+}
+
+} // namespace bfvm
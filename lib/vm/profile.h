@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "../asm/source_map.h"
+#include "program.h"
+
+
+namespace bfvm {
+
+// Executed-op counts of a profiling run attributed to bfasm origins through
+// the compiler's source map.
+class Profile {
+private:
+    const bfasm::compiler::SourceMap& map;
+
+    std::vector<uint64_t> origin_counts;
+    std::vector<uint64_t> frame_counts;
+    uint64_t total = 0;
+
+public:
+    // `op_counts` come from `Interpreter::run` over `program`, which must have
+    // been loaded from the code `map` describes.
+    Profile(const Program& program, const std::vector<uint64_t>& op_counts, const bfasm::compiler::SourceMap& map);
+
+    // Self and inclusive counts per macro, then self counts per source line.
+    void write_flat(std::ostream& os) const;
+
+    // One `main;macro;...;macro <count>` line per USE chain, as consumed by
+    // flamegraph.pl and compatible tools.
+    void write_folded(std::ostream& os) const;
+};
+
+} // namespace bfvm
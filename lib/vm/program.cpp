@@ -0,0 +1,523 @@
+#include "program.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+
+namespace bfvm {
+
+namespace {
+
+// `loop` with cells relative to its counter under the layout of `code`.
+ClosedForm place(const bflabels::ClosedLoop& loop, const bflabels::BFLCode& code) {
+    int64_t counter = code.offset(loop.counter);
+    ClosedForm form;
+
+    auto relative = [&](bflabels::Label label) {
+        int32_t cell = code.offset(label) - counter;
+        form.min_cell = std::min(form.min_cell, cell);
+        form.max_cell = std::max(form.max_cell, cell);
+        return cell;
+    };
+
+    for (const auto& update : loop.updates) {
+        ClosedForm::Update placed { relative(update.cell), {} };
+
+        for (const auto& term : update.terms) {
+            ClosedForm::Term placed_term { term.coefficient, {} };
+            for (auto factor : term.factors) {
+                placed_term.factors.push_back(relative(factor));
+            }
+            placed.terms.push_back(std::move(placed_term));
+        }
+
+        form.updates.push_back(std::move(placed));
+    }
+
+    return form;
+}
+
+// Whether `ops[i..]` is a `[-]`-like loop on one cell: one odd step, which
+// reaches zero from any value.
+bool is_clear(const std::vector<Op>& ops, size_t i) {
+    if (i + 2 >= ops.size() || ops[i + 1].arg % 2 == 0) {
+        return false;
+    }
+
+    if (ops[i].kind == OpKind::Open) {
+        return ops[i + 1].kind == OpKind::Add && ops[i + 2].kind == OpKind::Close;
+    }
+
+    return ops[i].kind == OpKind::OpenAt && ops[i + 1].kind == OpKind::AddAt && ops[i + 2].kind == OpKind::CloseAt
+        && ops[i + 1].cell == ops[i].cell && ops[i + 2].cell == ops[i].cell;
+}
+
+// Whether a cell delta fits `Op::value`.
+bool fits_value(int32_t delta) {
+    return delta >= INT8_MIN && delta <= INT8_MAX;
+}
+
+// Replaces hot op pairs by superinstructions (see `OpKind::MoveAdd`). Jumps
+// only ever land on the last op of a fused sequence, so they keep working
+// when retargeted to the superinstruction.
+void fuse(std::vector<Op>& ops) {
+    std::vector<Op> fused;
+    std::vector<size_t> index(ops.size());
+
+    for (size_t i = 0; i < ops.size();) {
+        Op op = ops[i];
+        size_t length = 1;
+
+        if (is_clear(ops, i)) {
+            op.kind = op.kind == OpKind::Open ? OpKind::Set : OpKind::SetAt;
+            length = 3;
+
+            OpKind add = op.kind == OpKind::Set ? OpKind::Add : OpKind::AddAt;
+            if (i + 3 < ops.size() && ops[i + 3].kind == add && ops[i + 3].cell == op.cell && fits_value(ops[i + 3].arg)) {
+                op.value = ops[i + 3].arg;
+                length = 4;
+            }
+        } else if (i + 1 < ops.size() && fits_value(op.kind == OpKind::Move ? ops[i + 1].arg : op.arg)) {
+            const Op& next = ops[i + 1];
+
+            if (op.kind == OpKind::Move && next.kind == OpKind::Add) {
+                op.kind = OpKind::MoveAdd;
+                op.value = next.arg;
+                length = 2;
+            } else if (op.kind == OpKind::Add && next.kind == OpKind::Close) {
+                op = Op { OpKind::AddClose, next.arg, op.pos };
+                op.value = ops[i].arg;
+                length = 2;
+            } else if (op.kind == OpKind::AddAt && next.kind == OpKind::CloseAt && next.cell == op.cell) {
+                op = Op { OpKind::AddCloseAt, next.arg, op.pos, op.cell };
+                op.value = ops[i].arg;
+                length = 2;
+            }
+        }
+
+        for (size_t j = i; j < i + length; ++j) {
+            index[j] = fused.size();
+        }
+
+        fused.push_back(op);
+        i += length;
+    }
+
+    for (Op& op : fused) {
+        switch (op.kind) {
+            case OpKind::Open:
+            case OpKind::Close:
+            case OpKind::OpenAt:
+            case OpKind::CloseAt:
+            case OpKind::AddClose:
+            case OpKind::AddCloseAt:
+                op.arg = index[op.arg];
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    ops = std::move(fused);
+}
+
+// Lowers labels to absolute addresses (see `Program::from_labels`).
+//
+// Brainfuck leaves the pointer on the cell of a loop's `[` when the loop is
+// skipped, and on the cell of its `]` otherwise, so a loop whose brackets are
+// on different cells is lowered as drifting: the pointer is sought to its
+// cells around both brackets, and its body up to the first label and
+// everything after it up to the next one use the pointer.
+class LabelLowering {
+private:
+    const std::vector<bflabels::Token>& tokens;
+    const bflabels::BFLCode& code;
+    const bflabels::ClosedLoops& closed;
+    const std::set<size_t>& drifting;
+
+    Program program;
+
+    // Address of the current cell, unknown where ops must use the pointer,
+    // and of the last label, where `BFLCode::compile` leaves the pointer.
+    std::optional<uint32_t> cell;
+    uint32_t last = 0;
+
+    // Whether the previous op was folded into `program.ops.back()`.
+    bool in_run = false;
+
+    struct OpenLoop {
+        size_t op;
+        size_t token;
+        std::optional<uint32_t> cell;
+    };
+
+    std::vector<OpenLoop> open_loops;
+
+    void push(OpKind relative, OpKind at, int32_t arg, uint32_t pos) {
+        program.ops.push_back(cell ? Op { at, arg, pos, *cell } : Op { relative, arg, pos });
+    }
+
+    // Makes the pointer physical before ops that use it.
+    void seek(uint32_t pos) {
+        if (cell) {
+            program.ops.push_back(Op { OpKind::Seek, 0, pos, *cell });
+        }
+    }
+
+    void fold(OpKind relative, OpKind at, int32_t delta, uint32_t pos) {
+        if (in_run && program.ops.back().kind == (cell ? at : relative)) {
+            program.ops.back().arg += delta;
+        } else {
+            push(relative, at, delta, pos);
+        }
+        in_run = true;
+    }
+
+    // Index of the `]` matching the `[` at `open`, or `tokens.size()`.
+    size_t match(size_t open) const {
+        size_t i = open;
+        for (size_t depth = 0; i < tokens.size(); ++i) {
+            depth += tokens[i] == bflabels::Token('[');
+            depth -= tokens[i] == bflabels::Token(']');
+            if (tokens[i] == bflabels::Token(']') && depth == 0) {
+                break;
+            }
+        }
+        return i;
+    }
+
+    // Whether the closed loop at `open` starts and ends on its counter, so
+    // skipping its body leaves the pointer where running it would.
+    bool ends_on_counter(size_t open, const bflabels::ClosedLoop& loop) const {
+        int64_t counter = code.offset(loop.counter);
+        if (cell != counter) {
+            return false;
+        }
+
+        size_t close = match(open);
+        if (close == tokens.size()) {
+            return false;
+        }
+
+        for (size_t i = close; i > open; --i) {
+            if (const bflabels::Label* label = std::get_if<bflabels::Label>(&tokens[i])) {
+                return code.offset(*label) == counter;
+            }
+        }
+        return true;
+    }
+
+    std::expected<void, RunError> operation(size_t& i, bflabels::Operation op) {
+        uint32_t pos = i;
+
+        switch (op) {
+            case '+':
+            case '-':
+                fold(OpKind::Add, OpKind::AddAt, op == '+' ? 1 : -1, pos);
+                return {};
+
+            case '<':
+            case '>':
+                if (cell) {
+                    program.ops.push_back(Op { OpKind::Seek, 0, pos, last });
+                    cell = std::nullopt;
+                    in_run = false;
+                }
+                fold(OpKind::Move, OpKind::Move, op == '>' ? 1 : -1, pos);
+                return {};
+
+            case '[':
+                if (auto loop = closed.find(i); loop != closed.end() && ends_on_counter(i, loop->second)) {
+                    program.ops.push_back(Op { OpKind::ClosedAt, (int32_t)program.closed_forms.size(), pos, *cell });
+                    program.closed_forms.push_back(place(loop->second, code));
+
+                    // Skip the loop body, which leaves the pointer on the counter.
+                    i = match(i);
+                    last = *cell;
+                    break;
+                }
+
+                if (drifting.contains(i)) {
+                    seek(pos);
+                }
+
+                open_loops.push_back(OpenLoop { program.ops.size(), i, cell });
+                push(OpKind::Open, OpKind::OpenAt, 0, pos);
+
+                if (drifting.contains(i)) {
+                    cell = std::nullopt;
+                }
+                break;
+
+            case ']': {
+                if (open_loops.empty()) {
+                    return std::unexpected(RunError::UnbalancedLoops);
+                }
+
+                OpenLoop open = open_loops.back();
+                open_loops.pop_back();
+
+                if (drifting.contains(open.token)) {
+                    seek(pos);
+                } else if (cell != open.cell && !found) {
+                    found = open.token;
+                }
+
+                program.ops[open.op].arg = program.ops.size();
+                push(OpKind::Close, OpKind::CloseAt, (int32_t)open.op, pos);
+
+                if (drifting.contains(open.token)) {
+                    cell = std::nullopt;
+                }
+                break;
+            }
+
+            case '.':
+                push(OpKind::Out, OpKind::OutAt, 0, pos);
+                break;
+
+            case ',':
+                push(OpKind::In, OpKind::InAt, 0, pos);
+                break;
+        }
+
+        in_run = false;
+        return {};
+    }
+
+public:
+    // The `[` of a loop found to drift, which must be lowered again.
+    std::optional<size_t> found;
+
+    LabelLowering(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::BFLCode& code,
+        const bflabels::ClosedLoops& closed,
+        const std::set<size_t>& drifting
+    ) :
+        tokens(tokens),
+        code(code),
+        closed(closed),
+        drifting(drifting) {}
+
+    std::expected<Program, RunError> lower() {
+        const auto& extents = code.memory_layout().label_extents;
+
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (const bflabels::Label* label = std::get_if<bflabels::Label>(&tokens[i])) {
+                int64_t offset = code.offset(*label);
+                if (offset < 0) {
+                    return std::unexpected(RunError::TapeUnderflow);
+                }
+
+                size_t size = offset + 1;
+                if (auto extent = extents.find(*label); extent != extents.end()) {
+                    size = std::max<size_t>(size, code.offset(bflabels::Label { label->label_idx, 0 }) + extent->second);
+                }
+                program.tape_size = std::max(program.tape_size, size);
+
+                // Switching labels costs nothing, so runs on one cell go on.
+                if (cell != offset) {
+                    in_run = false;
+                }
+                cell = last = offset;
+            } else if (const bflabels::Operation* op = std::get_if<bflabels::Operation>(&tokens[i])) {
+                auto result = operation(i, *op);
+                if (!result) {
+                    return std::unexpected(result.error());
+                }
+            }
+        }
+
+        if (!open_loops.empty()) {
+            return std::unexpected(RunError::UnbalancedLoops);
+        }
+
+        fuse(program.ops);
+
+        return std::move(program);
+    }
+};
+
+} // namespace
+
+
+std::expected<Program, RunError> Program::from_bf(std::string_view code, bool fold, const ClosedForms& closed) {
+    Program program;
+    std::vector<size_t> open_loops;
+
+    // Whether the previous command was folded into `program.ops.back()`.
+    bool in_run = false;
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        uint32_t pos = i;
+
+        switch (code[i]) {
+            case '+':
+            case '-':
+            case '<':
+            case '>': {
+                OpKind kind = (code[i] == '<' || code[i] == '>') ? OpKind::Move : OpKind::Add;
+                int32_t delta = (code[i] == '+' || code[i] == '>') ? 1 : -1;
+
+                if (fold && in_run && program.ops.back().kind == kind) {
+                    program.ops.back().arg += delta;
+                } else {
+                    program.ops.push_back(Op { kind, delta, pos });
+                }
+
+                in_run = true;
+                continue;
+            }
+
+            case '[':
+                if (auto form = closed.find(i); form != closed.end()) {
+                    program.ops.push_back(Op { OpKind::Closed, (int32_t)program.closed_forms.size(), pos });
+                    program.closed_forms.push_back(form->second);
+
+                    // Skip the loop body; it is balanced by construction.
+                    for (size_t depth = 0; i < code.size(); ++i) {
+                        depth += code[i] == '[';
+                        depth -= code[i] == ']';
+                        if (code[i] == ']' && depth == 0) {
+                            break;
+                        }
+                    }
+
+                    if (i == code.size()) {
+                        return std::unexpected(RunError::UnbalancedLoops);
+                    }
+                    break;
+                }
+
+                open_loops.push_back(program.ops.size());
+                program.ops.push_back(Op { OpKind::Open, 0, pos });
+                break;
+
+            case ']': {
+                if (open_loops.empty()) {
+                    return std::unexpected(RunError::UnbalancedLoops);
+                }
+
+                size_t open = open_loops.back();
+                open_loops.pop_back();
+
+                program.ops[open].arg = program.ops.size();
+                program.ops.push_back(Op { OpKind::Close, (int32_t)open, pos });
+                break;
+            }
+
+            case '.':
+                program.ops.push_back(Op { OpKind::Out, 0, pos });
+                break;
+
+            case ',':
+                program.ops.push_back(Op { OpKind::In, 0, pos });
+                break;
+
+            default:
+                continue;
+        }
+
+        in_run = false;
+    }
+
+    if (!open_loops.empty()) {
+        return std::unexpected(RunError::UnbalancedLoops);
+    }
+
+    if (fold) {
+        fuse(program.ops);
+    }
+
+    return program;
+}
+
+std::expected<Program, RunError> Program::from_labels(
+    const std::vector<bflabels::Token>& tokens,
+    const bflabels::BFLCode& code,
+    const bflabels::ClosedLoops& closed
+) {
+    std::set<size_t> drifting;
+
+    while (true) {
+        LabelLowering lowering(tokens, code, closed, drifting);
+        auto program = lowering.lower();
+
+        if (!lowering.found) {
+            return program;
+        }
+
+        drifting.insert(*lowering.found);
+    }
+}
+
+size_t max_stride(const Program& program) {
+    size_t stride = 0;
+
+    // Distance moved since the pointer last used a cell.
+    size_t moved = 0;
+
+    for (const Op& op : program.ops) {
+        switch (op.kind) {
+            case OpKind::Move:
+                moved += std::abs((int64_t)op.arg);
+                stride = std::max(stride, moved);
+                break;
+
+            case OpKind::MoveAdd:
+                stride = std::max(stride, moved + std::abs((int64_t)op.arg));
+                moved = 0;
+                break;
+
+            // Label-addressed ops leave the pointer be. Closed forms check
+            // the cells they use.
+            case OpKind::ClosedAt:
+            case OpKind::AddAt:
+            case OpKind::OpenAt:
+            case OpKind::CloseAt:
+            case OpKind::OutAt:
+            case OpKind::InAt:
+            case OpKind::AddCloseAt:
+            case OpKind::SetAt:
+                break;
+
+            default:
+                moved = 0;
+                break;
+        }
+    }
+
+    return stride;
+}
+
+ClosedForms place_closed_loops(
+    const bflabels::ClosedLoops& loops,
+    const bflabels::BFLCode& code,
+    std::string_view text,
+    const std::vector<size_t>& token_map
+) {
+    ClosedForms forms;
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        auto loop = text[i] == '[' ? loops.find(token_map[i]) : loops.end();
+
+        if (loop == loops.end()) {
+            continue;
+        }
+
+        forms[i] = place(loop->second, code);
+    }
+
+    return forms;
+}
+
+} // namespace bfvm
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <iostream>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "../labels/bflabels.h"
+
+
+namespace bfvm {
+
+enum class RunError {
+    UnbalancedLoops,
+    StepLimit,
+    TimeLimit,
+    InputWait,
+    TapeUnderflow,
+    TapeOverflow,
+    CellOverflow,
+    OutOfMemory,
+};
+
+enum class OpKind : uint8_t {
+    Add,
+    Move,
+    Open,
+    Close,
+    Out,
+    In,
+    Closed,
+
+    // Label-addressed forms of the above, using the cell at `Op::cell`
+    // rather than the one under the pointer.
+    AddAt,
+    OpenAt,
+    CloseAt,
+    OutAt,
+    InAt,
+    ClosedAt,
+
+    // Points the pointer at `Op::cell`, ahead of raw moves.
+    Seek,
+
+    // Superinstructions for the op pairs folded programs execute most, as
+    // counted over compiled units: `Move` then `Add` (a label switch and its
+    // op), `Add` then `Close` (a counter step ending its loop), and the
+    // `[-]` clear with the `+` run after it (`IF` prologues and `t[-]`).
+    MoveAdd,
+    AddClose,
+    Set,
+    AddCloseAt,
+    SetAt,
+};
+
+struct Op {
+    OpKind kind;
+
+    // Cell delta for `Add`, pointer delta for `Move` and `MoveAdd`, index of
+    // the matching bracket for `Open`/`Close` and `AddClose`, index into
+    // `Program::closed_forms` for `Closed`.
+    int32_t arg;
+
+    // Offset of the first brainfuck character the op was built from, or the
+    // index of its token for programs built from labels.
+    uint32_t pos;
+
+    // Tape address for label-addressed ops and `Seek`.
+    uint32_t cell = 0;
+
+    // Cell delta for `MoveAdd` and `AddClose`, cell value for `Set`. Kept
+    // within a byte, so it means the same for every cell width.
+    int8_t value = 0;
+};
+
+// A loop replaced by its closed-form effect (see `bflabels::ClosedLoop`),
+// with cells given relative to the loop's counter cell.
+struct ClosedForm {
+    struct Term {
+        uint8_t coefficient;
+        std::vector<int32_t> factors;
+    };
+
+    struct Update {
+        int32_t cell;
+        std::vector<Term> terms;
+    };
+
+    std::vector<Update> updates;
+
+    // Extent of the cells it touches, counter included.
+    int32_t min_cell = 0;
+    int32_t max_cell = 0;
+};
+
+// Closed forms keyed by the offset of their loop's `[` in the code.
+using ClosedForms = std::map<size_t, ClosedForm>;
+
+class Program {
+public:
+    std::vector<Op> ops;
+    std::vector<ClosedForm> closed_forms;
+
+    // Cells label-addressed ops may use, which the tape must hold upfront.
+    size_t tape_size = 0;
+
+    // With `fold`, runs of `+-` and `<>` become a single op and hot op pairs
+    // superinstructions; without it every character keeps its own op, which
+    // profiling relies on. Loops starting at an offset in `closed` become a
+    // single `Closed` op.
+    static std::expected<Program, RunError> from_bf(std::string_view code, bool fold = true, const ClosedForms& closed = {});
+
+    // Lowers a label stream straight to ops addressing the cells `code` lays
+    // its labels out at, so label switches cost nothing and no brainfuck is
+    // emitted. Ops between raw moves and the next label stay relative to the
+    // pointer, which a `Seek` first puts where `BFLCode::compile` would have
+    // it; like `compile`, this takes raw moves to return to where they
+    // started before the next label. `+`/`-` runs are folded as with
+    // `from_bf`, and loops in `closed` become `ClosedAt`.
+    static std::expected<Program, RunError> from_labels(
+        const std::vector<bflabels::Token>& tokens,
+        const bflabels::BFLCode& code,
+        const bflabels::ClosedLoops& closed = {}
+    );
+};
+
+// How far the pointer of `program` may get from the last cell it used before
+// it uses another, which bounds how far past the tape a stray access lands.
+size_t max_stride(const Program& program);
+
+// Resolves label-level closed loops against the layout of `code`, for the
+// brainfuck `text` it emitted with `token_map`.
+ClosedForms place_closed_loops(
+    const bflabels::ClosedLoops& loops,
+    const bflabels::BFLCode& code,
+    std::string_view text,
+    const std::vector<size_t>& token_map
+);
+
+} // namespace bfvm
+
+std::ostream& operator<<(std::ostream& os, bfvm::RunError error);
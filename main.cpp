@@ -1,49 +1,388 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <optional>
+#include <set>
+#include <span>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
 
 #include <lib/asm/parser.h>
 #include <lib/asm/compiler.h>
+#include <lib/asm/source_map.h>
+#include <lib/driver/cli.h>
+#include <lib/driver/stats.h>
+#include <lib/opt/closed_form.h>
+#include <lib/opt/cost.h>
+#include <lib/opt/pipeline.h>
+#include <lib/vm/batch.h>
+#include <lib/vm/deadline.h>
+#include <lib/vm/host.h>
+#include <lib/vm/interpreter.h>
+#include <lib/vm/io.h>
+#include <lib/vm/profile.h>
 
-int main() {
-    std::ifstream ifs("test.bfasm");
-    std::string content(
-        (std::istreambuf_iterator<char>(ifs)),
-        (std::istreambuf_iterator<char>())
-    );
+using namespace bftrans;
 
-    auto tokens = bfasm::parse::Tokenizer(content).tokenize();
 
-    if (!tokens) {
-        std::cout << tokens.error() << '\n';
-        return 1;
+static bool read_input(const std::string& path, std::string& content) {
+    std::stringstream ss;
+
+    if (path == "-") {
+        ss << std::cin.rdbuf();
+    } else {
+        std::ifstream ifs(path);
+        if (!ifs) {
+            return false;
+        }
+        ss << ifs.rdbuf();
     }
 
-    auto res = bfasm::parse::Parser(*tokens).parse();
+    content = ss.str();
+    return true;
+}
+
+// Records a batch runs on at once; outputs are written after every chunk.
+static constexpr size_t BATCH_CHUNK = size_t(1) << 16;
 
-    if (!res.has_value()) {
-        std::cout << res.error() << '\n';
+// Runs `program` once per record of stdin, writing the outputs in order.
+static int run_batch(const bfvm::Program& program, const driver::Options& options, std::ostream& out) {
+    bool files = options.batch == driver::Batch::Files;
+    auto format = options.batch == driver::Batch::Lengths ? bfvm::RecordFormat::Lengths : bfvm::RecordFormat::Lines;
+
+    std::string content;
+    read_input("-", content);
+
+    auto records = bfvm::split_records(content, format);
+    if (!records) {
+        std::cerr << "Truncated record on stdin.\n";
         return 1;
     }
 
-    std::cout << "AST: " << std::endl;
-    for (const auto& [name, macro] : *res) {
-        std::cout << macro;
+    unsigned jobs = options.jobs ? options.jobs : std::max(std::thread::hardware_concurrency(), 1u);
+    int status = 0;
+
+    std::optional<std::chrono::milliseconds> timeout;
+    if (options.timeout_ms) {
+        timeout = std::chrono::milliseconds(*options.timeout_ms);
     }
-    std::cout << std::endl;
 
-    std::cout << "Labels: " << std::endl;
-    auto compiled = bfasm::compiler::Compiler(*res);
+    for (size_t first = 0; first < records->size(); first += BATCH_CHUNK) {
+        auto chunk = std::span(*records).subspan(first, std::min(BATCH_CHUNK, records->size() - first));
+
+        std::vector<std::string> contents;
+        std::vector<std::string_view> inputs(chunk.begin(), chunk.end());
+
+        if (files) {
+            contents.resize(chunk.size());
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                std::string path(chunk[i]);
+                if (!read_input(path, contents[i])) {
+                    std::cerr << "Can't read \"" << path << "\".\n";
+                    return 1;
+                }
+                inputs[i] = contents[i];
+            }
+        }
 
-    compiled.compile();
+        auto runs = bfvm::run_batch(program, options.dialect, inputs, jobs, options.max_steps, options.lockstep, timeout);
 
-    for (auto l : compiled.result) {
-        std::cout << l;
+        for (size_t i = 0; i < runs.size(); ++i) {
+            bfvm::write_record(out, runs[i].output, format);
+
+            if (!runs[i].result) {
+                std::cerr << "Record " << first + i << ": " << runs[i].result.error() << '\n';
+                status = 1;
+            }
+        }
     }
 
-    std::cout << std::endl;
+    return status;
+}
+
+int main(int argc, char** argv) {
+    auto options = driver::parse_args(argc, argv);
+
+    if (!options) {
+        std::cerr << options.error() << "\n\n" << driver::USAGE;
+        return 2;
+    }
+
+    if (options->help) {
+        std::cout << driver::USAGE;
+        return 0;
+    }
+
+    const bfvm::Dialect& dialect = options->dialect;
+
+    // Optimizations assume 8-bit wrapping cells.
+    if (options->run && !dialect.byte_cells()) {
+        options->opt_level = 0;
+    }
+
+    std::string content;
+    if (!read_input(options->input, content)) {
+        std::cerr << "Can't read \"" << options->input << "\".\n";
+        return 1;
+    }
+
+    std::ofstream ofs;
+    if (options->output != "-") {
+        ofs.open(options->output);
+        if (!ofs) {
+            std::cerr << "Can't open \"" << options->output << "\" for writing.\n";
+            return 1;
+        }
+    }
+    std::ostream& out = options->output == "-" ? std::cout : ofs;
+
+    driver::PassTimer timer(options->time_passes);
+
+    int status = [&] {
+        auto tokens = timer.time("tokenize", [&] {
+            return bfasm::parse::Tokenizer(content).tokenize();
+        });
+
+        if (!tokens) {
+            std::cerr << tokens.error() << '\n';
+            return 1;
+        }
+
+        auto unit = timer.time("parse", [&] {
+            return bfasm::parse::Parser(*tokens).parse();
+        });
+
+        if (!unit) {
+            std::cerr << unit.error() << '\n';
+            return 1;
+        }
+
+        if (options->emit == driver::Emit::Ast) {
+            for (const auto& [name, macro] : *unit) {
+                out << macro;
+            }
+            return 0;
+        }
+
+        bfasm::compiler::Compiler compiler(*unit);
+
+        auto error = timer.time("compile", [&] {
+            return compiler.compile();
+        });
+
+        if (error) {
+            std::cerr << *error << '\n';
+            return 1;
+        }
+
+        timer.time("optimize", [&] {
+            bflabels::opt::Stream stream { std::move(compiler.result), std::move(compiler.result_origins) };
+            bflabels::opt::optimize(stream, options->opt_level, compiler.layout);
+
+            compiler.result = std::move(stream.tokens);
+            compiler.result_origins = std::move(stream.origins);
+        });
+
+        if (options->emit == driver::Emit::Labels) {
+            for (auto token : compiler.result) {
+                out << token;
+            }
+            out << '\n';
+            return 0;
+        }
+
+        auto bfl = timer.time("layout", [&] {
+            return bflabels::BFLCode(compiler.result, compiler.layout);
+        });
+
+        if (options->emit == driver::Emit::Cost && !options->run) {
+            std::vector<std::string_view> token_macros;
+            for (size_t origin : compiler.result_origins) {
+                token_macros.push_back(compiler.frames[compiler.origins[origin].frame].macro);
+            }
+
+            auto cost = timer.time("cost", [&] {
+                return bflabels::opt::estimate_cost(compiler.result, bfl, token_macros);
+            });
+
+            cost.write(out);
+            return 0;
+        }
+
+        bool profile = options->profile != driver::ProfileFormat::None;
+        bool needs_map = !options->source_map.empty() || profile;
+
+        // Folding `+-` runs needs cells that wrap.
+        bool wraps = dialect.overflow == bfvm::Overflow::Wrap;
+
+        // Plain runs lower the labels straight to the VM, skipping brainfuck.
+        bool direct = options->run && !needs_map && wraps;
+
+        // Tiered runs look for closed loops only once a loop gets hot. The
+        // runs of a batch or server share one program, which gets them all
+        // up front.
+        bool shared = options->batch != driver::Batch::None || !options->serve.empty();
+        bool tiered = options->tiered && direct && options->opt_level >= 1 && !shared;
+
+        bflabels::ClosedLoops closed_loops;
+        if (options->opt_level >= 1 && (options->emit == driver::Emit::C || options->run) && !tiered) {
+            closed_loops = timer.time("closed-form", [&] {
+                return bflabels::opt::find_closed_loops(compiler.result);
+            });
+        }
+
+        std::vector<size_t> token_map;
+        std::string code;
+
+        if (!direct) {
+            code = timer.time("codegen", [&] {
+                if (options->emit == driver::Emit::C && !options->run) {
+                    return bfl.compile_c(options->backend, closed_loops);
+                }
+                return bfl.compile(&token_map);
+            });
+        }
+
+        bfasm::compiler::SourceMap source_map;
+        if (needs_map) {
+            source_map = bfasm::compiler::SourceMap::build(compiler, token_map);
+        }
+
+        if (!options->source_map.empty()) {
+            std::ofstream map_out(options->source_map);
+            if (!map_out) {
+                std::cerr << "Can't open \"" << options->source_map << "\" for writing.\n";
+                return 1;
+            }
+            source_map.write(map_out);
+        }
+
+        if (!options->run) {
+            out << code;
+            if (options->emit == driver::Emit::Bf) {
+                out << '\n';
+            }
+            return 0;
+        }
+
+        auto lower = [&] {
+            if (direct) {
+                return bfvm::Program::from_labels(compiler.result, bfl, closed_loops);
+            }
+
+            auto closed_forms = bfvm::place_closed_loops(closed_loops, bfl, code, token_map);
+            return bfvm::Program::from_bf(code, !profile && wraps, closed_forms);
+        };
+
+        auto program = timer.time("lower", lower);
+
+        if (!program) {
+            std::cerr << program.error() << '\n';
+            return 1;
+        }
+
+        if (!options->serve.empty()) {
+            unsigned jobs = options->jobs ? options->jobs : std::max(std::thread::hardware_concurrency(), 1u);
+
+            std::optional<std::chrono::milliseconds> timeout;
+            if (options->timeout_ms) {
+                timeout = std::chrono::milliseconds(*options->timeout_ms);
+            }
+
+            auto served = bfvm::serve_unix(options->serve, *program, dialect, jobs, options->max_steps, timeout, std::cerr);
+            if (!served) {
+                std::cerr << served.error() << '\n';
+                return 1;
+            }
+            return 0;
+        }
+
+        std::vector<uint64_t> op_counts;
+
+        // The standard streams go through buffers of the VM, which write
+        // whole blocks and map files given as input.
+        std::optional<bfvm::FdOutput> stdout_buffer;
+        std::ostream run_out(out.rdbuf());
+        if (options->output == "-") {
+            std::cout.flush();
+            run_out.rdbuf(&stdout_buffer.emplace(STDOUT_FILENO));
+        }
+
+        if (options->batch != driver::Batch::None) {
+            return timer.time("run", [&] {
+                return run_batch(*program, *options, run_out);
+            });
+        }
+
+        bfvm::FdInput stdin_buffer(STDIN_FILENO);
+        std::istream run_in(&stdin_buffer);
+
+        // Hot loops of a tiered run get lowered again with the closed forms
+        // found for them, the analysis running once, for the first of them.
+        std::optional<bflabels::ClosedLoops> all_closed;
+        bfvm::TierUp tier_up {
+            [&](const std::set<uint32_t>& hot) -> std::optional<bfvm::Program> {
+                if (!all_closed) {
+                    all_closed = bflabels::opt::find_closed_loops(compiler.result);
+                }
+
+                bflabels::ClosedLoops picked;
+                for (uint32_t pos : hot) {
+                    if (auto loop = all_closed->find(pos); loop != all_closed->end()) {
+                        picked.insert(*loop);
+                    }
+                }
+
+                if (picked.size() == closed_loops.size()) {
+                    return std::nullopt;
+                }
+
+                closed_loops = std::move(picked);
+                auto recompiled = lower();
+                if (!recompiled) {
+                    return std::nullopt;
+                }
+                return std::move(*recompiled);
+            },
+        };
+
+        auto run = timer.time("run", [&] {
+            std::optional<bfvm::Deadline> deadline;
+            if (options->timeout_ms) {
+                deadline.emplace(std::chrono::milliseconds(*options->timeout_ms));
+            }
+
+            return bfvm::run_dialect(
+                *program, dialect, run_in, run_out, options->max_steps,
+                profile ? &op_counts : nullptr, tiered ? &tier_up : nullptr,
+                deadline ? &deadline->flag() : nullptr
+            );
+        });
+
+        if (profile) {
+            bfvm::Profile report(*program, op_counts, source_map);
+
+            if (options->profile == driver::ProfileFormat::Flat) {
+                report.write_flat(std::cerr);
+            } else {
+                report.write_folded(std::cerr);
+            }
+        }
+
+        if (!run) {
+            std::cerr << run.error() << '\n';
+            return 1;
+        }
+
+        return 0;
+    }();
+
+    if (options->time_passes) {
+        timer.report(std::cerr);
+    }
 
-    std::cout << "Brainfuck: " << std::endl;
-    auto bfl = bflabels::BFLCode(compiled.result, bflabels::MemoryLayout{});
-    std::cout << bfl.compile();
-    std::cout << std::endl;
+    return status;
 }
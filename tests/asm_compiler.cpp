@@ -0,0 +1,299 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include <lib/asm/compiler.h>
+#include <lib/asm/parser.h>
+#include <lib/labels/bflabels.h>
+#include <lib/vm/interpreter.h>
+
+
+static std::string labels(const std::string& code) {
+    auto tokens = bfasm::parse::Tokenizer(code).tokenize().value();
+    auto unit = bfasm::parse::Parser(tokens).parse().value();
+
+    bfasm::compiler::Compiler compiler(unit);
+    EXPECT_FALSE(compiler.compile().has_value());
+
+    std::stringstream ss;
+    for (auto token : compiler.result) {
+        ss << token;
+    }
+    return ss.str();
+}
+
+static std::string run(const std::string& code, const std::string& input) {
+    auto tokens = bfasm::parse::Tokenizer(code).tokenize().value();
+    auto unit = bfasm::parse::Parser(tokens).parse().value();
+
+    bfasm::compiler::Compiler compiler(unit);
+    EXPECT_FALSE(compiler.compile().has_value());
+
+    bflabels::BFLCode bfl(compiler.result, compiler.layout);
+    auto program = bfvm::Program::from_bf(bfl.compile()).value();
+
+    std::stringstream in(input), out;
+    bfvm::Interpreter interpreter(program, in, out);
+    EXPECT_TRUE(interpreter.run().has_value());
+
+    return out.str();
+}
+
+
+TEST(AsmCompiler, DeadConditionIsDestroyed) {
+    auto code =
+        "MACRO main ():\n"
+        "    x,\n"
+        "    IF x {\n"
+        "        y+.\n"
+        "    }\n";
+
+    ASSERT_EQ(labels(code), "var1,var1[var2+.var1[-]]");
+    ASSERT_EQ(run(code, "a"), "\x01");
+}
+
+TEST(AsmCompiler, LiveConditionIsKept) {
+    auto code =
+        "MACRO main ():\n"
+        "    x,\n"
+        "    IF x {\n"
+        "        y+.\n"
+        "    }\n"
+        "    x.\n";
+
+    ASSERT_EQ(labels(code), "var1,var2[-]var1[var3+.var1[var2+var1-]]var2[var1+var2-]var1.");
+    ASSERT_EQ(run(code, "a"), "\x01" "a");
+}
+
+TEST(AsmCompiler, ElseWithDeadCondition) {
+    auto code =
+        "MACRO main ():\n"
+        "    x,\n"
+        "    IF x {\n"
+        "        y+.\n"
+        "    } ELSE {\n"
+        "        y++.\n"
+        "    }\n";
+
+    ASSERT_EQ(run(code, "a"), "\x01");
+    ASSERT_EQ(run(code, std::string(1, '\0')), "\x02");
+}
+
+TEST(AsmCompiler, ArgumentsStayLive) {
+    // `a` is the caller's `x`, read after the USE.
+    auto code =
+        "MACRO test (a):\n"
+        "    IF a {\n"
+        "        y+.\n"
+        "    }\n"
+        "\n"
+        "MACRO main ():\n"
+        "    x,\n"
+        "    USE test (x)\n"
+        "    x.\n";
+
+    ASSERT_EQ(run(code, "a"), "\x01" "a");
+}
+
+TEST(AsmCompiler, ReturnsOutliveTheUse) {
+    // `r` is first seen as a return; it must name the same cell afterwards.
+    auto code =
+        "MACRO set (-> r):\n"
+        "    r[-]+++\n"
+        "\n"
+        "MACRO main ():\n"
+        "    USE set (-> r)\n"
+        "    IF r {\n"
+        "        y+.\n"
+        "    }\n"
+        "    r.\n";
+
+    ASSERT_EQ(run(code, ""), "\x01\x03");
+}
+
+TEST(AsmCompiler, ConditionReadByNextPassOfRawLoop) {
+    // `b` is copied back from `c` and read by the IF on every pass.
+    auto code =
+        "MACRO main ():\n"
+        "    a+++ b+\n"
+        "    a[\n"
+        "        c[-] b[c+d+b-] c[b+c-]\n"
+        "        IF b {\n"
+        "            e+\n"
+        "        }\n"
+        "        a-\n"
+        "    ]\n"
+        "    e" + std::string(48, '+') + ".\n";
+
+    ASSERT_EQ(run(code, ""), "3");
+}
+
+TEST(AsmCompiler, SwitchDispatch) {
+    auto code =
+        "MACRO main ():\n"
+        "    x,\n"
+        "    SWITCH x {\n"
+        "        CASE 98 { y+. }\n"
+        "        CASE 0 { y++. }\n"
+        "        CASE 97 { x. }\n"
+        "        DEFAULT { y+++. }\n"
+        "    }\n";
+
+    ASSERT_EQ(run(code, "a"), "a");
+    ASSERT_EQ(run(code, "b"), "\x01");
+    ASSERT_EQ(run(code, std::string(1, '\0')), "\x02");
+    ASSERT_EQ(run(code, "c"), "\x03");
+}
+
+TEST(AsmCompiler, SwitchKeepsLiveCondition) {
+    auto code =
+        "MACRO main ():\n"
+        "    x,\n"
+        "    SWITCH x {\n"
+        "        CASE 1 { y+. }\n"
+        "    }\n"
+        "    x.\n";
+
+    ASSERT_EQ(run(code, "\x01"), "\x01\x01");
+    ASSERT_EQ(run(code, "z"), "z");
+}
+
+TEST(AsmCompiler, SwitchReadByNextPassOfRawLoop) {
+    auto code =
+        "MACRO main ():\n"
+        "    a+++ b+\n"
+        "    a[\n"
+        "        c[-] b[c+d+b-] c[b+c-]\n"
+        "        SWITCH b {\n"
+        "            CASE 1 { e+ }\n"
+        "        }\n"
+        "        a-\n"
+        "    ]\n"
+        "    e" + std::string(48, '+') + ".\n";
+
+    ASSERT_EQ(run(code, ""), "3");
+}
+
+TEST(AsmCompiler, SwitchParseErrors) {
+    auto parse = [](const std::string& code) {
+        auto tokens = bfasm::parse::Tokenizer(code).tokenize().value();
+        return bfasm::parse::Parser(tokens).parse();
+    };
+
+    ASSERT_FALSE(parse("MACRO main (): SWITCH x { CASE 1 {} CASE 1 {} }").has_value());
+    ASSERT_FALSE(parse("MACRO main (): SWITCH x { CASE 256 {} }").has_value());
+    ASSERT_FALSE(parse("MACRO main (): SWITCH x { CASE y {} }").has_value());
+    ASSERT_FALSE(parse("MACRO main (): SWITCH x { DEFAULT {} DEFAULT {} }").has_value());
+    ASSERT_FALSE(parse("MACRO main (): CASE 1 {}").has_value());
+    ASSERT_TRUE(parse("MACRO main (): SWITCH x { CASE 0 { x+ } DEFAULT { x- } }").has_value());
+}
+
+TEST(AsmCompiler, ArrayLookup) {
+    auto code =
+        "MACRO fill (table):\n"
+        "    i[-]\n"
+        "    n[-]n++++\n"
+        "    WHILE n {\n"
+        "        SET table[i] n\n"
+        "        i+ n-\n"
+        "    }\n"
+        "\n"
+        "MACRO main ():\n"
+        "    ARRAY table(4)\n"
+        "    USE fill (table)\n"
+        "    k,\n"
+        "    GET table[k] -> x\n"
+        "    x.\n"
+        "    SET table[k] k\n"
+        "    GET table[k] -> k\n"
+        "    k.\n";
+
+    ASSERT_EQ(run(code, std::string(1, '\0')), std::string("\x04\x00", 2));
+    ASSERT_EQ(run(code, "\x02"), "\x02\x02");
+    ASSERT_EQ(run(code, "\x03"), "\x01\x03");
+}
+
+TEST(AsmCompiler, ArrayMustBeDeclared) {
+    auto tokens = bfasm::parse::Tokenizer("MACRO main (): GET table[i] -> x").tokenize().value();
+    auto unit = bfasm::parse::Parser(tokens).parse().value();
+
+    bfasm::compiler::Compiler compiler(unit);
+    ASSERT_TRUE(compiler.compile().has_value());
+}
+
+TEST(AsmCompiler, ArrayParseErrors) {
+    auto parse = [](const std::string& code) {
+        auto tokens = bfasm::parse::Tokenizer(code).tokenize().value();
+        return bfasm::parse::Parser(tokens).parse();
+    };
+
+    ASSERT_FALSE(parse("MACRO main (): ARRAY table(0)").has_value());
+    ASSERT_FALSE(parse("MACRO main (): ARRAY table(257)").has_value());
+    ASSERT_FALSE(parse("MACRO main (): ARRAY table(4) GET table[i] x").has_value());
+    ASSERT_FALSE(parse("MACRO main (): ARRAY table(4) SET table i x").has_value());
+    ASSERT_TRUE(parse("MACRO main (): ARRAY table(256) SET table[i] x GET table[i] -> x").has_value());
+}
+
+// Prints x as its low and high byte.
+static const char* const PRINT16 =
+    "MACRO print (x):\n"
+    "    INT base(2)\n"
+    "    s[-]s++++++++++++++++\n"
+    "    MUL s s -> base\n"
+    "    DIVMOD x base -> hi lo\n"
+    "    lo.\n"
+    "    hi.\n"
+    "\n";
+
+TEST(AsmCompiler, IntCarries) {
+    std::string code = std::string(PRINT16) +
+        "MACRO main ():\n"
+        "    INT c(2)\n"
+        "    INT d(2)\n"
+        "    a,\n"
+        "    b,\n"
+        "    MUL a a -> c\n"
+        "    USE print (c)\n"
+        "    ADD c c -> c\n"
+        "    USE print (c)\n"
+        "    SUB b c -> d\n"
+        "    USE print (d)\n";
+
+    ASSERT_EQ(run(code, "\xfa\x07"), "\x24\xf4\x48\xe8\xbf\x17");
+}
+
+TEST(AsmCompiler, IntDivisionAndComparison) {
+    std::string code = std::string(PRINT16) +
+        "MACRO main ():\n"
+        "    INT x(2)\n"
+        "    INT q(2)\n"
+        "    a,\n"
+        "    b,\n"
+        "    MUL a a -> x\n"
+        "    DIVMOD x b -> q r\n"
+        "    USE print (q)\n"
+        "    r.\n"
+        "    LESS x b -> f\n"
+        "    f.\n"
+        "    LESS b x -> f\n"
+        "    f.\n"
+        "    zero[-]\n"
+        "    DIVMOD x zero -> q r\n"
+        "    USE print (q)\n"
+        "    r.\n";
+
+    ASSERT_EQ(run(code, "\xfa\x09"), std::string("\x20\x1b\x04\x00\x01\xff\xff\x24", 8));
+}
+
+TEST(AsmCompiler, IntParseErrors) {
+    auto parse = [](const std::string& code) {
+        auto tokens = bfasm::parse::Tokenizer(code).tokenize().value();
+        return bfasm::parse::Parser(tokens).parse();
+    };
+
+    ASSERT_FALSE(parse("MACRO main (): INT x(0)").has_value());
+    ASSERT_FALSE(parse("MACRO main (): INT x(9)").has_value());
+    ASSERT_FALSE(parse("MACRO main (): ADD x y z").has_value());
+    ASSERT_FALSE(parse("MACRO main (): DIVMOD x y -> q").has_value());
+    ASSERT_TRUE(parse("MACRO main (): INT x(8) DIVMOD x y -> q r LESS x y -> f").has_value());
+}
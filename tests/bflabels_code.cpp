@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include <lib/labels/bflabels.h>
+
+
+using Tokens = std::vector<bflabels::Token>;
+
+
+TEST(BFLCode, FirstUsePlacement) {
+    using namespace bflabels;
+
+    Tokens tokens = Parser("b+a+b-c.").parse().value();
+    BFLCode code(tokens);
+
+    ASSERT_EQ(code.offset(Label{1, 0}), 0);
+    ASSERT_EQ(code.offset(Label{2, 0}), 1);
+    ASSERT_EQ(code.offset(Label{3, 0}), 2);
+    ASSERT_EQ(code.compile(), "+>+<->>.");
+}
+
+TEST(BFLCode, ElementsReserveCells) {
+    using namespace bflabels;
+
+    Tokens tokens = Parser("arr(2)+x+arr+").parse().value();
+    BFLCode code(tokens);
+
+    ASSERT_EQ(code.offset(Label{1, 2}), 2);
+    ASSERT_EQ(code.offset(Label{2, 0}), 3);
+    ASSERT_EQ(code.compile(), ">>+>+<<<+");
+}
+
+TEST(BFLCode, ExplicitLayout) {
+    using namespace bflabels;
+
+    Tokens tokens = Parser("a+b+c+").parse().value();
+    BFLCode code(tokens, MemoryLayout {
+        .label_offsets = {{Label{2, 0}, 4}},
+    });
+
+    ASSERT_EQ(code.offset(Label{1, 0}), 5);
+    ASSERT_EQ(code.offset(Label{2, 0}), 4);
+    ASSERT_EQ(code.offset(Label{3, 0}), 6);
+    ASSERT_EQ(code.compile(), ">>>>>+<+>>+");
+}
+
+TEST(BFLCode, ReservedExtents) {
+    using namespace bflabels;
+
+    Tokens tokens = Parser("arr+x+").parse().value();
+    BFLCode code(tokens, MemoryLayout {
+        .label_offsets = {},
+        .label_extents = {{Label{1, 0}, 5}},
+    });
+
+    ASSERT_EQ(code.offset(Label{1, 0}), 0);
+    ASSERT_EQ(code.offset(Label{2, 0}), 5);
+    ASSERT_EQ(code.compile(), "+>>>>>+");
+}
@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/closed_form.h>
+
+
+TEST(OptClosedForm, TransferLoop) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x,x[t+x-]").parse().value();
+    auto loops = opt::find_closed_loops(tokens);
+
+    ASSERT_EQ(loops.size(), 1);
+
+    const auto& loop = loops.begin()->second;
+    ASSERT_EQ(tokens[loops.begin()->first], Token('['));
+    ASSERT_EQ(loop.updates.size(), 1);
+    ASSERT_EQ(loop.updates[0].terms.size(), 1);
+    ASSERT_EQ(loop.updates[0].terms[0].coefficient, 1);
+    ASSERT_EQ(loop.updates[0].terms[0].factors.size(), 1);
+}
+
+TEST(OptClosedForm, NestedMultiplication) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x,y,x[y[r+t+y-]t[y+t-]x-]").parse().value();
+    auto loops = opt::find_closed_loops(tokens);
+
+    // The inner loops are folded into the outer one.
+    ASSERT_EQ(loops.size(), 1);
+
+    const auto& loop = loops.begin()->second;
+    ASSERT_EQ(loop.updates.size(), 1);
+    ASSERT_EQ(loop.updates[0].terms.size(), 1);
+    ASSERT_EQ(loop.updates[0].terms[0].coefficient, 1);
+    ASSERT_EQ(loop.updates[0].terms[0].factors.size(), 2);
+}
+
+TEST(OptClosedForm, EvenStepIsLeftAlone) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x,x[t+x--]").parse().value();
+
+    ASSERT_TRUE(opt::find_closed_loops(tokens).empty());
+}
+
+TEST(OptClosedForm, IOIsLeftAlone) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x,x[t.x-]").parse().value();
+
+    ASSERT_TRUE(opt::find_closed_loops(tokens).empty());
+}
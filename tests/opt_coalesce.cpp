@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/coalesce.h>
+
+#include "opt_stream.h"
+
+
+static std::string coalesce(std::string_view code) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser(code).parse().value(), {} };
+    opt::coalesce_copies(stream);
+
+    return print(stream.tokens);
+}
+
+
+TEST(OptCoalesce, MergesReadOnlyDestination) {
+    ASSERT_EQ(coalesce("x,t[-]q[-]x[q+t+x-]t[x+t-]q.x+."), parsed("x,t[-]q[-]x.x+."));
+}
+
+TEST(OptCoalesce, MergesIntoDeadSource) {
+    ASSERT_EQ(coalesce("x,t[-]q[-]x[t+q+x-]t[x+t-]q+q."), parsed("x,t[-]q[-]x+x."));
+}
+
+TEST(OptCoalesce, RangeEndsWhereDestinationIsCleared) {
+    ASSERT_EQ(
+        coalesce("x,t[-]q[-]x[q+t+x-]t[x+t-]q.x+q[-]q+++q."),
+        parsed("x,t[-]q[-]x.x+q[-]q+++q.")
+    );
+    ASSERT_EQ(
+        coalesce("c+++[x,t[-]q[-]x[q+t+x-]t[x+t-]q.x+c-]"),
+        parsed("c+++[x,t[-]q[-]x.x+c-]")
+    );
+}
+
+TEST(OptCoalesce, KeepsCopyWhileBothLive) {
+    for (auto code : {
+        "x,t[-]q[-]x[q+t+x-]t[x+t-]x+q.x.",
+        "x,t[-]q[-]x[q+t+x-]t[x+t-]q+x.q.",
+        // `q` is live out of the loop, past where the range ends.
+        "c+++[x,t[-]q[-]x[q+t+x-]t[x+t-]q.x+c-]q.",
+        // `q` is not known to be zero.
+        "x,q+t[-]x[q+t+x-]t[x+t-]q.",
+        // `q` is read by the check of its loop after `x` is written.
+        "x,t[-]q[-]x[q+t+x-]t[x+t-]q[q[-]x[-]x,q]",
+    }) {
+        ASSERT_EQ(coalesce(code), parsed(code)) << code;
+    }
+}
+
+TEST(OptCoalesce, KeepsOriginsParallel) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser("x,t[-]q[-]x[q+t+x-]t[x+t-]q.").parse().value(), {} };
+    identity_origins(stream);
+
+    opt::coalesce_copies(stream);
+
+    ASSERT_EQ(print(stream.tokens), parsed("x,t[-]q[-]x."));
+    ASSERT_EQ(stream.origins, (std::vector<size_t> { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 26, 27 }));
+    ASSERT_EQ(stream.merged, (std::set<size_t> { 1, 3 }));
+}
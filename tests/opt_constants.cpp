@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/constants.h>
+
+#include "opt_stream.h"
+
+
+TEST(OptConstants, ShortRunsStayRuns) {
+    using namespace bflabels;
+
+    auto tokens = opt::synthesize_constant(Label { 1, 0 }, 0, 13, Label { 2, 0 });
+
+    ASSERT_EQ(print(tokens), std::string(13, '+'));
+}
+
+TEST(OptConstants, RunsWrapAround) {
+    using namespace bflabels;
+
+    auto tokens = opt::synthesize_constant(Label { 1, 0 }, 10, 250, std::nullopt);
+
+    ASSERT_EQ(print(tokens), std::string(16, '-'));
+}
+
+TEST(OptConstants, LargeConstantsMultiply) {
+    using namespace bflabels;
+
+    auto tokens = opt::synthesize_constant(Label { 1, 0 }, 0, 100, Label { 2, 0 });
+
+    std::string code = print(tokens);
+    ASSERT_LT(code.size(), 100);
+    ASSERT_EQ(code.substr(0, 4), "var2");
+    ASSERT_EQ(code.substr(code.size() - 4), "var1");
+}
+
+TEST(OptConstants, ResynthesizesKnownValues) {
+    using namespace bflabels;
+
+    std::string run(120, '+');
+    opt::Stream stream { Parser("x,t[-]t" + run + ".x" + run).parse().value(), {} };
+    opt::synthesize_constants(stream);
+
+    std::string code = print(stream.tokens);
+
+    // `t` is known to be zero after its clear loop; `x` comes from input.
+    ASSERT_NE(code.find("var2var3"), std::string::npos);
+    ASSERT_NE(code.find("var1" + std::string(120, '+')), std::string::npos);
+}
+
+TEST(OptConstants, DerivesFromKnownCells) {
+    using namespace bflabels;
+
+    auto tokens = opt::derive_constant(Label { 1, 0 }, 0, 100, Label { 2, 0 }, 97, Label { 3, 0 });
+    ASSERT_EQ(print(tokens), "var2[var1+var3+var2-]var3[var2+var3-]var1+++");
+
+    // 127 is a long run or an inexact product, but `x` already holds it.
+    std::string run(127, '+');
+    opt::Stream stream { Parser("x" + run + ".y" + run + ".").parse().value(), {} };
+    opt::synthesize_constants(stream);
+
+    ASSERT_NE(print(stream.tokens).find("var1[var2+var3+var1-]var3[var1+var3-]var2."), std::string::npos);
+}
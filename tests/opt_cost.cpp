@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/cost.h>
+
+
+static std::string ops_bound(const bflabels::opt::CostReport& report) {
+    std::stringstream ss;
+    report.program.ops.write(ss, report.symbols);
+    return ss.str();
+}
+
+
+TEST(OptCost, TransferLoopIsLinear) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x[t+x-]").parse().value();
+    BFLCode code(tokens);
+    auto report = opt::estimate_cost(tokens, code);
+
+    // `[` once; `>+<-]` once per unit of x.
+    ASSERT_EQ(report.program.size, 6);
+    ASSERT_EQ(report.program.moves, 2);
+    ASSERT_EQ(report.program.min_cell, 0);
+    ASSERT_EQ(report.program.max_cell, 1);
+    ASSERT_EQ(ops_bound(report), "1 + 5*var1");
+    ASSERT_EQ(report.program.ops.worst_case(report.symbols), 1 + 5 * 255);
+}
+
+TEST(OptCost, NestedLoopsMultiply) {
+    using namespace bflabels;
+
+    auto tokens = Parser("a[b[c+b-]a-]").parse().value();
+    BFLCode code(tokens);
+    auto report = opt::estimate_cost(tokens, code);
+
+    ASSERT_EQ(ops_bound(report), "1 + 5*var1 + 5*var1*var2");
+}
+
+TEST(OptCost, ClearedConditionRunsOnce) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x[y+x[-]]").parse().value();
+    BFLCode code(tokens);
+    auto report = opt::estimate_cost(tokens, code);
+
+    ASSERT_EQ(ops_bound(report), "6 + 2*var1");
+}
+
+TEST(OptCost, UnknownLoopsAreUnbounded) {
+    using namespace bflabels;
+
+    auto tokens = Parser("x[,]").parse().value();
+    BFLCode code(tokens);
+    auto report = opt::estimate_cost(tokens, code);
+
+    ASSERT_EQ(ops_bound(report), "1 + 2*?var1");
+    ASSERT_FALSE(report.program.ops.worst_case(report.symbols).has_value());
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/invariants.h>
+
+#include "opt_stream.h"
+
+
+static std::string hoist(std::string_view code) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser(code).parse().value(), {} };
+    opt::hoist_invariants(stream);
+
+    return print(stream.tokens);
+}
+
+
+TEST(OptInvariants, DropsClearOfZeroTemp) {
+    ASSERT_EQ(hoist("x,c+++[t[-]x[t+x-]t[x+t-]x.c-]"), parsed("x,c+++[x[t+x-]t[x+t-]x.c-]"));
+}
+
+TEST(OptInvariants, HoistsSetUpClearedAfterLoop) {
+    ASSERT_EQ(hoist("t,c+++[t[-]++t.c-]t[-]"), parsed("t,c+++t[-]++c[t.c-]t[-]"));
+}
+
+TEST(OptInvariants, HoistsOutOfNestedLoops) {
+    ASSERT_EQ(
+        hoist("t,a++[b++[t[-]t.b-]t[-]a-]t[-]"),
+        parsed("t,a++t[-]a[b++b[t.b-]t[-]a-]t[-]")
+    );
+}
+
+TEST(OptInvariants, KeepsVariantSetUps) {
+    for (auto code : {
+        // Read before the set-up.
+        "t,c+++[t.t[-]c-]t[-]",
+        // Not back to its value at the end of the body.
+        "t,c+++[t[-]++t.t-c-]t[-]",
+        // Live after a loop that may not run.
+        "t,c+++[t[-]++t.c-]t.",
+        // The loop check.
+        "t,t[t[-]]",
+    }) {
+        ASSERT_EQ(hoist(code), parsed(code)) << code;
+    }
+}
+
+TEST(OptInvariants, KeepsOriginsParallel) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser("t,c+[t[-]+t.c-]t[-]").parse().value(), {} };
+    identity_origins(stream);
+
+    opt::hoist_invariants(stream);
+
+    ASSERT_EQ(print(stream.tokens), parsed("t,c+t[-]+c[t.c-]t[-]"));
+    ASSERT_EQ(stream.origins, (std::vector<size_t> { 0, 1, 2, 3, 5, 6, 7, 8, 9, 4, 4, 10, 11, 12, 13, 14, 15, 16, 17, 18 }));
+}
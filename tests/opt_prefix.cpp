@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/prefix.h>
+
+#include "opt_stream.h"
+
+
+TEST(OptPrefix, StopsAtInput) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser("a++[b+++a-]b.x,x.").parse().value(), {} };
+    opt::evaluate_prefix(stream);
+
+    ASSERT_EQ(print(stream.tokens), "var2++++++.var3,var3.");
+}
+
+TEST(OptPrefix, CutsBeforeLoopWithInput) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser("a+++b+a[,a-]").parse().value(), {} };
+    opt::evaluate_prefix(stream);
+
+    ASSERT_EQ(print(stream.tokens), "var1+++var2+var1[,var1-]");
+}
+
+TEST(OptPrefix, KeepsOriginsParallel) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser("a++++a[-]b+b,").parse().value(), {} };
+    identity_origins(stream);
+
+    opt::evaluate_prefix(stream);
+
+    ASSERT_EQ(print(stream.tokens), "var2+,");
+    ASSERT_EQ(stream.origins, (std::vector<size_t> { 0, 0, 12 }));
+}
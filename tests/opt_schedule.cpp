@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/schedule.h>
+
+#include "opt_stream.h"
+
+
+static std::string schedule(std::string_view code, const bflabels::MemoryLayout& reserved = {}) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser(code).parse().value(), {} };
+    opt::schedule_operations(stream, reserved);
+
+    return print(stream.tokens);
+}
+
+
+TEST(OptSchedule, GroupsOpsByCell) {
+    ASSERT_EQ(schedule("a+b+c+a+b+c+"), parsed("a++b++c++"));
+}
+
+TEST(OptSchedule, KeepsTheCellUsedAfterTheRun) {
+    ASSERT_EQ(schedule("a+b+c+a+b-c+."), parsed("a++b+-c++."));
+    ASSERT_EQ(schedule("c+a+b+c+a-b+[b-]"), parsed("c++a+-b++[b-]"));
+}
+
+TEST(OptSchedule, KeepsLoopsAndIoInPlace) {
+    for (auto code : {
+        "a+b+c,a+b+c.",
+        "a+b+c+",
+    }) {
+        ASSERT_EQ(schedule(code), parsed(code)) << code;
+    }
+}
+
+TEST(OptSchedule, StartsFromTheCurrentCell) {
+    ASSERT_EQ(schedule("a+b+[a+b-]a+b+"), parsed("a+b+[a+b-]+a+"));
+}
+
+TEST(OptSchedule, FollowsReservedLayout) {
+    using namespace bflabels;
+
+    // `c` sits at the start of the tape, `b` two cells after it.
+    MemoryLayout reserved;
+    reserved.label_offsets[Label { 3, 0 }] = 0;
+    reserved.label_offsets[Label { 2, 0 }] = 2;
+
+    ASSERT_EQ(schedule("a+b+c+a+", reserved), "var3+var2+var1++");
+}
+
+TEST(OptSchedule, KeepsOriginsParallel) {
+    using namespace bflabels;
+
+    opt::Stream stream { Parser("a+b+a+b+.").parse().value(), {} };
+    identity_origins(stream);
+
+    opt::schedule_operations(stream, {});
+
+    ASSERT_EQ(print(stream.tokens), parsed("a++b++."));
+    ASSERT_EQ(stream.origins, (std::vector<size_t> { 0, 1, 5, 2, 3, 7, 8 }));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <lib/labels/bflabels.h>
+#include <lib/opt/pipeline.h>
+
+
+// Helpers for the tests of passes over label streams.
+
+inline std::string print(const std::vector<bflabels::Token>& tokens) {
+    std::stringstream ss;
+    for (auto token : tokens) {
+        ss << token;
+    }
+    return ss.str();
+}
+
+// `code` as the parser prints it back, for comparing with pass output.
+inline std::string parsed(std::string_view code) {
+    return print(bflabels::Parser(code).parse().value());
+}
+
+// Makes every token of `stream` its own origin, so that tests can tell where
+// a pass moved or merged them.
+inline void identity_origins(bflabels::opt::Stream& stream) {
+    stream.origins.resize(stream.tokens.size());
+    for (size_t i = 0; i < stream.origins.size(); ++i) {
+        stream.origins[i] = i;
+    }
+}
@@ -0,0 +1,730 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <expected>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <lib/asm/compiler.h>
+#include <lib/asm/parser.h>
+#include <lib/asm/source_map.h>
+#include <lib/labels/bflabels.h>
+#include <lib/opt/closed_form.h>
+#include <lib/vm/batch.h>
+#include <lib/vm/deadline.h>
+#include <lib/vm/host.h>
+#include <lib/vm/interpreter.h>
+#include <lib/vm/io.h>
+#include <lib/vm/profile.h>
+
+
+TEST(VMInterpreter, HelloLoop) {
+    using namespace bfvm;
+
+    auto program = Program::from_bf("++++++++[>++++++++<-]>+.+.");
+    ASSERT_TRUE(program.has_value());
+
+    std::stringstream in, out;
+    Interpreter interpreter(*program, in, out);
+
+    ASSERT_TRUE(interpreter.run().has_value());
+    ASSERT_EQ(out.str(), "AB");
+    ASSERT_EQ(interpreter.pointer, 1);
+}
+
+TEST(VMInterpreter, Folding) {
+    using namespace bfvm;
+
+    auto folded = Program::from_bf("+++-->><");
+    auto unfolded = Program::from_bf("+++-->><", false);
+
+    ASSERT_EQ(folded->ops.size(), 2);
+    ASSERT_EQ(folded->ops[0].arg, 1);
+    ASSERT_EQ(folded->ops[1].arg, 1);
+    ASSERT_EQ(unfolded->ops.size(), 8);
+}
+
+TEST(VMInterpreter, Superinstructions) {
+    using namespace bfvm;
+
+    auto program = Program::from_bf("[-]+++[>++<-]>.");
+    ASSERT_EQ(program->ops.size(), 7);
+    ASSERT_EQ(program->ops[0].kind, OpKind::Set);
+    ASSERT_EQ(program->ops[0].value, 3);
+    ASSERT_EQ(program->ops[2].kind, OpKind::MoveAdd);
+    ASSERT_EQ(program->ops[2].value, 2);
+    ASSERT_EQ(program->ops[1].arg, 4);
+    ASSERT_EQ(program->ops[4].arg, 1);
+
+    auto countdown = Program::from_bf("+++[.-]");
+    ASSERT_EQ(countdown->ops.size(), 4);
+    ASSERT_EQ(countdown->ops[3].kind, OpKind::AddClose);
+    ASSERT_EQ(countdown->ops[1].arg, 3);
+    ASSERT_EQ(countdown->ops[3].arg, 1);
+
+    std::stringstream in, out;
+    Interpreter(*program, in, out).run();
+    Interpreter(*countdown, in, out).run();
+    ASSERT_EQ(out.str(), "\x06\x03\x02\x01");
+
+    auto tokens = bflabels::Parser("a[-]+++[b++a-]b.").parse().value();
+    auto labels = Program::from_labels(tokens, bflabels::BFLCode(tokens));
+    ASSERT_EQ(labels->ops[0].kind, OpKind::SetAt);
+    ASSERT_EQ(labels->ops[3].kind, OpKind::AddCloseAt);
+}
+
+TEST(VMInterpreter, InputAndEOF) {
+    using namespace bfvm;
+
+    auto program = Program::from_bf(",.,.");
+
+    std::stringstream in("x"), out;
+    Interpreter interpreter(*program, in, out);
+
+    ASSERT_TRUE(interpreter.run().has_value());
+    ASSERT_EQ(out.str(), "xx");
+}
+
+TEST(VMInterpreter, Errors) {
+    using namespace bfvm;
+
+    ASSERT_EQ(Program::from_bf("[[]").error(), RunError::UnbalancedLoops);
+    ASSERT_EQ(Program::from_bf("]").error(), RunError::UnbalancedLoops);
+
+    std::stringstream in, out;
+
+    auto underflow = Program::from_bf("<");
+    ASSERT_EQ(Interpreter(*underflow, in, out).run().error(), RunError::TapeUnderflow);
+
+    auto forever = Program::from_bf("+[]");
+    Interpreter interpreter(*forever, in, out);
+    ASSERT_EQ(interpreter.run(100).error(), RunError::StepLimit);
+    ASSERT_EQ(interpreter.steps, 100);
+}
+
+TEST(VMInterpreter, AwaitsInput) {
+    using namespace bfvm;
+
+    // Echoes a line.
+    auto echo = Program::from_bf(",----------[++++++++++.,----------]");
+
+    InputQueue queue;
+    std::istream in(&queue);
+    std::stringstream out;
+
+    Interpreter interpreter(*echo, in, out);
+    interpreter.await_input = true;
+
+    // Stops before `,`, which runs once fed.
+    ASSERT_EQ(interpreter.run().error(), RunError::InputWait);
+    ASSERT_EQ(interpreter.pc, 0);
+    ASSERT_EQ(interpreter.steps, 0);
+
+    queue.feed("ab");
+    ASSERT_EQ(interpreter.run().error(), RunError::InputWait);
+    ASSERT_EQ(out.str(), "ab");
+
+    queue.feed("c\n");
+    ASSERT_TRUE(interpreter.run().has_value());
+    ASSERT_EQ(out.str(), "abc");
+}
+
+TEST(VMInterpreter, Budgets) {
+    using namespace bfvm;
+
+    std::stringstream in, out;
+
+    // Six ops up to the first back-edge, then four per iteration, charged
+    // and checked at back-edges.
+    auto counting = Program::from_bf("+[>+<]", false);
+    Interpreter interpreter(*counting, in, out);
+
+    ASSERT_EQ(interpreter.run(100).error(), RunError::StepLimit);
+    ASSERT_EQ(interpreter.steps, 102);
+    ASSERT_EQ(interpreter.pointer, 0);
+    ASSERT_EQ(interpreter.tape[1], 25);
+
+    // A stopped run resumes where it stopped.
+    ASSERT_EQ(interpreter.run(200).error(), RunError::StepLimit);
+    ASSERT_EQ(interpreter.steps, 202);
+    ASSERT_EQ(interpreter.tape[1], 50);
+
+    auto forever = Program::from_bf("+[]");
+    Interpreter timed(*forever, in, out);
+
+    Deadline deadline(std::chrono::milliseconds(10));
+    timed.timed_out = &deadline.flag();
+    ASSERT_EQ(timed.run().error(), RunError::TimeLimit);
+    ASSERT_TRUE(deadline.flag());
+
+    // Straight-line code is charged once it ends.
+    auto straight = Program::from_bf("+>+>+", false);
+    Interpreter ended(*straight, in, out);
+    ASSERT_TRUE(ended.run().has_value());
+    ASSERT_EQ(ended.steps, 5);
+}
+
+// Output of `code` run under `dialect`, or its error.
+static std::expected<std::string, bfvm::RunError> run_in(std::string_view code, bfvm::Dialect dialect, bool fold = true) {
+    auto program = bfvm::Program::from_bf(code, fold);
+
+    std::stringstream in, out;
+    auto result = bfvm::run_dialect(*program, dialect, in, out);
+    if (!result) {
+        return std::unexpected(result.error());
+    }
+    return out.str();
+}
+
+TEST(VMDialects, CellWidths) {
+    using namespace bfvm;
+
+    std::string code = std::string(256, '+') + "[>+<[-]]>.";
+
+    ASSERT_EQ(run_in(code, Dialect {}), std::string(1, '\0'));
+    ASSERT_EQ(run_in(code, Dialect { .cells = CellWidth::Bits16 }), "\x01");
+    ASSERT_EQ(run_in(code, Dialect { .cells = CellWidth::Bits32 }), "\x01");
+}
+
+TEST(VMDialects, Overflow) {
+    using namespace bfvm;
+
+    ASSERT_EQ(run_in("-.", Dialect {}), "\xff");
+    ASSERT_EQ(run_in("-.", Dialect { .overflow = Overflow::Saturate }, false), std::string(1, '\0'));
+    ASSERT_EQ(run_in("-", Dialect { .overflow = Overflow::Trap }, false).error(), RunError::CellOverflow);
+    ASSERT_EQ(run_in(std::string(255, '+') + ".", Dialect { .overflow = Overflow::Trap }, false), "\xff");
+    ASSERT_EQ(run_in(std::string(256, '+'), Dialect { .overflow = Overflow::Trap }, false).error(), RunError::CellOverflow);
+}
+
+TEST(VMDialects, EndOfInput) {
+    using namespace bfvm;
+
+    ASSERT_EQ(run_in("+,.", Dialect {}), "\x01");
+    ASSERT_EQ(run_in("+,.", Dialect { .eof = EofBehavior::Zero }), std::string(1, '\0'));
+    ASSERT_EQ(run_in("+,.", Dialect { .eof = EofBehavior::MinusOne }), "\xff");
+}
+
+TEST(VMDialects, FixedTape) {
+    using namespace bfvm;
+
+    Dialect fixed { .tape = TapePolicy::Fixed, .tape_cells = 4 };
+
+    ASSERT_EQ(run_in(">>>+.", fixed), "\x01");
+    ASSERT_EQ(run_in(">>>>", fixed).error(), RunError::TapeOverflow);
+    ASSERT_EQ(run_in("<", fixed).error(), RunError::TapeUnderflow);
+}
+
+TEST(VMDialects, PagedTape) {
+    using namespace bfvm;
+
+    Dialect paged { .tape = TapePolicy::Paged };
+
+    ASSERT_EQ(run_in("+[>++<-]>>>+.<<.", paged), "\x01\x02");
+    ASSERT_EQ(run_in("+[-<<<+>>>]", paged).error(), RunError::TapeUnderflow);
+    ASSERT_EQ(run_in(">>><<<<<<+", paged, false).error(), RunError::TapeUnderflow);
+
+    // A fault starts the session over, rather than leaving it where the slice
+    // before had it.
+    auto program = Program::from_bf("++++++++[>++++++++<-]>[<+>-]<<+", false);
+    auto session = make_session(*program, paged);
+    std::string output;
+
+    ASSERT_EQ(session->resume(output, 10).error(), RunError::StepLimit);
+    ASSERT_GT(session->steps(), 0);
+    ASSERT_EQ(session->resume(output).error(), RunError::TapeUnderflow);
+    ASSERT_EQ(session->steps(), 0);
+    ASSERT_EQ(session->resume(output, 10).error(), RunError::StepLimit);
+    ASSERT_EQ(session->resume(output).error(), RunError::TapeUnderflow);
+}
+
+TEST(VMDialects, GuardPages) {
+    using namespace bfvm;
+
+    PagedRegion region(4096, 64, false);
+    ASSERT_TRUE(region.valid());
+
+    auto below = [&] { region.data()[-1] = std::byte(1); };
+    auto above = [&] { region.data()[4096 + 63] = std::byte(1); };
+    auto inside = [&] { region.data()[4095] = std::byte(1); };
+
+    ASSERT_EQ(region.guard(below), PagedRegion::Fault::Below);
+    ASSERT_EQ(region.guard(above), PagedRegion::Fault::Above);
+    ASSERT_EQ(region.guard(inside), PagedRegion::Fault::None);
+    ASSERT_EQ(region.data()[4095], std::byte(1));
+}
+
+// Output of a label stream run through its brainfuck, and lowered straight
+// from its labels.
+static std::pair<std::string, std::string> run_both(std::string_view code, const bflabels::ClosedLoops& closed = {}) {
+    using namespace bfvm;
+
+    auto tokens = bflabels::Parser(code).parse().value();
+    bflabels::BFLCode bfl(tokens);
+
+    std::stringstream in, text_out, labels_out;
+
+    auto text = Program::from_bf(bfl.compile());
+    Interpreter(*text, in, text_out).run();
+
+    auto labels = Program::from_labels(tokens, bfl, closed);
+    Interpreter(*labels, in, labels_out).run();
+
+    return { text_out.str(), labels_out.str() };
+}
+
+TEST(VMLabels, AbsoluteAddresses) {
+    using namespace bfvm;
+
+    auto tokens = bflabels::Parser("a++++++++[b++++++++a-]b+.+.").parse().value();
+    bflabels::BFLCode bfl(tokens);
+
+    auto program = Program::from_labels(tokens, bfl);
+    ASSERT_TRUE(program.has_value());
+
+    for (const Op& op : program->ops) {
+        ASSERT_NE(op.kind, OpKind::Move);
+    }
+    ASSERT_LT(program->ops.size(), Program::from_bf(bfl.compile())->ops.size());
+
+    auto [text, labels] = run_both("a++++++++[b++++++++a-]b+.+.");
+    ASSERT_EQ(labels, "AB");
+    ASSERT_EQ(labels, text);
+}
+
+TEST(VMLabels, RawMoves) {
+    auto [text, labels] = run_both("a+++b++++++++[>++++++++<-]>+.<a.");
+    ASSERT_EQ(labels, "A\x03");
+    ASSERT_EQ(labels, text);
+}
+
+TEST(VMLabels, DriftingLoops) {
+    // Unlabeled ops at the top of the body run on `b` after the first pass.
+    auto [text, labels] = run_both("a+b+++a[-b].");
+    ASSERT_EQ(labels, std::string(1, '\0'));
+    ASSERT_EQ(labels, text);
+
+    // A skipped loop leaves the pointer on its `[`.
+    std::tie(text, labels) = run_both("a+++b[-a].");
+    ASSERT_EQ(labels, std::string(1, '\0'));
+    ASSERT_EQ(labels, text);
+}
+
+TEST(VMLabels, ClosedLoops) {
+    using namespace bfvm;
+
+    auto tokens = bflabels::Parser("a+++[b++a-]b.").parse().value();
+    auto closed = bflabels::opt::find_closed_loops(tokens);
+    ASSERT_EQ(closed.size(), 1);
+
+    auto program = Program::from_labels(tokens, bflabels::BFLCode(tokens), closed);
+    ASSERT_EQ(program->ops[1].kind, OpKind::ClosedAt);
+
+    auto [text, labels] = run_both("a+++[b++a-]b.", closed);
+    ASSERT_EQ(labels, "\x06");
+    ASSERT_EQ(labels, text);
+}
+
+TEST(VMLabels, Tiering) {
+    using namespace bfvm;
+
+    std::string code = "a++++++++[b+++a-]b.a++[c+a-]c.a++++[b+a-]b.";
+    auto tokens = bflabels::Parser(code).parse().value();
+    auto closed = bflabels::opt::find_closed_loops(tokens);
+    ASSERT_EQ(closed.size(), 3);
+
+    bflabels::BFLCode bfl(tokens);
+    std::vector<std::set<uint32_t>> recompiles;
+
+    TierUp tier_up {
+        [&](const std::set<uint32_t>& hot) -> std::optional<Program> {
+            recompiles.push_back(hot);
+
+            bflabels::ClosedLoops picked;
+            for (uint32_t pos : hot) {
+                picked.insert(*closed.find(pos));
+            }
+            return *Program::from_labels(tokens, bfl, picked);
+        },
+        3,
+    };
+
+    std::stringstream in, out;
+    auto program = Program::from_labels(tokens, bfl);
+    ASSERT_TRUE(run_dialect(*program, Dialect {}, in, out, Interpreter::UNLIMITED, nullptr, &tier_up).has_value());
+
+    // The short middle loop never gets hot.
+    ASSERT_EQ(out.str(), "\x18\x02\x1c");
+    ASSERT_EQ(recompiles.size(), 2);
+    ASSERT_EQ(recompiles[0].size(), 1);
+    ASSERT_EQ(recompiles[1].size(), 2);
+}
+
+TEST(VMLabels, Errors) {
+    using namespace bfvm;
+
+    auto tokens = bflabels::Parser("a[b+").parse().value();
+    ASSERT_EQ(Program::from_labels(tokens, bflabels::BFLCode(tokens)).error(), RunError::UnbalancedLoops);
+}
+
+TEST(VMProfile, AttributesToMacros) {
+    using namespace bfasm;
+
+    std::string code =
+        "MACRO inc (x):\n"
+        "    x+++\n"
+        "MACRO main ():\n"
+        "    a+\n"
+        "    USE inc (a)\n";
+
+    auto tokens = parse::Tokenizer(code).tokenize();
+    auto unit = parse::Parser(*tokens).parse();
+    compiler::Compiler compiler(*unit);
+    ASSERT_FALSE(compiler.compile().has_value());
+
+    std::vector<size_t> token_map;
+    std::string bf = bflabels::BFLCode(compiler.result).compile(&token_map);
+    auto map = compiler::SourceMap::build(compiler, token_map);
+
+    auto program = bfvm::Program::from_bf(bf, false);
+    std::stringstream in, out;
+    bfvm::Interpreter interpreter(*program, in, out);
+    ASSERT_TRUE(interpreter.run(bfvm::Interpreter::UNLIMITED, true).has_value());
+
+    std::stringstream folded;
+    bfvm::Profile(*program, interpreter.op_counts, map).write_folded(folded);
+    ASSERT_EQ(folded.str(), "main 1\nmain;inc 3\n");
+}
+
+// Input that is always empty, noting what had reached `fd` when it was read.
+struct PeekingInput : std::streambuf {
+    int fd;
+    std::string seen;
+
+    explicit PeekingInput(int fd) : fd(fd) {}
+
+    int_type underflow() override {
+        char buffer[64];
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        seen.assign(buffer, std::max<ssize_t>(bytes, 0));
+        return traits_type::eof();
+    }
+};
+
+TEST(VMIO, FlushesBeforeInput) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    {
+        bfvm::FdOutput sink(fds[1]);
+        PeekingInput source(fds[0]);
+        std::ostream out(&sink);
+        std::istream in(&source);
+
+        auto program = bfvm::Program::from_bf("+++.,.");
+        ASSERT_TRUE(bfvm::Interpreter(*program, in, out).run().has_value());
+        ASSERT_EQ(source.seen, "\x03");
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(VMIO, MappedInput) {
+    FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    std::fputs("abc", file);
+    std::fflush(file);
+    lseek(fileno(file), 1, SEEK_SET);
+
+    {
+        bfvm::FdInput source(fileno(file));
+        std::istream in(&source);
+        std::stringstream out;
+
+        auto program = bfvm::Program::from_bf(",.,.,.");
+        ASSERT_TRUE(bfvm::Interpreter(*program, in, out).run().has_value());
+        ASSERT_EQ(out.str(), "bcc");
+    }
+
+    ASSERT_EQ(lseek(fileno(file), 0, SEEK_CUR), 3);
+    std::fclose(file);
+}
+
+TEST(VMBatch, Records) {
+    using namespace bfvm;
+    using Records = std::vector<std::string_view>;
+
+    ASSERT_EQ(split_records("ab\n\ncd", RecordFormat::Lines), (Records { "ab", "", "cd" }));
+    ASSERT_EQ(split_records("ab\n", RecordFormat::Lines), (Records { "ab" }));
+
+    std::stringstream framed;
+    write_record(framed, "a\nb", RecordFormat::Lengths);
+    write_record(framed, "", RecordFormat::Lengths);
+    std::string bytes = framed.str();
+
+    ASSERT_EQ(split_records(bytes, RecordFormat::Lengths), (Records { "a\nb", "" }));
+    ASSERT_EQ(split_records(std::string_view(bytes).substr(0, 5), RecordFormat::Lengths), std::nullopt);
+}
+
+TEST(VMBatch, RunsInOrder) {
+    using namespace bfvm;
+
+    // Echoes its input, then counts the runs its tape has seen, which stays
+    // one as tapes are cleared between runs.
+    auto program = Program::from_bf(",[.,]>+.");
+
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < 100; ++i) {
+        inputs.push_back(std::string(i % 7, 'a' + i % 26));
+    }
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+
+    Dialect dialect;
+    dialect.eof = EofBehavior::Zero;
+
+    auto runs = run_batch(*program, dialect, views, 4);
+    ASSERT_EQ(runs.size(), inputs.size());
+    for (size_t i = 0; i < runs.size(); ++i) {
+        ASSERT_TRUE(runs[i].result.has_value()) << i;
+        ASSERT_EQ(runs[i].output, inputs[i] + "\x01") << i;
+    }
+
+    auto limited = run_batch(*program, dialect, views, 3, 10);
+    ASSERT_TRUE(limited[1].result.has_value());
+    ASSERT_EQ(limited[6].result.error(), RunError::StepLimit);
+}
+
+TEST(VMBatch, TimesOut) {
+    using namespace bfvm;
+
+    // Records starting with a byte loop forever, and only they time out.
+    auto program = Program::from_bf(",[]+.");
+    std::vector<std::string_view> views { "", "x", "" };
+
+    auto runs = run_batch(*program, Dialect {}, views, 2, Interpreter::UNLIMITED, false, std::chrono::milliseconds(20));
+    ASSERT_EQ(runs[0].output, "\x01");
+    ASSERT_EQ(runs[1].result.error(), RunError::TimeLimit);
+    ASSERT_EQ(runs[2].output, "\x01");
+}
+
+TEST(VMBatch, Lockstep) {
+    using namespace bfvm;
+
+    // Inputs of every length up to 12 and a byte wrapping, for lanes to leave
+    // loops and move their pointers apart at different times.
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < 45; ++i) {
+        inputs.push_back(std::string(i % 13, static_cast<char>(i * 37 % 256)));
+    }
+    std::vector<std::string_view> views(inputs.begin(), inputs.end());
+
+    Dialect dialect;
+    dialect.eof = EofBehavior::Zero;
+
+    auto tokens = bflabels::Parser("a,[b++c+a-]b.c[-b+c]b.").parse().value();
+    std::vector<Program> programs;
+    programs.push_back(*Program::from_bf(",[>,]<[.<]"));
+    programs.push_back(*Program::from_bf(",[[->+>+<<]>[-<+>]>[.-]<<,]"));
+    programs.push_back(*Program::from_labels(tokens, bflabels::BFLCode(tokens)));
+
+    for (const Program& program : programs) {
+        for (uint64_t max_steps : { Interpreter::UNLIMITED, uint64_t { 60 } }) {
+            auto scalar = run_batch(program, dialect, views, 2, max_steps);
+            auto lockstep = run_batch(program, dialect, views, 2, max_steps, true);
+
+            ASSERT_EQ(lockstep.size(), scalar.size());
+            for (size_t i = 0; i < scalar.size(); ++i) {
+                ASSERT_EQ(lockstep[i].output, scalar[i].output) << i;
+                ASSERT_EQ(lockstep[i].result, scalar[i].result) << i;
+            }
+        }
+    }
+
+    // Lanes given input loop forever, until the group runs out of time.
+    auto spinning = Program::from_bf(",[]+.");
+    auto timed = run_batch(*spinning, dialect, views, 2, Interpreter::UNLIMITED, true, std::chrono::milliseconds(20));
+    ASSERT_EQ(timed[0].output, "\x01");
+    ASSERT_EQ(timed[1].result.error(), RunError::TimeLimit);
+    ASSERT_EQ(timed[40].result.error(), RunError::TimeLimit);
+
+    // Reversing the empty input moves off the left of the tape.
+    auto reversed = run_batch(programs[0], dialect, views, 1, Interpreter::UNLIMITED, true);
+    ASSERT_EQ(reversed[0].result.error(), RunError::TapeUnderflow);
+    ASSERT_EQ(reversed[3].output, std::string(3, static_cast<char>(111)));
+
+    // Lanes given input run off the right of a fixed tape, all at once, while
+    // the others go on past the loop.
+    Dialect fixed = dialect;
+    fixed.tape = TapePolicy::Fixed;
+    fixed.tape_cells = 4;
+
+    for (const char* code : { "+[>+]", ",[>+]+." }) {
+        auto program = Program::from_bf(code);
+        auto scalar = run_batch(*program, fixed, views, 1);
+        auto lockstep = run_batch(*program, fixed, views, 1, Interpreter::UNLIMITED, true);
+
+        for (size_t i = 0; i < scalar.size(); ++i) {
+            ASSERT_EQ(lockstep[i].output, scalar[i].output) << code << ' ' << i;
+            ASSERT_EQ(lockstep[i].result, scalar[i].result) << code << ' ' << i;
+        }
+        ASSERT_EQ(lockstep[1].result.error(), RunError::TapeOverflow) << code;
+    }
+}
+
+// Outputs and results of the sessions of a host, as it tells them.
+struct HostLog {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::map<uint64_t, std::string> outputs;
+    std::map<uint64_t, std::expected<void, bfvm::RunError>> results;
+
+    bfvm::SessionEvents events() {
+        return {
+            .output = [this](uint64_t session, std::string_view output) {
+                std::lock_guard lock(mutex);
+                outputs[session] += output;
+            },
+            .finished = [this](uint64_t session, std::expected<void, bfvm::RunError> result) {
+                std::lock_guard lock(mutex);
+                results.emplace(session, result);
+                done.notify_all();
+            },
+        };
+    }
+
+    void wait(size_t sessions) {
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return results.size() == sessions; });
+    }
+};
+
+TEST(VMHost, Sessions) {
+    using namespace bfvm;
+
+    auto echo = Program::from_bf(",[.,]");
+
+    Dialect dialect;
+    dialect.eof = EofBehavior::Zero;
+
+    // Sessions yield at every back-edge, on fewer threads than they are.
+    HostLog log;
+    std::vector<uint64_t> sessions;
+    {
+        Host host(*echo, dialect, log.events(), 3, Interpreter::UNLIMITED, 1);
+
+        for (size_t i = 0; i < 200; ++i) {
+            sessions.push_back(host.open());
+            host.feed(sessions.back(), "session ");
+        }
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            host.feed(sessions[i], std::to_string(i));
+            host.end_input(sessions[i]);
+            host.feed(sessions[i], "ignored");
+        }
+
+        // Closed sessions never finish.
+        host.close(host.open());
+
+        log.wait(sessions.size());
+    }
+
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        ASSERT_EQ(log.outputs[sessions[i]], "session " + std::to_string(i));
+        ASSERT_TRUE(log.results.at(sessions[i]).has_value());
+    }
+
+    // Waiting for input costs no steps, unlike running past `max_steps`.
+    HostLog limited;
+    {
+        Host host(*echo, dialect, limited.events(), 1, 50, 8);
+        uint64_t session = host.open();
+
+        host.feed(session, std::string(5, 'x'));
+        host.feed(session, std::string(100, 'y'));
+        limited.wait(1);
+    }
+
+    ASSERT_EQ(limited.results.at(0).error(), RunError::StepLimit);
+    ASSERT_TRUE(limited.outputs[0].starts_with("xxxxxyy"));
+    ASSERT_LT(limited.outputs[0].size(), 20);
+
+    // Sessions that never end run out of time, without holding up the others.
+    auto spinning = Program::from_bf(",[]");
+    HostLog timed;
+    {
+        Host host(*spinning, dialect, timed.events(), 1, Interpreter::UNLIMITED, HOST_SLICE_STEPS, std::chrono::milliseconds(20));
+        host.feed(host.open(), "x");
+        host.end_input(host.open());
+        timed.wait(2);
+    }
+
+    ASSERT_EQ(timed.results.at(0).error(), RunError::TimeLimit);
+    ASSERT_TRUE(timed.results.at(1).has_value());
+}
+
+TEST(VMHost, ServesUnixSocket) {
+    using namespace bfvm;
+
+    auto echo = Program::from_bf(",[.,]");
+
+    Dialect dialect;
+    dialect.eof = EofBehavior::Zero;
+
+    std::string path = "/tmp/bftrans-test-" + std::to_string(getpid()) + ".sock";
+    std::stringstream log;
+
+    std::jthread server([&](std::stop_token stop) {
+        ASSERT_TRUE(serve_unix(path, *echo, dialect, 2, Interpreter::UNLIMITED, std::nullopt, log, stop).has_value());
+    });
+
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+
+    auto client = [&] {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        while (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return fd;
+    };
+
+    int first = client();
+    int second = client();
+
+    ASSERT_EQ(write(first, "hello", 5), 5);
+    ASSERT_EQ(write(second, "other", 5), 5);
+    shutdown(first, SHUT_WR);
+    shutdown(second, SHUT_WR);
+
+    for (auto [fd, expected] : { std::pair { first, "hello" }, std::pair { second, "other" } }) {
+        std::string received;
+        char buffer[64];
+        for (ssize_t bytes; (bytes = read(fd, buffer, sizeof(buffer))) > 0;) {
+            received.append(buffer, bytes);
+        }
+        close(fd);
+        ASSERT_EQ(received, expected);
+    }
+
+    server.request_stop();
+    server.join();
+    ASSERT_EQ(access(path.c_str(), F_OK), -1);
+}